@@ -0,0 +1,148 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "autorange.hpp"
+#include "asymptotes.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * Determines if a function goes to infinity between two samples.
+ *
+ * @param fn The function
+ * @param A The first sample
+ * @param B The second sample
+ * @param xrange The width of the whole x-range
+ */
+static bool has_pole(Func fn, Point A, Point B, double xrange) {
+   // A sample may have landed right on the asymptote.
+   if (std::isinf(A.y) || std::isinf(B.y)) {
+      return true;
+   }
+
+   return goes_pos_inf(fn, A, B, xrange).y != 0 || goes_neg_inf(fn, A, B, xrange).y != 0;
+}
+
+YRange auto_yrange(BatchFunc batch, Func fn, double xmin, double xmax, int n) {
+   YRange range = { 0, 0, false };
+   if (!(xmin < xmax) || n < 1) {
+      return range;
+   }
+
+   ThreadPool &pool = ThreadPool::shared();
+   double h = (xmax - xmin) / n;
+   int64_t n_blocks = (n + RANGE_BLOCK) / RANGE_BLOCK;
+
+   std::vector<double> xs(n + 1), ys(n + 1);
+   pool.run(n_blocks, [&](int64_t k) {
+      int64_t lo = k * RANGE_BLOCK,
+              hi = std::min<int64_t>(lo + RANGE_BLOCK, n + 1);
+      for (int64_t i = lo; i < hi; i++) {
+         xs[i] = i == n ? xmax : xmin + i * h;
+      }
+
+      const double *args[1] = { &xs[lo] };
+      batch(args, &ys[lo], hi - lo);
+   });
+
+   std::vector<double> finite;
+   for (double y: ys) {
+      if (std::isfinite(y)) {
+         finite.push_back(y);
+      }
+   }
+
+   if (finite.empty()) {
+      return range;
+   }
+
+   // The samples between the quantiles are trusted as they are.
+   size_t lo_rank = (size_t)(RANGE_QUANTILE * (finite.size() - 1)),
+          hi_rank = finite.size() - 1 - lo_rank;
+   std::nth_element(finite.begin(), finite.begin() + lo_rank, finite.end());
+   double q_lo = finite[lo_rank];
+   std::nth_element(finite.begin(), finite.begin() + hi_rank, finite.end());
+   double q_hi = finite[hi_rank];
+
+   auto outlier = [&](int64_t i) {
+      return !(q_lo <= ys[i] && ys[i] <= q_hi);
+   };
+
+   // Only pieces next to an outlier can have an asymptote worth looking for.
+   std::vector<char> poles(n, false);
+   pool.run(n_blocks, [&](int64_t k) {
+      int64_t lo = k * RANGE_BLOCK,
+              hi = std::min<int64_t>(lo + RANGE_BLOCK, n);
+      for (int64_t i = lo; i < hi; i++) {
+         if (outlier(i) || outlier(i + 1)) {
+            poles[i] = has_pole(fn, { xs[i], ys[i] }, { xs[i + 1], ys[i + 1] }, xmax - xmin);
+         }
+      }
+   });
+
+   // The outliers running up to an asymptote from either side are left out.
+   std::vector<char> excluded(n + 1, false);
+   for (int64_t i = 0; i < n; i++) {
+      if (!poles[i]) {
+         continue;
+      }
+
+      for (int64_t j = i; j >= 0 && outlier(j) && !excluded[j]; j--) {
+         excluded[j] = true;
+      }
+
+      for (int64_t j = i + 1; j <= n && outlier(j) && !excluded[j]; j++) {
+         excluded[j] = true;
+      }
+   }
+
+   // Each block reduces what's left to a min and max.
+   std::vector<double> mins(n_blocks, INFINITY), maxes(n_blocks, -INFINITY);
+   pool.run(n_blocks, [&](int64_t k) {
+      int64_t lo = k * RANGE_BLOCK,
+              hi = std::min<int64_t>(lo + RANGE_BLOCK, n + 1);
+      for (int64_t i = lo; i < hi; i++) {
+         if (std::isfinite(ys[i]) && !excluded[i]) {
+            mins[k] = std::min(mins[k], ys[i]);
+            maxes[k] = std::max(maxes[k], ys[i]);
+         }
+      }
+   });
+
+   double ymin = *std::min_element(mins.begin(), mins.end()),
+          ymax = *std::max_element(maxes.begin(), maxes.end());
+   if (ymin > ymax) {
+      // Everything was next to an asymptote. The quantiles are the best there is.
+      ymin = q_lo;
+      ymax = q_hi;
+   }
+
+   double margin = RANGE_MARGIN * (ymax - ymin);
+   if (margin == 0) {
+      // A constant function is shown in the middle.
+      margin = std::max(std::fabs(ymin), 1.0);
+   }
+
+   range.ymin = ymin - margin;
+   range.ymax = ymax + margin;
+   range.found = true;
+   return range;
+}
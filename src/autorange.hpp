@@ -0,0 +1,60 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef AUTORANGE_HPP
+#define AUTORANGE_HPP
+
+#include "compile.hpp"
+
+/* Number of points the x-range is sampled at */
+#define RANGE_SAMPLES 4096
+
+/* Number of samples in each block evaluated by one pool task */
+#define RANGE_BLOCK 256
+
+/* Fraction of the samples at each end which are checked for asymptotes before they're trusted */
+#define RANGE_QUANTILE 0.02
+
+/* Fraction of the range added above and below it */
+#define RANGE_MARGIN 0.05
+
+/* A y-range found by sampling */
+struct YRange {
+   double ymin, ymax;
+
+   /* Were there any samples to take the range from? */
+   bool found;
+};
+
+/**
+ * Finds a y-range which shows a function well over an x-range.
+ * The function is sampled with its batch kernel across the thread pool.
+ * Samples beyond the RANGE_QUANTILE quantiles at either end are left out if they run up to
+ * an asymptote, and the range covers all of the rest, with a margin.
+ *
+ * @param batch The batch kernel of the function
+ * @param fn The function, used to search for asymptotes
+ * @param xmin The lower x bound
+ * @param xmax The upper x bound
+ * @param n How many pieces to cut the x-range into
+ *
+ * @return The y-range
+ */
+YRange auto_yrange(BatchFunc batch, Func fn, double xmin, double xmax, int n = RANGE_SAMPLES);
+
+#endif
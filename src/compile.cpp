@@ -17,9 +17,16 @@
  */
 
 #include "compile.hpp"
+#include "extrema.hpp"
+#include "poly.hpp"
+#include "quadrature.hpp"
+#include "roots.hpp"
+#include "series.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
@@ -36,6 +43,22 @@ FnTable::FnTable() {
    std::swap(*this, base);
 }
 
+ExprTable::~ExprTable() {
+   for (auto def: *this) {
+      destroy_expr(def.second);
+   }
+}
+
+void ExprTable::store(const std::string &name, Expr *expr) {
+   auto old = find(name);
+   if (old != end()) {
+      destroy_expr(old->second);
+      old->second = expr;
+   } else {
+      (*this)[name] = expr;
+   }
+}
+
 void ReportingException::report() {
    printf("Unknown exception thrown.\n\n");
 }
@@ -52,6 +75,30 @@ void NameResFail::report() {
    printf("Name could not be resolved.\nName given: %s\n\n", name.c_str());
 }
 
+DiffFail::DiffFail(const char *_name)
+   : name(_name)
+{}
+
+const char *DiffFail::what() {
+   return "Differentiation failure.";
+}
+
+void DiffFail::report() {
+   printf("Function could not be differentiated.\nName given: %s\n\n", name.c_str());
+}
+
+ArityFail::ArityFail(const char *_name)
+   : name(_name)
+{}
+
+const char *ArityFail::what() {
+   return "Wrong number of arguments.";
+}
+
+void ArityFail::report() {
+   printf("Function was given the wrong number of arguments.\nName given: %s\n\n", name.c_str());
+}
+
 ParseError::ParseError(char *_msg)
    : msg((const char *)_msg)
 {
@@ -66,9 +113,64 @@ void ParseError::report() {
    printf("The parser encountered an error: %s\n\n", msg.c_str());
 }
 
+FuncSignature arity_signature(int arity) {
+   switch (arity) {
+   case 0:
+      return FuncSignatureT<double>();
+   case 1:
+      return FuncSignatureT<double, double>();
+   case 2:
+      return FuncSignatureT<double, double, double>();
+   case 3:
+      return FuncSignatureT<double, double, double, double>();
+   default:
+      return FuncSignatureT<double, double, double, double, double>();
+   }
+}
+
+int fn_arity(const char *funcname, const ExecCtx &ectx) {
+   if (ectx.fnTable.find(funcname) != ectx.fnTable.end()) {
+      return 1;
+   }
+
+   auto nfn = ectx.nfnTable.find(funcname);
+   if (nfn == ectx.nfnTable.end()) {
+      throw new NameResFail(funcname);
+   }
+
+   return nfn->second.arity;
+}
+
+double call_nfunc(const NFunc &fn, const double *args) {
+   switch (fn.arity) {
+   case 1:
+      return ((double (*)(double))fn.fn)(args[0]);
+   case 2:
+      return ((double (*)(double, double))fn.fn)(args[0], args[1]);
+   case 3:
+      return ((double (*)(double, double, double))fn.fn)(args[0], args[1], args[2]);
+   default:
+      return ((double (*)(double, double, double, double))fn.fn)(args[0], args[1], args[2], args[3]);
+   }
+}
+
 CompCtx::CompCtx(JitRuntime &_rt,
                  CodeHolder &_code,
-                 const ExecCtx &_ectx)
+                 const ExecCtx &_ectx,
+                 int arity)
+   : CompCtx(_rt, _code, _ectx, arity_signature(arity))
+{
+   func->setArg(0, x);
+   for (int i = 1; i < arity; i++) {
+      args.push_back(cc.newXmm());
+      func->setArg(i, args[i]);
+   }
+}
+
+CompCtx::CompCtx(JitRuntime &_rt,
+                 CodeHolder &_code,
+                 const ExecCtx &_ectx,
+                 const FuncSignature &signature)
    : ectx(_ectx),
      cc(&_code),
      rt(_rt),
@@ -76,9 +178,9 @@ CompCtx::CompCtx(JitRuntime &_rt,
 {
    x = cc.newXmm();
    y = cc.newXmm();
+   args.push_back(x);
 
-   FuncNode *f = cc.addFunc(FuncSignatureT<double, double>());
-   f->setArg(0, x);
+   func = cc.addFunc(signature);
 }
 
 void CompCtx::conv_expr_rec(const Expr *expr) {
@@ -92,6 +194,12 @@ void CompCtx::conv_expr_rec(const Expr *expr) {
    case APPLY:
       conv_apply(expr->val.apply);
       break;
+   case INTEGRAL:
+      conv_integral(expr->val.integral);
+      break;
+   case DERIVATIVE:
+      conv_deriv(expr->val.derivative);
+      break;
    case VARIABLE:
       conv_var_expr(expr->val.varname);
       break;
@@ -103,7 +211,14 @@ void CompCtx::conv_expr_rec(const Expr *expr) {
 
       break;
    case ARGUMENT:
-      cc.movsd(y, x);
+      if (expr->val.argindex >= (int)args.size()) {
+         // Nothing here knows the parameter's name, only its position.
+         char msg[48];
+         snprintf(msg, sizeof(msg), "parameter %d is not defined here", expr->val.argindex + 1);
+         throw new ParseError(strdup(msg));
+      }
+
+      cc.movsd(y, args[expr->val.argindex]);
       break;
    }
 }
@@ -173,21 +288,117 @@ void CompCtx::conv_binary(const Binary *binary) {
    }
 }
 
+const void *CompCtx::resolve_fn(const char *funcname, int n_args) {
+   if (fn_arity(funcname, ectx) != n_args) {
+      throw new ArityFail(funcname);
+   }
+
+   if (n_args == 1) {
+      return (const void *)ectx.fnTable.at(funcname);
+   }
+
+   return ectx.nfnTable.at(funcname).fn;
+}
+
 void CompCtx::conv_apply(const Apply *apply) {
-   if (ectx.fnTable.find(apply->funcname) == ectx.fnTable.end()) {
-      throw new NameResFail(apply->funcname);
+   const void *target = resolve_fn(apply->funcname, apply->n_args);
+   if (apply->n_args == 1) {
+      conv_expr_rec(apply->args[0]);
+      InvokeNode *toFn;
+      cc.invoke(&toFn, target, FuncSignatureT<double, double>());
+
+      toFn->setArg(0, y);
+      toFn->setRet(0, y);
+      return;
+   }
+
+   // Every argument gets its own register, in which it's passed per the calling convention.
+   std::vector<x86::Xmm> vals;
+   for (int i = 0; i < apply->n_args; i++) {
+      conv_expr_rec(apply->args[i]);
+      vals.push_back(cc.newXmm());
+      cc.movsd(vals[i], y);
    }
 
-   conv_expr_rec(apply->arg);
    InvokeNode *toFn;
-   cc.invoke(&toFn,
-             ectx.fnTable.at(apply->funcname),
-             FuncSignatureT<double, double>());
+   cc.invoke(&toFn, target, arity_signature(apply->n_args));
+   for (int i = 0; i < apply->n_args; i++) {
+      toFn->setArg(i, vals[i]);
+   }
 
-   toFn->setArg(0, y);
    toFn->setRet(0, y);
 }
 
+void CompCtx::conv_integral(const Integral *integral) {
+   if (fn_arity(integral->funcname, ectx) != 1) {
+      throw new ArityFail(integral->funcname);
+   }
+
+   // A polynomial is integrated in closed form, through its antiderivative.
+   auto def = ectx.exprTable.find(integral->funcname);
+   Polynomial poly;
+   if (def != ectx.exprTable.end() && as_polynomial(def->second, ectx, poly)) {
+      Polynomial anti = poly.antiderivative();
+      Expr *anti_expr = anti.to_expr();
+      Expr *diff = new_binary(SUB,
+                              subst_arg(anti_expr, integral->upper),
+                              subst_arg(anti_expr, integral->lower));
+      conv_expr_rec(diff);
+      destroy_expr(diff);
+      destroy_expr(anti_expr);
+      return;
+   }
+
+   Func integrand = ectx.fnTable.at(integral->funcname);
+   if (is_const_expr(integral->lower) && is_const_expr(integral->upper)) {
+      // Constant bounds are folded, so no quadrature happens at runtime.
+      double area = integrate(integrand,
+                              eval_const(integral->lower),
+                              eval_const(integral->upper));
+
+      x86::Mem areaConst = cc.newDoubleConst(ConstPoolScope::kLocal, area);
+      cc.movsd(y, areaConst);
+      return;
+   }
+
+   x86::Xmm upper = cc.newXmm();
+   conv_expr_rec(integral->upper);
+   cc.movsd(upper, y);
+   conv_expr_rec(integral->lower);
+
+   x86::Gp fnPtr = cc.newIntPtr();
+   cc.mov(fnPtr, imm((intptr_t)integrand));
+
+   InvokeNode *toInt;
+   cc.invoke(&toInt,
+             &integrate,
+             FuncSignatureT<double, const void *, double, double>());
+   toInt->setArg(0, fnPtr);
+   toInt->setArg(1, y);
+   toInt->setArg(2, upper);
+   toInt->setRet(0, y);
+}
+
+void CompCtx::conv_deriv(const Derivative *derivative) {
+   Expr *expanded = expand_deriv(derivative->funcname, derivative->order, ectx);
+   try {
+      conv_expr_rec(expanded);
+   } catch (ReportingException *e) {
+      destroy_expr(expanded);
+      throw;
+   }
+
+   destroy_expr(expanded);
+}
+
+double CompCtx::eval_const(const Expr *expr) {
+   Func constFn = conv_expr(expr, rt, ectx);
+   double val = constFn(0);
+   rt.release(constFn);
+
+   return val;
+}
+
 void CompCtx::conv_var_expr(const char *varname) {
    if (ectx.varTable.find(varname) == ectx.varTable.end()) {
       throw new NameResFail(varname);
@@ -214,6 +425,84 @@ Func CompCtx::end() {
    return fn;
 }
 
+Expr *inline_expr(const Expr *expr, const ExecCtx &ectx) {
+   switch (expr->type) {
+   case UNARY:
+      return new_unary(expr->val.unary->op,
+                       inline_expr(expr->val.unary->inner, ectx));
+   case BINARY:
+      return new_binary(expr->val.binary->op,
+                        inline_expr(expr->val.binary->lhs, ectx),
+                        inline_expr(expr->val.binary->rhs, ectx));
+   case APPLY:
+      {
+         const Apply *apply = expr->val.apply;
+         auto def = ectx.exprTable.find(apply->funcname);
+         if (def != ectx.exprTable.end()
+             && fn_arity(apply->funcname, ectx) != apply->n_args) {
+            throw new ArityFail(apply->funcname);
+         }
+
+         Expr *inlined = new_apply(strdup(apply->funcname),
+                                   inline_expr(apply->args[0], ectx));
+         for (int i = 1; i < apply->n_args; i++) {
+            push_apply_arg(inlined, inline_expr(apply->args[i], ectx));
+         }
+
+         if (def == ectx.exprTable.end()) {
+            // A built-in, which the compiler calls directly.
+            return inlined;
+         }
+
+         Expr *substituted = subst_args(def->second,
+                                        inlined->val.apply->args,
+                                        apply->n_args);
+         destroy_expr(inlined);
+         return substituted;
+      }
+   case INTEGRAL:
+      return new_integral(strdup(expr->val.integral->funcname),
+                          inline_expr(expr->val.integral->lower, ectx),
+                          inline_expr(expr->val.integral->upper, ectx));
+   case DERIVATIVE:
+      return expand_deriv(expr->val.derivative->funcname,
+                          expr->val.derivative->order,
+                          ectx);
+   default:
+      return copy_expr(expr);
+   }
+}
+
+Expr *expand_deriv(const char *funcname, int order, const ExecCtx &ectx) {
+   if (fn_arity(funcname, ectx) != 1) {
+      throw new ArityFail(funcname);
+   }
+
+   Expr *expanded;
+   auto def = ectx.exprTable.find(funcname);
+   if (def != ectx.exprTable.end()) {
+      expanded = copy_expr(def->second);
+   } else {
+      expanded = new_apply(strdup(funcname), new_arg_expr());
+   }
+
+   for (int i = 0; i < order; i++) {
+      Expr *derived = derive_expr(expanded);
+      destroy_expr(expanded);
+      if (derived == nullptr) {
+         throw new DiffFail(funcname);
+      }
+
+      // Integrals differentiate into applications of their integrand,
+      // which have to be inlined before the next pass.
+      Expr *simplified = simplify_expr(derived);
+      expanded = inline_expr(simplified, ectx);
+      destroy_expr(simplified);
+   }
+
+   return expanded;
+}
+
 Func conv_expr(const Expr *expr,
                JitRuntime &rt,
                const ExecCtx &ectx) {
@@ -226,28 +515,276 @@ Func conv_expr(const Expr *expr,
    return ctx.end();   
 }
 
+Func conv_expr_deriv(const Expr *expr,
+                     JitRuntime &rt,
+                     const ExecCtx &ectx) {
+   Expr *inlined = inline_expr(expr, ectx);
+   Expr *derived = derive_expr(inlined);
+   destroy_expr(inlined);
+   if (derived == nullptr) {
+      return nullptr;
+   }
+
+   Expr *simplified = simplify_expr(derived);
+   try {
+      Func dfn = conv_expr(simplified, rt, ectx);
+      destroy_expr(simplified);
+      return dfn;
+   } catch (ReportingException *e) {
+      destroy_expr(simplified);
+      throw;
+   }
+}
+
+NFunc conv_expr_nary(const Expr *expr,
+                     int arity,
+                     JitRuntime &rt,
+                     const ExecCtx &ectx) {
+   CodeHolder code;
+   code.init(rt.environment(), rt.cpuFeatures());
+
+   CompCtx ctx(rt, code, ectx, arity);
+   ctx.conv_expr_rec(expr);
+
+   return { (void *)ctx.end(), arity };
+}
+
+BatchCtx::BatchCtx(JitRuntime &_rt,
+                   CodeHolder &_code,
+                   const ExecCtx &_ectx,
+                   int arity)
+   : CompCtx(_rt, _code, _ectx,
+             FuncSignatureT<void, const double *const *, double *, int64_t>())
+{
+   argv = cc.newIntPtr();
+   out = cc.newIntPtr();
+   n = cc.newInt64();
+
+   func->setArg(0, argv);
+   func->setArg(1, out);
+   func->setArg(2, n);
+
+   for (int i = 1; i < arity; i++) {
+      args.push_back(cc.newXmm());
+   }
+}
+
+void BatchCtx::conv_batch(const Expr *expr) {
+   std::vector<x86::Gp> arrays;
+   for (size_t k = 0; k < args.size(); k++) {
+      arrays.push_back(cc.newIntPtr());
+      cc.mov(arrays[k], x86::ptr(argv, k * sizeof(double *)));
+   }
+
+   x86::Gp i = cc.newInt64();
+   Label loop = cc.newLabel(),
+         done = cc.newLabel();
+
+   cc.xor_(i, i);
+   cc.bind(loop);
+   cc.cmp(i, n);
+   cc.jge(done);
+
+   for (size_t k = 0; k < args.size(); k++) {
+      cc.movsd(args[k], x86::ptr(arrays[k], i, 3));
+   }
+
+   conv_expr_rec(expr);
+   cc.movsd(x86::ptr(out, i, 3), y);
+
+   cc.inc(i);
+   cc.jmp(loop);
+   cc.bind(done);
+}
+
+BatchFunc BatchCtx::end() {
+   cc.ret();
+   cc.endFunc();
+   cc.finalize();
+
+   BatchFunc fn;
+   Error err = rt.add(&fn, &code);
+   if (err) {
+      printf("AsmJit failed: %s\n", DebugUtils::errorAsString(err));
+      exit(1);
+   }
+
+   return fn;
+}
+
+BatchFunc conv_expr_batch(const Expr *expr,
+                          int arity,
+                          JitRuntime &rt,
+                          const ExecCtx &ectx) {
+   CodeHolder code;
+   code.init(rt.environment(), rt.cpuFeatures());
+
+   BatchCtx ctx(rt, code, ectx, arity);
+   ctx.conv_batch(expr);
+
+   return ctx.end();
+}
+
+/**
+ * Answers a query about a function of one variable.
+ *
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ * @param query What was asked
+ * @param funcname The function it was asked about
+ * @param bounds The application holding the interval's bounds
+ * @param res Where to write the answer
+ */
+void answer_query(JitRuntime &rt,
+                  const ExecCtx &ectx,
+                  Query query,
+                  const std::string &funcname,
+                  const Expr *bounds,
+                  QueryResult &res) {
+   if (fn_arity(funcname.c_str(), ectx) != 1) {
+      throw new ArityFail(funcname.c_str());
+   }
+
+   Func fn = ectx.fnTable.at(funcname);
+
+   double lims[2] = { NAN, NAN };
+   for (int i = 0; i < bounds->val.apply->n_args; i++) {
+      Func bound = conv_expr(bounds->val.apply->args[i], rt, ectx);
+      lims[i] = bound(0);
+      rt.release(bound);
+   }
+
+   res.query = query;
+   res.funcname = funcname;
+   res.lower = lims[0];
+   res.upper = lims[1];
+   res.values.clear();
+   res.heights.clear();
+   res.maxima.clear();
+
+   double lo = std::min(lims[0], lims[1]),
+          hi = std::max(lims[0], lims[1]);
+
+   switch (query) {
+   case ROOTS_QUERY:
+      {
+         // Polynomial roots are isolated exactly, including the ones where it only touches 0.
+         auto def = ectx.exprTable.find(funcname);
+         Polynomial poly;
+         if (def != ectx.exprTable.end() && as_polynomial(def->second, ectx, poly)) {
+            res.values = poly.roots(lo, hi);
+         } else {
+            Expr *applied = new_apply(strdup(funcname.c_str()), new_arg_expr());
+            BatchFunc batch = conv_expr_batch(applied, 1, rt, ectx);
+            destroy_expr(applied);
+
+            res.values = find_roots(batch, fn, lo, hi);
+            rt.release(batch);
+         }
+      }
+      break;
+   case EXTREMA_QUERY:
+      {
+         Expr *applied = new_apply(strdup(funcname.c_str()), new_arg_expr());
+         Func deriv = conv_expr_deriv(applied, rt, ectx);
+         BatchFunc batch = conv_expr_batch(applied, 1, rt, ectx);
+         destroy_expr(applied);
+
+         for (const Extremum &ext: find_extrema(batch, fn, lo, hi, deriv)) {
+            res.values.push_back(ext.x);
+            res.heights.push_back(ext.y);
+            res.maxima.push_back(ext.maximum);
+         }
+
+         if (deriv != nullptr) {
+            rt.release(deriv);
+         }
+
+         rt.release(batch);
+      }
+      break;
+   case SUM_QUERY:
+   case LIMIT_QUERY:
+      {
+         SeriesResult series = query == SUM_QUERY ? sum_series(fn, lims[0]) : seq_limit(fn, lims[0]);
+         res.values.push_back(series.value);
+         res.error = series.error;
+         res.method = accel_name(series.method);
+         res.terms = series.terms;
+         res.converged = series.converged;
+      }
+      break;
+   case NO_QUERY:
+      break;
+   }
+}
+
 bool conv_eval_str(JitRuntime &rt,
                    const char *in,
                    ExecCtx &ectx,
                    Expr **expr,
                    double &result,
                    char **funcRes,
-                   char **varRes) {
+                   char **varRes,
+                   QueryResult *queryRes) {
    char *funcname = nullptr,
         *varname = nullptr;
 
    char *err = nullptr;
+   int arity = 1;
+   Query query = NO_QUERY;
    bool hasResult = false;
 
+   if (queryRes != nullptr) {
+      queryRes->query = NO_QUERY;
+   }
+
    yy_scan_string(in);
-   yyparse(expr, &funcname, &varname, &err);
+   yyparse(expr, &funcname, &varname, &arity, &err, &query);
    if (err != nullptr) {
+      free(funcname);
       throw new ParseError(err);
    }
+
+   if (query != NO_QUERY) {
+      std::string name = funcname;
+      free(funcname);
+      yylex_destroy();
+
+      if (queryRes == nullptr) {
+         throw new ParseError(strdup("queries can only be answered in the REPL"));
+      }
+
+      answer_query(rt, ectx, query, name, *expr, *queryRes);
+      return false;
+   }
+
+   if (arity != 1) {
+      if (arity > MAX_ARITY) {
+         ArityFail *fail = new ArityFail(funcname);
+         free(funcname);
+         throw fail;
+      }
+
+      NFunc nfn = conv_expr_nary(*expr, arity, rt, ectx);
+      ectx.fnTable.erase(funcname);
+      ectx.nfnTable[funcname] = nfn;
+      ectx.exprTable.store(funcname, inline_expr(*expr, ectx));
+      if (funcRes != nullptr) {
+         *funcRes = funcname;
+      } else {
+         free(funcname);
+      }
+
+      yylex_destroy();
+      return false;
+   }
    
    Func fn = conv_expr(*expr, rt, ectx);
    if (funcname != nullptr) {
+      ectx.nfnTable.erase(funcname);
       ectx.fnTable[funcname] = fn;
+      ectx.exprTable.store(funcname, inline_expr(*expr, ectx));
       if (funcRes != nullptr) {
          *funcRes = funcname;
       }
@@ -28,20 +28,62 @@ extern "C" {
 #include "../asmjit/src/asmjit/x86.h"
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <exception>
 
 using namespace asmjit;
 
 typedef double (*Func)(double);
 
+/* The most parameters a user-defined function can have.
+ * All of them are passed in XMM registers.
+ */
+#define MAX_ARITY 4
+
+/* A compiled function of several arguments.
+ * fn is a double (*)(double, ..., double) taking arity arguments.
+ */
+struct NFunc {
+   void *fn;
+   int arity;
+};
+
+/* A compiled function evaluated over arrays.
+ * args[k] holds the values of the kth argument, and n results are written to out.
+ */
+typedef void (*BatchFunc)(const double *const *args, double *out, int64_t n);
+
 /* A type for the REPL's symbol table */
 class FnTable : public std::unordered_map<std::string, Func> {
 public:
    FnTable();
 };
 
+/* A type for the REPL's table of functions of more than one argument */
+typedef std::unordered_map<std::string, NFunc> NFnTable;
+
 typedef std::unordered_map<std::string, double> VarTable;
 
+/* A table of the expressions behind user-defined functions.
+ * Owns the expressions it stores.
+ */
+class ExprTable : public std::unordered_map<std::string, Expr *> {
+public:
+   ExprTable() = default;
+
+   ExprTable(const ExprTable &) = delete;
+
+   ~ExprTable();
+
+   /**
+    * Stores an expression, replacing and freeing any old one.
+    *
+    * @param name The function name
+    * @param expr The expression to take ownership of
+    */
+   void store(const std::string &name, Expr *expr);
+};
+
 /* An exception with a method that prints a message */
 class ReportingException : public std::exception {
 public:
@@ -62,6 +104,34 @@ public:
    virtual void report();
 };
 
+/* Differentiation failure exception class.
+ * Thrown by the compiler when D(F) is used on something it can't differentiate.
+ */
+class DiffFail : public ReportingException {
+public:
+   std::string name;
+
+   DiffFail(const char *name);
+
+   virtual const char *what();
+
+   virtual void report();
+};
+
+/* Arity failure exception class.
+ * Thrown by the compiler when a function is given the wrong number of arguments.
+ */
+class ArityFail : public ReportingException {
+public:
+   std::string name;
+
+   ArityFail(const char *name);
+
+   virtual const char *what();
+
+   virtual void report();
+};
+
 class ParseError : public ReportingException {
 public:
    std::string msg;
@@ -75,7 +145,9 @@ public:
 
 struct ExecCtx {
    FnTable fnTable;
+   NFnTable nfnTable;
    VarTable varTable;
+   ExprTable exprTable;
 };
 
 /* A class to store information for the compiler.
@@ -87,12 +159,16 @@ public:
    x86::Compiler cc;
    x86::Xmm y, x;
 
+   /* The registers holding the arguments, starting with x */
+   std::vector<x86::Xmm> args;
+
    JitRuntime &rt;
    CodeHolder &code;
 
    CompCtx(JitRuntime &rt,
            CodeHolder &code,
-           const ExecCtx &ectx);
+           const ExecCtx &ectx,
+           int arity = 1);
 
    /**
     * Starts the recursive compilation of the expression.
@@ -108,6 +184,22 @@ public:
     */
    Func end();
 
+protected:
+   /* The function being compiled */
+   FuncNode *func;
+
+   /**
+    * Starts compiling a function with some other signature.
+    * The caller is responsible for binding its arguments, and for adding
+    * any after x to args.
+    *
+    * @param signature The function signature
+    */
+   CompCtx(JitRuntime &rt,
+           CodeHolder &code,
+           const ExecCtx &ectx,
+           const FuncSignature &signature);
+
 private:
    void conv_unary(const Unary *unary);
 
@@ -115,9 +207,106 @@ private:
 
    void conv_apply(const Apply *apply);
 
+   void conv_integral(const Integral *integral);
+
+   void conv_deriv(const Derivative *derivative);
+
    void conv_var_expr(const char *varname);
+
+   /**
+    * Looks up a function and checks that it takes the given number of arguments.
+    *
+    * @param funcname The function name
+    * @param n_args The number of arguments it is applied to
+    *
+    * @return A pointer to the function
+    */
+   const void *resolve_fn(const char *funcname, int n_args);
+
+   /**
+    * Evaluates an expression which does not depend on x at compile time.
+    *
+    * @param expr The constant expression
+    *
+    * @return Its value
+    */
+   double eval_const(const Expr *expr);
+};
+
+/* A class to store information for the compilation of a batch function. */
+class BatchCtx : public CompCtx {
+public:
+   BatchCtx(JitRuntime &rt,
+            CodeHolder &code,
+            const ExecCtx &ectx,
+            int arity);
+
+   /**
+    * Compiles the loop over the arrays around an expression.
+    *
+    * @param expr The expression to evaluate for every element
+    */
+   void conv_batch(const Expr *expr);
+
+   /**
+    * Finalizes the compiler
+    *
+    * @return The compiled function
+    */
+   BatchFunc end();
+
+private:
+   x86::Gp argv, out, n;
 };
 
+/**
+ * Gets the signature of a function taking some number of doubles and returning one.
+ *
+ * @param arity The number of arguments, from 0 to MAX_ARITY
+ */
+FuncSignature arity_signature(int arity);
+
+/**
+ * Gets the number of arguments a function takes.
+ * Throws a NameResFail if the function doesn't exist.
+ *
+ * @param funcname The function name
+ * @param ectx The context storing the symbol tables
+ */
+int fn_arity(const char *funcname, const ExecCtx &ectx);
+
+/**
+ * Calls a compiled function of several arguments.
+ *
+ * @param fn The function
+ * @param args Its arguments, fn.arity of them
+ *
+ * @return The result
+ */
+double call_nfunc(const NFunc &fn, const double *args);
+
+/**
+ * Makes a copy of an expression with every user-defined function applied in it
+ * replaced by its definition, and every derivative expanded.
+ *
+ * @param expr The expression to inline
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The new expression
+ */
+Expr *inline_expr(const Expr *expr, const ExecCtx &ectx);
+
+/**
+ * Symbolically differentiates a named function.
+ *
+ * @param funcname The function name
+ * @param order How many times to differentiate it
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The simplified derivative, in terms of x
+ */
+Expr *expand_deriv(const char *funcname, int order, const ExecCtx &ectx);
+
 /**
  * Converts the provided expression into a callable function.
  *
@@ -131,9 +320,76 @@ Func conv_expr(const Expr *expr,
                JitRuntime &rt,
                const ExecCtx &ectx);
 
+/**
+ * Differentiates an expression and compiles its derivative.
+ *
+ * @param expr The expression to differentiate
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled derivative, or nullptr if expr can't be differentiated
+ */
+Func conv_expr_deriv(const Expr *expr,
+                     JitRuntime &rt,
+                     const ExecCtx &ectx);
+
+/**
+ * Converts the provided expression into a callable function of several arguments.
+ *
+ * @param expr The expression to compile
+ * @param arity The number of parameters
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled function
+ */
+NFunc conv_expr_nary(const Expr *expr,
+                     int arity,
+                     JitRuntime &rt,
+                     const ExecCtx &ectx);
+
+/**
+ * Converts the provided expression into a function evaluating it over arrays.
+ *
+ * @param expr The expression to compile
+ * @param arity The number of parameters
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled function
+ */
+BatchFunc conv_expr_batch(const Expr *expr,
+                          int arity,
+                          JitRuntime &rt,
+                          const ExecCtx &ectx);
+
+/* The answer to a query statement, such as Roots(F, a, b), Extrema(F, a, b) or Sum(F, a) */
+struct QueryResult {
+   Query query;
+
+   /* The function asked about, and the interval it was asked about on.
+      Sums and limits only have a lower bound, where the sequence starts. */
+   std::string funcname;
+   double lower, upper;
+
+   /* The numbers found */
+   std::vector<double> values;
+
+   /* For extrema, the function's value at each, and whether it is a maximum */
+   std::vector<double> heights;
+   std::vector<bool> maxima;
+
+   /* For sums and limits, the estimate's error, the transform that gave it, and how many terms it took */
+   double error;
+   std::string method;
+   int terms;
+   bool converged;
+};
+
 /**
  * Evaluates an expression from a string.
  * Writes the result to the provided double.
+ * Queries are answered in queryRes, and are an error if it isn't provided.
  *
  * @param rt The asmjit runtime
  * @param in The input string
@@ -142,8 +398,9 @@ Func conv_expr(const Expr *expr,
  * @param result Where to write the result
  * @param funcRes Where to write the function name
  * @param varRes Where to write the var name
+ * @param queryRes Where to write the answer to a query
  *
- * @return true if the expression had a result (false if it was a definition).
+ * @return true if the expression had a result (false if it was a definition or query).
  */
 bool conv_eval_str(JitRuntime &rt,
                    const char *in,
@@ -151,7 +408,8 @@ bool conv_eval_str(JitRuntime &rt,
                    Expr **expr,
                    double &result,
                    char **funcRes = nullptr,
-                   char **varRes = nullptr);
+                   char **varRes = nullptr,
+                   QueryResult *queryRes = nullptr);
 
 #endif
 
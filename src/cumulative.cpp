@@ -0,0 +1,220 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "cumulative.hpp"
+#include "asymptotes.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/* 5-point Gauss-Legendre nodes and weights on [-1, 1] */
+static const double GL_NODES[5] = {
+   -0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831, 0.9061798459386640
+};
+
+static const double GL_WEIGHTS[5] = {
+   0.2369268850561891, 0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891
+};
+
+CumulativeIntegral::CumulativeIntegral(ThreadPool &_pool)
+   : expr(nullptr),
+     pool(_pool),
+     rt(nullptr),
+     ectx(nullptr),
+     fn(nullptr),
+     a(0),
+     b(0),
+     h(0)
+{}
+
+CumulativeIntegral::~CumulativeIntegral() {
+   release();
+   destroy_expr(expr);
+}
+
+void CumulativeIntegral::release() {
+   if (fn != nullptr) {
+      rt->release(fn);
+      fn = nullptr;
+   }
+}
+
+void CumulativeIntegral::set_expr(const Expr *_expr, JitRuntime &_rt, const ExecCtx &_ectx) {
+   if (expr != nullptr && equal_expr(expr, _expr) && rt == &_rt && ectx == &_ectx) {
+      return;
+   }
+
+   release();
+   destroy_expr(expr);
+
+   expr = copy_expr(_expr);
+   rt = &_rt;
+   ectx = &_ectx;
+   F.clear();
+}
+
+bool CumulativeIntegral::has_expr() const {
+   return expr != nullptr;
+}
+
+bool CumulativeIntegral::covers(double lo, double hi) const {
+   return !F.empty() && a <= lo && hi <= b && (hi - lo) * CUMUL_MAX_ZOOM >= b - a;
+}
+
+bool CumulativeIntegral::contains(double lo, double hi) const {
+   return !F.empty() && a <= lo && hi <= b;
+}
+
+void CumulativeIntegral::cover(double lo, double hi) {
+   if (expr != nullptr && lo < hi && !covers(lo, hi)) {
+      build(lo, hi);
+   }
+}
+
+void CumulativeIntegral::build(double lo, double hi) {
+   if (fn == nullptr) {
+      fn = conv_expr(expr, *rt, *ectx);
+   }
+
+   a = lo;
+   b = hi;
+   h = (hi - lo) / CUMUL_PANELS;
+
+   F.assign(CUMUL_PANELS + 1, 0);
+   f.assign(CUMUL_PANELS + 1, 0);
+   bad.assign(CUMUL_PANELS + 1, 0);
+
+   // First each block integrates its panels and sums them from the start of the block,
+   //  then the block totals are scanned, and finally each block adds the total before it.
+   int n_blocks = (CUMUL_PANELS + CUMUL_BLOCK - 1) / CUMUL_BLOCK;
+   std::vector<double> block_sums(n_blocks);
+   std::vector<int> block_bad(n_blocks);
+   pool.run(n_blocks, [&](int64_t k) {
+      int begin = k * CUMUL_BLOCK,
+          end = std::min(begin + CUMUL_BLOCK, CUMUL_PANELS);
+
+      double sum = 0;
+      int n_bad = 0;
+      Point A = Point::of(fn, a + begin * h);
+      for (int i = begin; i < end; i++) {
+         // The last panel ends exactly at b, rather than wherever the steps add up to.
+         Point B = Point::of(fn, i + 1 == CUMUL_PANELS ? b : a + (i + 1) * h);
+
+         double mid = A.x + h / 2,
+                panel = 0;
+         for (int j = 0; j < 5; j++) {
+            panel += GL_WEIGHTS[j] * fn(mid + GL_NODES[j] * h / 2);
+         }
+
+         // Poles right on a panel end are only seen by the function being infinite there.
+         panel *= h / 2;
+         bool pole = std::isinf(A.y) || std::isinf(B.y)
+                  || goes_pos_inf(fn, A, B, b - a).y != 0
+                  || goes_neg_inf(fn, A, B, b - a).y != 0;
+         if (!std::isfinite(panel) || pole) {
+            n_bad++;
+         } else {
+            sum += panel;
+         }
+
+         f[i] = A.y;
+         F[i + 1] = sum;
+         bad[i + 1] = n_bad;
+         A = B;
+      }
+
+      if (end == CUMUL_PANELS) {
+         f[end] = A.y;
+      }
+
+      block_sums[k] = sum;
+      block_bad[k] = n_bad;
+   });
+
+   double offset = 0;
+   int bad_offset = 0;
+   for (int k = 0; k < n_blocks; k++) {
+      double sum = block_sums[k];
+      int n_bad = block_bad[k];
+      block_sums[k] = offset;
+      block_bad[k] = bad_offset;
+      offset += sum;
+      bad_offset += n_bad;
+   }
+
+   pool.run(n_blocks, [&](int64_t k) {
+      int begin = k * CUMUL_BLOCK,
+          end = std::min(begin + CUMUL_BLOCK, CUMUL_PANELS);
+      for (int i = begin; i < end; i++) {
+         F[i + 1] += block_sums[k];
+         bad[i + 1] += block_bad[k];
+      }
+   });
+}
+
+int CumulativeIntegral::panel_of(double x) const {
+   return std::min((int)((x - a) / h), CUMUL_PANELS - 1);
+}
+
+double CumulativeIntegral::at(double x) const {
+   if (F.empty() || !(a <= x && x <= b)) {
+      return NAN;
+   }
+
+   int i = panel_of(x);
+   double t = (x - a) / h - i;
+   if (!std::isfinite(f[i]) || !std::isfinite(f[i + 1])) {
+      return F[i] + t * (F[i + 1] - F[i]);
+   }
+
+   // Cubic Hermite basis, with the function as the slope at either end
+   double t2 = t * t,
+          t3 = t2 * t;
+   return (2 * t3 - 3 * t2 + 1) * F[i]
+        + (t3 - 2 * t2 + t) * h * f[i]
+        + (-2 * t3 + 3 * t2) * F[i + 1]
+        + (t3 - t2) * h * f[i + 1];
+}
+
+bool CumulativeIntegral::continuous(double lo, double hi) const {
+   return bad[panel_of(std::max(lo, hi)) + 1] == bad[panel_of(std::min(lo, hi))];
+}
+
+double CumulativeIntegral::integral(double lo, double hi) const {
+   if (hi < lo) {
+      return -integral(hi, lo);
+   }
+
+   if (F.empty() || !(a <= lo && hi <= b)) {
+      return NAN;
+   }
+
+   if (!continuous(lo, hi)) {
+      return NAN;
+   }
+
+   return at(hi) - at(lo);
+}
+
+double CumulativeIntegral::lower() const {
+   return a;
+}
+
+double CumulativeIntegral::upper() const {
+   return b;
+}
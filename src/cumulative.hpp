@@ -0,0 +1,159 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef CUMULATIVE_HPP
+#define CUMULATIVE_HPP
+
+#include "compile.hpp"
+#include "threadpool.hpp"
+#include <vector>
+
+/* Number of panels in a table. Each is integrated with a 5-point Gauss-Legendre rule. */
+#define CUMUL_PANELS 4096
+
+/* Number of panels in each block of the prefix sum */
+#define CUMUL_BLOCK 256
+
+/* A table is rebuilt for a range this many times narrower than it, to keep its resolution */
+#define CUMUL_MAX_ZOOM 8
+
+/* A table of the integral of a function from the start of a range,
+ *  so that any definite integral inside the range is the difference of two lookups.
+ * Between panel ends the integral is interpolated with cubic Hermite polynomials,
+ *  since the function itself is the integral's derivative.
+ * The table is kept until the expression changes or a range it doesn't cover is asked for.
+ */
+class CumulativeIntegral {
+   /* The integrand */
+   Expr *expr;
+
+   ThreadPool &pool;
+
+   JitRuntime *rt;
+   const ExecCtx *ectx;
+
+   /* Compiled when a table is first built */
+   Func fn;
+
+   /* The range of the table, and the width of its panels */
+   double a, b, h;
+
+   /* The integral from a to each panel end, and the function's value there */
+   std::vector<double> F, f;
+
+   /* Number of panels up to each panel end with a pole or an undefined integral.
+    * Integrals across any of them are undefined, and they add nothing to F.
+    * This includes integrable singularities, which are left to Integral(F, a, b).
+    */
+   std::vector<int> bad;
+
+   /**
+    * Releases the compiled function.
+    */
+   void release();
+
+   /**
+    * Fills the table for a range, with the panels integrated and summed across the thread pool.
+    *
+    * @param lo The start of the range
+    * @param hi The end of the range
+    */
+   void build(double lo, double hi);
+
+   /**
+    * Gets the index of the panel containing x, which must be in the range.
+    */
+   int panel_of(double x) const;
+
+public:
+   /**
+    * @param pool The threads to build tables on
+    */
+   CumulativeIntegral(ThreadPool &pool = ThreadPool::shared());
+
+   ~CumulativeIntegral();
+
+   CumulativeIntegral(const CumulativeIntegral &) = delete;
+
+   /**
+    * Sets the integrand. Does nothing if it's the same as the current one.
+    *
+    * @param expr The expression
+    * @param rt The runtime to compile it with
+    * @param ectx The context to compile it in
+    */
+   void set_expr(const Expr *expr, JitRuntime &rt, const ExecCtx &ectx);
+
+   /* Has an integrand been set? */
+   bool has_expr() const;
+
+   /**
+    * Does the current table cover a range, at a fine enough resolution?
+    */
+   bool covers(double lo, double hi) const;
+
+   /**
+    * Are both ends of a range inside the current table, at whatever resolution?
+    */
+   bool contains(double lo, double hi) const;
+
+   /**
+    * Makes sure the table covers a range, building a new one over exactly that range if not.
+    *
+    * @param lo The start of the range
+    * @param hi The end of the range
+    */
+   void cover(double lo, double hi);
+
+   /**
+    * Checks that no pole or undefined panel lies between two points in the table.
+    */
+   bool continuous(double lo, double hi) const;
+
+   /**
+    * Looks up a definite integral in the table.
+    * If hi < lo, the result is negated as usual.
+    *
+    * @param lo The lower bound
+    * @param hi The upper bound
+    *
+    * @return The integral, or NaN if it's outside the table or crosses a pole
+    */
+   double integral(double lo, double hi) const;
+
+   /**
+    * Gets the integral from the start of the table to x, leaving out any undefined panels.
+    *
+    * @param x The upper bound
+    *
+    * @return The integral, or NaN if x is outside the table
+    */
+   double at(double x) const;
+
+   /**
+    * Gets the start of the range covered.
+    */
+   double lower() const;
+
+   /**
+    * Gets the end of the range covered.
+    */
+   double upper() const;
+};
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "curve.hpp"
+#include "asymptotes.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/* How far from a whole number of columns a view can be moved and still count as a pan */
+#define CURVE_PAN_TOLERANCE 1e-6
+
+CurveCache::CurveCache()
+   : expr(nullptr),
+     rt(nullptr),
+     ectx(nullptr),
+     fn(nullptr),
+     xmin(0),
+     xmax(0),
+     width(0)
+{}
+
+CurveCache::~CurveCache() {
+   release();
+   destroy_expr(expr);
+}
+
+void CurveCache::release() {
+   if (fn != nullptr) {
+      rt->release(fn);
+      fn = nullptr;
+   }
+}
+
+void CurveCache::set_expr(const Expr *_expr, JitRuntime &_rt, const ExecCtx &_ectx) {
+   if (expr != nullptr && equal_expr(expr, _expr) && rt == &_rt && ectx == &_ectx) {
+      return;
+   }
+
+   release();
+   destroy_expr(expr);
+
+   expr = copy_expr(_expr);
+   rt = &_rt;
+   ectx = &_ectx;
+
+   // The old curve is of a different function, so it's no use as a preview either.
+   std::fill(known.begin(), known.end(), false);
+   std::fill(spans.begin(), spans.end(), 0);
+   preview.clear();
+}
+
+void CurveCache::set_view(double _xmin, double _xmax, int _width) {
+   if (_xmin == xmin && _xmax == xmax && _width == width) {
+      return;
+   }
+
+   // A pan keeps the width of the view and moves it by a whole number of columns.
+   double step = (xmax - xmin) / width,
+          shift = width > 0? (_xmin - xmin) / step: 0;
+   long long k = std::llround(shift);
+   bool panned = _width == width
+              && width > 0
+              && std::fabs((_xmax - _xmin) - (xmax - xmin)) <= CURVE_PAN_TOLERANCE * step
+              && std::fabs(shift - k) <= CURVE_PAN_TOLERANCE
+              && std::llabs(k) < width;
+
+   if (!panned && covered()) {
+      preview = get_ops();
+   }
+
+   std::vector<double> old_samples(_width + 1, NAN);
+   std::vector<bool> old_known(_width + 1, false);
+   std::vector<std::vector<CurveOp>> old_columns(_width);
+   std::vector<int> old_spans(_width, 0);
+   samples.swap(old_samples);
+   known.swap(old_known);
+   columns.swap(old_columns);
+   spans.swap(old_spans);
+
+   if (panned) {
+      for (int i = std::max(0, (int) -k); i <= width && i + k <= width; i++) {
+         samples[i] = old_samples[i + k];
+         known[i] = old_known[i + k];
+      }
+
+      // Spans cut off by the new edge are dropped.
+      for (int i = std::max(0, (int) -k); i < width && i + k < width; i++) {
+         if (i + old_spans[i + k] <= width) {
+            columns[i].swap(old_columns[i + k]);
+            spans[i] = old_spans[i + k];
+         }
+      }
+   }
+
+   xmin = _xmin;
+   xmax = _xmax;
+   width = _width;
+}
+
+bool CurveCache::complete() const {
+   if (width <= 0) {
+      return false;
+   }
+
+   for (int i = 0; i < width; i++) {
+      if (spans[i] != 1) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool CurveCache::covered() const {
+   if (width <= 0) {
+      return false;
+   }
+
+   for (int i = 0; i < width; i += spans[i]) {
+      if (spans[i] == 0) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool CurveCache::has_preview() const {
+   return !preview.empty();
+}
+
+double CurveCache::edge_x(int i) const {
+   return ((double) i / width) * (xmax - xmin) + xmin;
+}
+
+double CurveCache::sample(int i) {
+   if (!known[i]) {
+      samples[i] = fn(edge_x(i));
+      known[i] = true;
+   }
+
+   return samples[i];
+}
+
+void CurveCache::trace(int i, int n) {
+   std::vector<CurveOp> &ops = columns[i];
+   ops.clear();
+   spans[i] = n;
+
+   double xrange = xmax - xmin,
+          x = edge_x(i + n);
+   Point A = { edge_x(i), sample(i) },
+         B = { x, sample(i + n) };
+
+   if (std::isnan(A.y) || std::isnan(B.y)) {
+      ops.push_back({ CURVE_STROKE, 0, 0 });
+      return;
+   }
+
+   Point mid = midpoint(A, B);
+   if (std::isinf(mid.y)) {
+      ops.push_back({ CURVE_EDGE, x, mid.y });
+      return;
+   }
+
+   Point pos_inf = goes_pos_inf(fn, A, B, xrange);
+   Point neg_inf = { 0, 0 };
+   if (pos_inf.y != 0) {
+      // Check if it goes to infinity from the left or the right.
+      // Assumes a continuous ascent from whichever side
+      double lhs_mid = fn((A.x + pos_inf.x) / 2.0);
+      if (lhs_mid > A.y) {
+         // We assume it comes from the left
+         ops.push_back({ CURVE_LINE, pos_inf.x, INFINITY });
+
+         // What's on the other side?
+         neg_inf = goes_neg_inf(fn, pos_inf, B, xrange);
+         if (neg_inf.y != 0) {
+            ops.push_back({ CURVE_STROKE, 0, 0 });
+            ops.push_back({ CURVE_MOVE, neg_inf.x, -INFINITY });
+         } else {
+            pos_inf = goes_pos_inf(fn, pos_inf, B, xrange);
+            if (pos_inf.y == 0) {
+               // It doesn't go to infinity and come back.
+               // There's some other kind of jump.
+               ops.push_back({ CURVE_STROKE, 0, 0 });
+            }
+         }
+      } else {
+         // We assume it comes from the right.
+         // But then what happens on the left side?
+         neg_inf = goes_neg_inf(fn, A, pos_inf, xrange);
+         if (neg_inf.y != 0) {
+            ops.push_back({ CURVE_LINE, neg_inf.x, -INFINITY });
+            ops.push_back({ CURVE_STROKE, 0, 0 });
+         } else {
+            Point lhs_pos_inf = goes_pos_inf(fn, A, pos_inf, xrange);
+            if (lhs_pos_inf.y == 0) {
+               ops.push_back({ CURVE_STROKE, 0, 0 });
+            }
+         }
+
+         ops.push_back({ CURVE_MOVE, pos_inf.x, INFINITY });
+      }
+   } else {
+      // The mirror image of the above.
+      neg_inf = goes_neg_inf(fn, A, B, xrange);
+      if (neg_inf.y != 0) {
+         double lhs_mid = fn((A.x + neg_inf.x) / 2.0);
+         if (lhs_mid < A.y) {
+            ops.push_back({ CURVE_LINE, neg_inf.x, -INFINITY });
+
+            pos_inf = goes_pos_inf(fn, neg_inf, B, xrange);
+            if (pos_inf.y != 0) {
+               ops.push_back({ CURVE_STROKE, 0, 0 });
+               ops.push_back({ CURVE_MOVE, pos_inf.x, INFINITY });
+            } else {
+               neg_inf = goes_neg_inf(fn, neg_inf, B, xrange);
+               if (neg_inf.y == 0) {
+                  ops.push_back({ CURVE_STROKE, 0, 0 });
+               }
+            }
+         } else {
+            pos_inf = goes_pos_inf(fn, neg_inf, A, xrange);
+            if (pos_inf.y != 0) {
+               ops.push_back({ CURVE_LINE, pos_inf.x, INFINITY });
+               ops.push_back({ CURVE_STROKE, 0, 0 });
+            } else {
+               Point lhs_neg_inf = goes_neg_inf(fn, neg_inf, A, xrange);
+               if (lhs_neg_inf.y == 0) {
+                  ops.push_back({ CURVE_STROKE, 0, 0 });
+               }
+            }
+
+            ops.push_back({ CURVE_MOVE, neg_inf.x, INFINITY });
+         }
+      }
+   }
+
+   if (pos_inf.y == 0 && neg_inf.y == 0) {
+      // No discontinuity. The line is drawn through the midpoint.
+      ops.push_back({ CURVE_POINT, mid.x, mid.y });
+   }
+}
+
+int CurveCache::unit(int i) const {
+   if (spans[i] > 0) {
+      return spans[i];
+   }
+
+   int n = 1;
+   while (n < CURVE_COARSEST && i + n < width && spans[i + n] == 0) {
+      n++;
+   }
+
+   return n;
+}
+
+bool CurveCache::pass(int s, std::chrono::steady_clock::time_point deadline) {
+   if (fn == nullptr) {
+      fn = conv_expr(expr, *rt, *ectx);
+   }
+
+   // Each span of the pass before is split whole, so the curve never has a gap in it.
+   for (int i = 0; i < width;) {
+      int n = unit(i);
+      if (spans[i] == 0 || n > s) {
+         for (int j = i; j < i + n; j += s) {
+            trace(j, std::min(s, i + n - j));
+         }
+
+         if (std::chrono::steady_clock::now() > deadline && i + n < width) {
+            return false;
+         }
+      }
+
+      i += n;
+   }
+
+   return true;
+}
+
+void CurveCache::compute() {
+   if (expr != nullptr && width > 0) {
+      pass(1, std::chrono::steady_clock::time_point::max());
+      preview.clear();
+   }
+}
+
+void CurveCache::cover() {
+   if (expr != nullptr && width > 0) {
+      pass(CURVE_COARSEST, std::chrono::steady_clock::time_point::max());
+      preview.clear();
+   }
+}
+
+bool CurveCache::refine(double budget) {
+   if (expr == nullptr || width <= 0) {
+      return false;
+   }
+
+   auto deadline = std::chrono::steady_clock::now()
+                 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                      std::chrono::duration<double>(budget));
+   for (int s = CURVE_COARSEST; s >= 1; s /= 2) {
+      if (!pass(s, deadline)) {
+         return true;
+      }
+
+      // The preview is only needed until the curve has no gaps.
+      preview.clear();
+   }
+
+   return false;
+}
+
+std::vector<CurveOp> CurveCache::get_ops() const {
+   if (!covered() && has_preview()) {
+      return preview;
+   }
+
+   // Columns not traced yet leave a break in the curve.
+   std::vector<CurveOp> ops;
+   for (int i = 0; i < width; i += std::max(spans[i], 1)) {
+      if (spans[i] == 0) {
+         ops.push_back({ CURVE_STROKE, 0, 0 });
+      } else {
+         ops.insert(ops.end(), columns[i].begin(), columns[i].end());
+      }
+   }
+
+   return ops;
+}
@@ -0,0 +1,198 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef CURVE_HPP
+#define CURVE_HPP
+
+#include "compile.hpp"
+#include <chrono>
+#include <vector>
+
+/* Width in columns of the spans traced by the first, coarsest pass. Each pass after it halves them. */
+#define CURVE_COARSEST 8
+
+/* Seconds of tracing between redraws while a curve is refined, about half a frame */
+#define CURVE_BUDGET 0.008
+
+/* Steps in drawing a curve, in graph coordinates.
+ * An infinite y stands for the top or bottom edge of the window.
+ */
+enum CurveOpKind {
+   /* Start a new piece of the curve at a point */
+   CURVE_MOVE,
+
+   /* Continue the curve to a point */
+   CURVE_LINE,
+
+   /* End the current piece of the curve */
+   CURVE_STROKE,
+
+   /* The curve leaves the window through the edge at x, in the direction of y */
+   CURVE_EDGE,
+
+   /* The curve passes through a point, which may be outside the window */
+   CURVE_POINT
+};
+
+struct CurveOp {
+   CurveOpKind kind;
+   double x, y;
+};
+
+/* The plotted curve of a function, traced in spans of pixel columns.
+ * Each span is traced from the function's values at its edges, with a search for
+ *  asymptotes between them, and the result is kept as drawing steps, so drawing the
+ *  same view again evaluates nothing.
+ * The curve is refined from spans of CURVE_COARSEST columns down to single ones,
+ *  with every pass reusing the values at the edges of the spans before it.
+ * A view that's a whole number of columns over from the last one keeps the spans
+ *  they share. Any other change keeps the whole old curve as a preview, to be drawn
+ *  in the new view until the first pass over it is done.
+ */
+class CurveCache {
+   /* The function being plotted */
+   Expr *expr;
+
+   JitRuntime *rt;
+   const ExecCtx *ectx;
+
+   /* Compiled when the first column is traced */
+   Func fn;
+
+   /* The view, and its width in columns */
+   double xmin, xmax;
+   int width;
+
+   /* The function at each column edge, and whether it's been evaluated there */
+   std::vector<double> samples;
+   std::vector<bool> known;
+
+   /* The drawing steps of the span starting at each column, and its width.
+    * The width is 0 for columns inside a span, or not traced at all.
+    */
+   std::vector<std::vector<CurveOp>> columns;
+   std::vector<int> spans;
+
+   /* The curve of an earlier view */
+   std::vector<CurveOp> preview;
+
+   /**
+    * Releases the compiled function.
+    */
+   void release();
+
+   /**
+    * Gets the x of a column edge.
+    */
+   double edge_x(int i) const;
+
+   /**
+    * Gets the function at a column edge, evaluating it only the first time.
+    */
+   double sample(int i);
+
+   /**
+    * Traces one span, leaving its drawing steps in columns[i].
+    *
+    * @param i The first column
+    * @param n The number of columns
+    */
+   void trace(int i, int n);
+
+   /**
+    * Gets the width of the span starting at a column,
+    *  or of the untraced gap there, up to CURVE_COARSEST.
+    */
+   int unit(int i) const;
+
+   /**
+    * Traces spans of at most s columns wherever the ones so far are wider or missing.
+    *
+    * @param s The widest span to keep
+    * @param deadline When to stop, checked after each span of the pass before is split
+    *
+    * @return Was the pass finished?
+    */
+   bool pass(int s, std::chrono::steady_clock::time_point deadline);
+
+public:
+   CurveCache();
+
+   ~CurveCache();
+
+   CurveCache(const CurveCache &) = delete;
+
+   /**
+    * Sets the function to plot. Does nothing if it's the same as the current one.
+    *
+    * @param expr The expression
+    * @param rt The runtime to compile it with
+    * @param ectx The context to compile it in
+    */
+   void set_expr(const Expr *expr, JitRuntime &rt, const ExecCtx &ectx);
+
+   /**
+    * Sets the view, keeping whatever of the old one still applies.
+    *
+    * @param xmin The lower x bound
+    * @param xmax The upper x bound
+    * @param width The width of the window in pixels
+    */
+   void set_view(double xmin, double xmax, int width);
+
+   /**
+    * Have all the columns of the current view been traced one at a time?
+    */
+   bool complete() const;
+
+   /**
+    * Is every column of the current view in a traced span?
+    */
+   bool covered() const;
+
+   /**
+    * Is there an earlier curve to draw until this one is complete?
+    */
+   bool has_preview() const;
+
+   /**
+    * Traces every column that hasn't been yet, one at a time.
+    */
+   void compute();
+
+   /**
+    * Runs the coarsest pass over every column not in a span yet.
+    */
+   void cover();
+
+   /**
+    * Refines the curve a pass at a time, for as long as the budget allows.
+    *
+    * @param budget The number of seconds to spend
+    *
+    * @return Is there more to refine?
+    */
+   bool refine(double budget);
+
+   /**
+    * Gets the drawing steps of the curve, or of the preview if it isn't covered yet.
+    */
+   std::vector<CurveOp> get_ops() const;
+};
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "cxcompile.hpp"
+
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+
+using namespace asmjit;
+
+/* Largest integer exponent which is expanded into multiplications */
+#define MAX_INT_POW 64
+
+typedef std::complex<double> Complex;
+
+/* The complex versions of the built-ins, called from compiled code.
+ * Each replaces the number at z with its result.
+ */
+static void cx_sqrt(double *z) {
+   Complex w = std::sqrt(Complex(z[0], z[1]));
+   z[0] = w.real();
+   z[1] = w.imag();
+}
+
+static void cx_log(double *z) {
+   Complex w = std::log(Complex(z[0], z[1]));
+   z[0] = w.real();
+   z[1] = w.imag();
+}
+
+static void cx_sin(double *z) {
+   Complex w = std::sin(Complex(z[0], z[1]));
+   z[0] = w.real();
+   z[1] = w.imag();
+}
+
+static void cx_cos(double *z) {
+   Complex w = std::cos(Complex(z[0], z[1]));
+   z[0] = w.real();
+   z[1] = w.imag();
+}
+
+static void cx_tan(double *z) {
+   Complex w = std::tan(Complex(z[0], z[1]));
+   z[0] = w.real();
+   z[1] = w.imag();
+}
+
+/**
+ * Raises the complex number at z to the power after it, leaving the result at z.
+ */
+static void cx_pow(double *z) {
+   Complex w = std::pow(Complex(z[0], z[1]), Complex(z[2], z[3]));
+   z[0] = w.real();
+   z[1] = w.imag();
+}
+
+static const std::unordered_map<std::string, void (*)(double *)> CX_FNS =
+   {{ "Sqrt", &cx_sqrt },
+    { "Log",  &cx_log  },
+    { "Sin",  &cx_sin  },
+    { "Cos",  &cx_cos  },
+    { "Tan",  &cx_tan  }};
+
+CxCompCtx::CxCompCtx(JitRuntime &_rt,
+                     CodeHolder &_code,
+                     const ExecCtx &_ectx)
+   : ectx(_ectx),
+     cc(&_code),
+     rt(_rt),
+     code(_code)
+{
+   y = cc.newXmm();
+   z = cc.newXmm();
+   in = cc.newIntPtr();
+   out = cc.newIntPtr();
+   n = cc.newInt64();
+
+   FuncNode *f = cc.addFunc(FuncSignatureT<void, const double *, double *, int64_t>());
+   f->setArg(0, in);
+   f->setArg(1, out);
+   f->setArg(2, n);
+}
+
+void CxCompCtx::conv_batch(const Expr *expr) {
+   x86::Gp i = cc.newInt64();
+   Label loop = cc.newLabel(),
+         done = cc.newLabel();
+
+   cc.xor_(i, i);
+   cc.bind(loop);
+   cc.cmp(i, n);
+   cc.jge(done);
+
+   cc.movupd(z, x86::ptr(in));
+   conv_expr_rec(expr);
+   cc.movupd(x86::ptr(out), y);
+
+   cc.add(in, 16);
+   cc.add(out, 16);
+   cc.inc(i);
+   cc.jmp(loop);
+   cc.bind(done);
+}
+
+void CxCompCtx::conv_expr_rec(const Expr *expr) {
+   switch (expr->type) {
+   case UNARY:
+      conv_unary(expr->val.unary);
+      break;
+   case BINARY:
+      conv_binary(expr->val.binary);
+      break;
+   case APPLY:
+      conv_apply(expr->val.apply);
+      break;
+   case INTEGRAL:
+      {
+         // Only integrals along the real line make sense, so the bounds can't depend on x.
+         if (!is_const_expr(expr)) {
+            throw new ParseError(strdup("integrals over the complex plane need constant bounds"));
+         }
+
+         Func area = conv_expr(expr, rt, ectx);
+         load_real(area(0));
+         rt.release(area);
+      }
+
+      break;
+   case DERIVATIVE:
+      {
+         Expr *expanded = expand_deriv(expr->val.derivative->funcname,
+                                       expr->val.derivative->order,
+                                       ectx);
+         try {
+            conv_expr_rec(expanded);
+         } catch (ReportingException *e) {
+            destroy_expr(expanded);
+            throw;
+         }
+
+         destroy_expr(expanded);
+      }
+
+      break;
+   case VARIABLE:
+      if (ectx.varTable.find(expr->val.varname) == ectx.varTable.end()) {
+         throw new NameResFail(expr->val.varname);
+      }
+
+      load_real(ectx.varTable.at(expr->val.varname));
+      break;
+   case NUMBER:
+      load_real(expr->val.number);
+      break;
+   case ARGUMENT:
+      if (expr->val.argindex != 0) {
+         char msg[48];
+         snprintf(msg, sizeof(msg), "parameter %d is not defined here", expr->val.argindex + 1);
+         throw new ParseError(strdup(msg));
+      }
+
+      cc.movapd(y, z);
+      break;
+   }
+}
+
+void CxCompCtx::conv_unary(const Unary *unary) {
+   conv_expr_rec(unary->inner);
+   switch (unary->op) {
+   case NEG:
+      cc.xorpd(y, pair_const(-0.0, -0.0));
+      break;
+   case ABS:
+      {
+         // |y| = sqrt(re^2 + im^2), as a real number
+         x86::Xmm sq = cc.newXmm(),
+                  swapped = cc.newXmm();
+
+         cc.movapd(sq, y);
+         cc.mulpd(sq, sq);
+         cc.movapd(swapped, sq);
+         cc.shufpd(swapped, swapped, 1);
+         cc.addsd(sq, swapped);
+         cc.sqrtsd(sq, sq);
+         cc.xorpd(y, y);
+         cc.movsd(y, sq);
+      }
+
+      break;
+   }
+}
+
+void CxCompCtx::conv_binary(const Binary *binary) {
+   if (binary->op == POW
+       && binary->rhs->type == NUMBER
+       && binary->rhs->val.number == std::floor(binary->rhs->val.number)
+       && std::fabs(binary->rhs->val.number) <= MAX_INT_POW) {
+      conv_expr_rec(binary->lhs);
+      conv_int_pow((int) binary->rhs->val.number);
+      return;
+   }
+
+   x86::Xmm b = cc.newXmm();
+
+   conv_expr_rec(binary->rhs);
+   cc.movapd(b, y);
+   conv_expr_rec(binary->lhs);
+   switch (binary->op) {
+   case ADD:
+      cc.addpd(y, b);
+      break;
+   case SUB:
+      cc.subpd(y, b);
+      break;
+   case MUL:
+      emit_mul(y, y, b);
+      break;
+   case DIV:
+      emit_div(y, y, b);
+      break;
+   case POW:
+      invoke_complex(&cx_pow, &b);
+      break;
+   }
+}
+
+void CxCompCtx::conv_int_pow(int n) {
+   // Exponentiation by squaring, unrolled at compile time.
+   x86::Xmm base = cc.newXmm(),
+            res = cc.newXmm();
+
+   cc.movapd(base, y);
+
+   bool started = false;
+   for (int k = n < 0? -n: n; k > 0; k >>= 1) {
+      if (k & 1) {
+         if (started) {
+            emit_mul(res, res, base);
+         } else {
+            cc.movapd(res, base);
+            started = true;
+         }
+      }
+
+      if (k > 1) {
+         emit_mul(base, base, base);
+      }
+   }
+
+   if (!started) {
+      cc.movapd(res, pair_const(1.0, 0.0));
+   }
+
+   if (n < 0) {
+      emit_div(y, pair_const(1.0, 0.0), res);
+   } else {
+      cc.movapd(y, res);
+   }
+}
+
+void CxCompCtx::conv_apply(const Apply *apply) {
+   // User-defined functions have been inlined, so only built-ins of x are left.
+   if (fn_arity(apply->funcname, ectx) != apply->n_args) {
+      throw new ArityFail(apply->funcname);
+   }
+
+   auto fn = CX_FNS.find(apply->funcname);
+   if (fn == CX_FNS.end()) {
+      throw new NameResFail(apply->funcname);
+   }
+
+   conv_expr_rec(apply->args[0]);
+   invoke_complex(fn->second);
+}
+
+void CxCompCtx::load_real(double value) {
+   // Loading a single double clears the high lane.
+   cc.movsd(y, cc.newDoubleConst(ConstPoolScope::kLocal, value));
+}
+
+x86::Xmm CxCompCtx::pair_const(double lo, double hi) {
+   double pair[2] = { lo, hi };
+   x86::Xmm reg = cc.newXmm();
+   cc.movupd(reg, cc.newConst(ConstPoolScope::kLocal, pair, sizeof(pair)));
+
+   return reg;
+}
+
+void CxCompCtx::invoke_complex(void (*fn)(double *), const x86::Xmm *b) {
+   x86::Mem slot = cc.newStack(32, 16);
+   x86::Gp slotPtr = cc.newIntPtr();
+   cc.lea(slotPtr, slot);
+   cc.movupd(slot, y);
+   if (b != nullptr) {
+      cc.movupd(slot.cloneAdjusted(16), *b);
+   }
+
+   InvokeNode *toFn;
+   cc.invoke(&toFn, fn, FuncSignatureT<void, double *>());
+   toFn->setArg(0, slotPtr);
+
+   cc.movupd(y, slot);
+}
+
+void CxCompCtx::emit_mul(x86::Xmm r, x86::Xmm a, x86::Xmm b) {
+   // (ar + ai i)(br + bi i) = (ar br - ai bi) + (ar bi + ai br) i
+   x86::Xmm re = cc.newXmm(),
+            im = cc.newXmm(),
+            swapped = cc.newXmm();
+
+   cc.movapd(re, a);
+   cc.unpcklpd(re, re);
+   cc.movapd(im, a);
+   cc.unpckhpd(im, im);
+   cc.movapd(swapped, b);
+   cc.shufpd(swapped, swapped, 1);
+
+   cc.mulpd(re, b);
+   cc.mulpd(im, swapped);
+   cc.xorpd(im, pair_const(-0.0, 0.0));
+   cc.addpd(re, im);
+   cc.movapd(r, re);
+}
+
+void CxCompCtx::emit_div(x86::Xmm r, x86::Xmm a, x86::Xmm b) {
+   // a / b = a conj(b) / |b|^2
+   x86::Xmm conj = cc.newXmm(),
+            norm = cc.newXmm(),
+            swapped = cc.newXmm();
+
+   cc.movapd(conj, b);
+   cc.xorpd(conj, pair_const(0.0, -0.0));
+
+   cc.movapd(norm, b);
+   cc.mulpd(norm, norm);
+   cc.movapd(swapped, norm);
+   cc.shufpd(swapped, swapped, 1);
+   cc.addpd(norm, swapped);
+
+   emit_mul(r, a, conj);
+   cc.divpd(r, norm);
+}
+
+CxBatchFunc CxCompCtx::end() {
+   cc.ret();
+   cc.endFunc();
+   cc.finalize();
+
+   CxBatchFunc fn;
+   Error err = rt.add(&fn, &code);
+   if (err) {
+      printf("AsmJit failed: %s\n", DebugUtils::errorAsString(err));
+      exit(1);
+   }
+
+   return fn;
+}
+
+CxBatchFunc conv_expr_cx(const Expr *expr,
+                         JitRuntime &rt,
+                         const ExecCtx &ectx) {
+   Expr *inlined = inline_expr(expr, ectx);
+
+   CodeHolder code;
+   code.init(rt.environment(), rt.cpuFeatures());
+
+   CxCompCtx ctx(rt, code, ectx);
+   try {
+      ctx.conv_batch(inlined);
+   } catch (ReportingException *e) {
+      destroy_expr(inlined);
+      throw;
+   }
+
+   destroy_expr(inlined);
+   return ctx.end();
+}
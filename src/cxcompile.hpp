@@ -0,0 +1,119 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef CXCOMPILE_HPP
+#define CXCOMPILE_HPP
+
+#include "compile.hpp"
+
+/* A compiled complex batch function.
+ * z and out each hold n complex numbers, as consecutive (real, imaginary) pairs.
+ */
+typedef void (*CxBatchFunc)(const double *z, double *out, int64_t n);
+
+/* A class to store information for the complex compiler.
+ * Every value is kept in a single register, with the real part in the low lane
+ *  and the imaginary part in the high lane, so that sums and products work on both at once.
+ * x stands for the complex argument. The built-ins and non-integer powers call their
+ *  principal complex versions.
+ */
+class CxCompCtx {
+public:
+   const ExecCtx &ectx;
+   x86::Compiler cc;
+   x86::Xmm y, z;
+   x86::Gp in, out, n;
+
+   JitRuntime &rt;
+   CodeHolder &code;
+
+   CxCompCtx(JitRuntime &rt,
+             CodeHolder &code,
+             const ExecCtx &ectx);
+
+   /**
+    * Compiles the loop over the arrays around an expression.
+    *
+    * @param expr The expression to evaluate for every element, with user functions inlined
+    */
+   void conv_batch(const Expr *expr);
+
+   /**
+    * Starts the recursive compilation of the expression.
+    * The result is left in y.
+    *
+    * @param expr The expression to compile
+    */
+   void conv_expr_rec(const Expr *expr);
+
+   /**
+    * Finalizes the compiler
+    *
+    * @return The compiled function
+    */
+   CxBatchFunc end();
+
+private:
+   void conv_unary(const Unary *unary);
+
+   void conv_binary(const Binary *binary);
+
+   void conv_int_pow(int n);
+
+   void conv_apply(const Apply *apply);
+
+   /**
+    * Loads a real number into y, with a zero imaginary part.
+    */
+   void load_real(double value);
+
+   /**
+    * Gets a register holding a constant pair of lanes.
+    */
+   x86::Xmm pair_const(double lo, double hi);
+
+   /**
+    * Calls a function which replaces the complex numbers at a pointer with its result.
+    * The arguments are y, followed by *b if it's given, and the result is left in y.
+    */
+   void invoke_complex(void (*fn)(double *), const x86::Xmm *b = nullptr);
+
+   /* The emitters below compute into fresh registers before writing their outputs,
+    * so outputs may alias inputs.
+    */
+
+   void emit_mul(x86::Xmm r, x86::Xmm a, x86::Xmm b);
+
+   void emit_div(x86::Xmm r, x86::Xmm a, x86::Xmm b);
+};
+
+/**
+ * Converts the provided expression into a complex batch function.
+ * User-defined functions are inlined so that they get complex semantics too.
+ *
+ * @param expr The expression to compile
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled function
+ */
+CxBatchFunc conv_expr_cx(const Expr *expr,
+                         JitRuntime &rt,
+                         const ExecCtx &ectx);
+
+#endif
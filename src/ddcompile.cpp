@@ -0,0 +1,486 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "ddcompile.hpp"
+#include "quadrature.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace asmjit;
+
+/* Dekker's splitting constant, 2^27 + 1 */
+#define SPLITTER 134217729.0
+
+/* Largest integer exponent which is expanded into multiplications */
+#define MAX_INT_POW 64
+
+/**
+ * Double-double square root, called from compiled code.
+ */
+static void dd_sqrt_to(double hi, double lo, double *out) {
+   DDouble root = dd_sqrt({ hi, lo });
+   out[0] = root.hi;
+   out[1] = root.lo;
+}
+
+DDCompCtx::DDCompCtx(JitRuntime &_rt,
+                     CodeHolder &_code,
+                     const ExecCtx &_ectx)
+   : ectx(_ectx),
+     cc(&_code),
+     rt(_rt),
+     code(_code)
+{
+   hasFMA = rt.cpuFeatures().x86().hasFMA();
+
+   xh = cc.newXmm();
+   xl = cc.newXmm();
+   yh = cc.newXmm();
+   yl = cc.newXmm();
+   out = cc.newIntPtr();
+
+   FuncNode *f = cc.addFunc(FuncSignatureT<void, double, double, double *>());
+   f->setArg(0, xh);
+   f->setArg(1, xl);
+   f->setArg(2, out);
+}
+
+void DDCompCtx::conv_expr_rec(const Expr *expr) {
+   switch (expr->type) {
+   case UNARY:
+      conv_unary(expr->val.unary);
+      break;
+   case BINARY:
+      conv_binary(expr->val.binary);
+      break;
+   case APPLY:
+      conv_apply(expr->val.apply);
+      break;
+   case INTEGRAL:
+      conv_integral(expr->val.integral);
+      break;
+   case DERIVATIVE:
+      {
+         Expr *expanded = expand_deriv(expr->val.derivative->funcname,
+                                       expr->val.derivative->order,
+                                       ectx);
+         try {
+            conv_expr_rec(expanded);
+         } catch (ReportingException *e) {
+            destroy_expr(expanded);
+            throw;
+         }
+
+         destroy_expr(expanded);
+      }
+
+      break;
+   case VARIABLE:
+      {
+         if (ectx.varTable.find(expr->val.varname) == ectx.varTable.end()) {
+            throw new NameResFail(expr->val.varname);
+         }
+
+         x86::Mem val = cc.newDoubleConst(ConstPoolScope::kLocal,
+                                          ectx.varTable.at(expr->val.varname));
+         cc.movsd(yh, val);
+         cc.xorps(yl, yl);
+      }
+
+      break;
+   case NUMBER:
+      {
+         x86::Mem numConst = cc.newDoubleConst(ConstPoolScope::kLocal, expr->val.number);
+         cc.movsd(yh, numConst);
+         cc.xorps(yl, yl);
+      }
+
+      break;
+   case ARGUMENT:
+      if (expr->val.argindex != 0) {
+         char msg[48];
+         snprintf(msg, sizeof(msg), "parameter %d is not defined here", expr->val.argindex + 1);
+         throw new ParseError(strdup(msg));
+      }
+
+      cc.movsd(yh, xh);
+      cc.movsd(yl, xl);
+      break;
+   }
+}
+
+void DDCompCtx::conv_unary(const Unary *unary) {
+   conv_expr_rec(unary->inner);
+   switch (unary->op) {
+   case NEG:
+      emit_neg(yh, yl);
+      break;
+   case ABS:
+      {
+         // Both halves are flipped by the sign of the hi half.
+         x86::Xmm sign = cc.newXmm(),
+                  mask = cc.newXmm();
+
+         cc.movsd(mask, cc.newDoubleConst(ConstPoolScope::kLocal, -0.0));
+         cc.movsd(sign, yh);
+         cc.andpd(sign, mask);
+         cc.xorpd(yh, sign);
+         cc.xorpd(yl, sign);
+      }
+
+      break;
+   }
+}
+
+void DDCompCtx::conv_binary(const Binary *binary) {
+   if (binary->op == POW
+       && binary->rhs->type == NUMBER
+       && binary->rhs->val.number == std::floor(binary->rhs->val.number)
+       && std::fabs(binary->rhs->val.number) <= MAX_INT_POW) {
+      conv_expr_rec(binary->lhs);
+      conv_int_pow((int) binary->rhs->val.number);
+      return;
+   }
+
+   x86::Xmm bh = cc.newXmm(),
+            bl = cc.newXmm();
+
+   conv_expr_rec(binary->rhs);
+   cc.movsd(bh, yh);
+   cc.movsd(bl, yl);
+   conv_expr_rec(binary->lhs);
+   switch (binary->op) {
+   case ADD:
+      emit_add(yh, yl, yh, yl, bh, bl);
+      break;
+   case SUB:
+      emit_neg(bh, bl);
+      emit_add(yh, yl, yh, yl, bh, bl);
+      break;
+   case MUL:
+      emit_mul(yh, yl, yh, yl, bh, bl);
+      break;
+   case DIV:
+      emit_div(yh, yl, yh, yl, bh, bl);
+      break;
+   case POW:
+      {
+         // Non-integer powers only get double precision.
+         cc.addsd(yh, yl);
+         cc.addsd(bh, bl);
+
+         InvokeNode *toPow;
+         cc.invoke(&toPow,
+                   (double (*)(double, double))&pow,
+                   FuncSignatureT<double, double, double>());
+         toPow->setArg(0, yh);
+         toPow->setArg(1, bh);
+         toPow->setRet(0, yh);
+         cc.xorps(yl, yl);
+      }
+
+      break;
+   }
+}
+
+void DDCompCtx::conv_int_pow(int n) {
+   // Exponentiation by squaring, unrolled at compile time.
+   x86::Xmm baseh = cc.newXmm(),
+            basel = cc.newXmm(),
+            resh = cc.newXmm(),
+            resl = cc.newXmm();
+
+   cc.movsd(baseh, yh);
+   cc.movsd(basel, yl);
+
+   bool started = false;
+   for (int k = n < 0? -n: n; k > 0; k >>= 1) {
+      if (k & 1) {
+         if (started) {
+            emit_mul(resh, resl, resh, resl, baseh, basel);
+         } else {
+            cc.movsd(resh, baseh);
+            cc.movsd(resl, basel);
+            started = true;
+         }
+      }
+
+      if (k > 1) {
+         emit_mul(baseh, basel, baseh, basel, baseh, basel);
+      }
+   }
+
+   if (!started) {
+      cc.movsd(resh, cc.newDoubleConst(ConstPoolScope::kLocal, 1.0));
+      cc.xorps(resl, resl);
+   }
+
+   if (n < 0) {
+      x86::Xmm oneh = cc.newXmm(),
+               onel = cc.newXmm();
+
+      cc.movsd(oneh, cc.newDoubleConst(ConstPoolScope::kLocal, 1.0));
+      cc.xorps(onel, onel);
+      emit_div(yh, yl, oneh, onel, resh, resl);
+   } else {
+      cc.movsd(yh, resh);
+      cc.movsd(yl, resl);
+   }
+}
+
+void DDCompCtx::conv_apply(const Apply *apply) {
+   // User-defined functions have been inlined, so only built-ins of x are left.
+   if (fn_arity(apply->funcname, ectx) != apply->n_args) {
+      throw new ArityFail(apply->funcname);
+   }
+
+   conv_expr_rec(apply->args[0]);
+   if (strcmp(apply->funcname, "Sqrt") == 0) {
+      x86::Mem slot = cc.newStack(16, 16);
+      x86::Gp slotPtr = cc.newIntPtr();
+      cc.lea(slotPtr, slot);
+
+      InvokeNode *toSqrt;
+      cc.invoke(&toSqrt,
+                &dd_sqrt_to,
+                FuncSignatureT<void, double, double, double *>());
+      toSqrt->setArg(0, yh);
+      toSqrt->setArg(1, yl);
+      toSqrt->setArg(2, slotPtr);
+
+      cc.movsd(yh, slot);
+      cc.movsd(yl, slot.cloneAdjusted(8));
+      return;
+   }
+
+   invoke_rounded(ectx.fnTable.at(apply->funcname));
+}
+
+void DDCompCtx::conv_integral(const Integral *integral) {
+   if (ectx.fnTable.find(integral->funcname) == ectx.fnTable.end()) {
+      throw new NameResFail(integral->funcname);
+   }
+
+   x86::Xmm upper = cc.newXmm();
+   conv_expr_rec(integral->upper);
+   cc.movsd(upper, yh);
+   cc.addsd(upper, yl);
+   conv_expr_rec(integral->lower);
+   cc.addsd(yh, yl);
+
+   x86::Gp fnPtr = cc.newIntPtr();
+   cc.mov(fnPtr, imm((intptr_t)ectx.fnTable.at(integral->funcname)));
+
+   InvokeNode *toInt;
+   cc.invoke(&toInt,
+             &integrate,
+             FuncSignatureT<double, const void *, double, double>());
+   toInt->setArg(0, fnPtr);
+   toInt->setArg(1, yh);
+   toInt->setArg(2, upper);
+   toInt->setRet(0, yh);
+   cc.xorps(yl, yl);
+}
+
+void DDCompCtx::invoke_rounded(Func fn) {
+   cc.addsd(yh, yl);
+
+   InvokeNode *toFn;
+   cc.invoke(&toFn, fn, FuncSignatureT<double, double>());
+   toFn->setArg(0, yh);
+   toFn->setRet(0, yh);
+   cc.xorps(yl, yl);
+}
+
+void DDCompCtx::emit_two_sum(x86::Xmm s, x86::Xmm e, x86::Xmm a, x86::Xmm b) {
+   x86::Xmm bb = cc.newXmm(),
+            t = cc.newXmm();
+
+   cc.movsd(s, a);
+   cc.addsd(s, b);
+   cc.movsd(bb, s);
+   cc.subsd(bb, a);
+   cc.movsd(t, s);
+   cc.subsd(t, bb);
+   cc.movsd(e, a);
+   cc.subsd(e, t);
+   cc.movsd(t, b);
+   cc.subsd(t, bb);
+   cc.addsd(e, t);
+}
+
+void DDCompCtx::emit_fast_two_sum(x86::Xmm s, x86::Xmm e, x86::Xmm a, x86::Xmm b) {
+   x86::Xmm t = cc.newXmm();
+
+   cc.movsd(s, a);
+   cc.addsd(s, b);
+   cc.movsd(t, s);
+   cc.subsd(t, a);
+   cc.movsd(e, b);
+   cc.subsd(e, t);
+}
+
+void DDCompCtx::emit_two_prod(x86::Xmm p, x86::Xmm e, x86::Xmm a, x86::Xmm b) {
+   cc.movsd(p, a);
+   cc.mulsd(p, b);
+
+   if (hasFMA) {
+      // e = a * b - p, with a single rounding
+      cc.movsd(e, p);
+      cc.vfmsub231sd(e, a, b);
+      return;
+   }
+
+   // Dekker's algorithm: split a and b into 26-bit halves whose products are exact.
+   x86::Xmm ah = cc.newXmm(), al = cc.newXmm(),
+            bh = cc.newXmm(), bl = cc.newXmm(),
+            t = cc.newXmm();
+
+   x86::Mem splitter = cc.newDoubleConst(ConstPoolScope::kLocal, SPLITTER);
+   x86::Xmm halves[2][3] = {{ a, ah, al }, { b, bh, bl }};
+   for (auto &half: halves) {
+      cc.movsd(t, splitter);
+      cc.mulsd(t, half[0]);
+      cc.movsd(half[1], t);
+      cc.subsd(t, half[0]);
+      cc.subsd(half[1], t);
+      cc.movsd(half[2], half[0]);
+      cc.subsd(half[2], half[1]);
+   }
+
+   // e = ((ah * bh - p) + ah * bl + al * bh) + al * bl
+   cc.movsd(e, ah);
+   cc.mulsd(e, bh);
+   cc.subsd(e, p);
+   cc.movsd(t, ah);
+   cc.mulsd(t, bl);
+   cc.addsd(e, t);
+   cc.movsd(t, al);
+   cc.mulsd(t, bh);
+   cc.addsd(e, t);
+   cc.movsd(t, al);
+   cc.mulsd(t, bl);
+   cc.addsd(e, t);
+}
+
+void DDCompCtx::emit_neg(x86::Xmm h, x86::Xmm l) {
+   x86::Xmm mask = cc.newXmm();
+
+   cc.movsd(mask, cc.newDoubleConst(ConstPoolScope::kLocal, -0.0));
+   cc.xorpd(h, mask);
+   cc.xorpd(l, mask);
+}
+
+void DDCompCtx::emit_add(x86::Xmm rh, x86::Xmm rl,
+                         x86::Xmm ah, x86::Xmm al,
+                         x86::Xmm bh, x86::Xmm bl) {
+   x86::Xmm s = cc.newXmm(), e = cc.newXmm(),
+            t = cc.newXmm(), f = cc.newXmm(),
+            s2 = cc.newXmm(), e2 = cc.newXmm();
+
+   emit_two_sum(s, e, ah, bh);
+   emit_two_sum(t, f, al, bl);
+   cc.addsd(e, t);
+   emit_fast_two_sum(s2, e2, s, e);
+   cc.addsd(e2, f);
+   emit_fast_two_sum(rh, rl, s2, e2);
+}
+
+void DDCompCtx::emit_mul(x86::Xmm rh, x86::Xmm rl,
+                         x86::Xmm ah, x86::Xmm al,
+                         x86::Xmm bh, x86::Xmm bl) {
+   x86::Xmm p = cc.newXmm(), e = cc.newXmm(),
+            t = cc.newXmm(), u = cc.newXmm();
+
+   emit_two_prod(p, e, ah, bh);
+   cc.movsd(t, ah);
+   cc.mulsd(t, bl);
+   cc.movsd(u, al);
+   cc.mulsd(u, bh);
+   cc.addsd(t, u);
+   cc.addsd(e, t);
+   emit_fast_two_sum(rh, rl, p, e);
+}
+
+void DDCompCtx::emit_div(x86::Xmm rh, x86::Xmm rl,
+                         x86::Xmm ah, x86::Xmm al,
+                         x86::Xmm bh, x86::Xmm bl) {
+   // Long division: three double quotients, each taken from the remainder of the last.
+   x86::Xmm q1 = cc.newXmm(), q2 = cc.newXmm(), q3 = cc.newXmm(),
+            remh = cc.newXmm(), reml = cc.newXmm(),
+            ph = cc.newXmm(), pl = cc.newXmm(),
+            zero = cc.newXmm();
+
+   cc.xorps(zero, zero);
+
+   cc.movsd(q1, ah);
+   cc.divsd(q1, bh);
+   emit_mul(ph, pl, bh, bl, q1, zero);
+   emit_neg(ph, pl);
+   emit_add(remh, reml, ah, al, ph, pl);
+
+   cc.movsd(q2, remh);
+   cc.divsd(q2, bh);
+   emit_mul(ph, pl, bh, bl, q2, zero);
+   emit_neg(ph, pl);
+   emit_add(remh, reml, remh, reml, ph, pl);
+
+   cc.movsd(q3, remh);
+   cc.divsd(q3, bh);
+   emit_fast_two_sum(ph, pl, q1, q2);
+   emit_add(rh, rl, ph, pl, q3, zero);
+}
+
+DDFunc DDCompCtx::end() {
+   cc.movsd(x86::ptr(out), yh);
+   cc.movsd(x86::ptr(out, 8), yl);
+   cc.ret();
+   cc.endFunc();
+   cc.finalize();
+
+   DDFunc fn;
+   Error err = rt.add(&fn, &code);
+   if (err) {
+      printf("AsmJit failed: %s\n", DebugUtils::errorAsString(err));
+      exit(1);
+   }
+
+   return fn;
+}
+
+DDFunc conv_expr_dd(const Expr *expr,
+                    JitRuntime &rt,
+                    const ExecCtx &ectx) {
+   Expr *inlined = inline_expr(expr, ectx);
+
+   CodeHolder code;
+   code.init(rt.environment(), rt.cpuFeatures());
+
+   DDCompCtx ctx(rt, code, ectx);
+   try {
+      ctx.conv_expr_rec(inlined);
+   } catch (ReportingException *e) {
+      destroy_expr(inlined);
+      throw;
+   }
+
+   destroy_expr(inlined);
+   return ctx.end();
+}
@@ -0,0 +1,132 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef DDCOMPILE_HPP
+#define DDCOMPILE_HPP
+
+#include "compile.hpp"
+#include "ddouble.hpp"
+
+/* A compiled double-double function. Writes the hi and lo parts of the result to out. */
+typedef void (*DDFunc)(double xhi, double xlo, double *out);
+
+/* A class to store information for the double-double compiler.
+ * Every value is kept as a pair of registers, (hi, lo).
+ * Arithmetic is exact to about 106 bits, as is Sqrt.
+ * The other built-ins are evaluated in plain double precision.
+ */
+class DDCompCtx {
+public:
+   const ExecCtx &ectx;
+   x86::Compiler cc;
+   x86::Xmm yh, yl, xh, xl;
+   x86::Gp out;
+
+   JitRuntime &rt;
+   CodeHolder &code;
+
+   /* Can the FMA instructions be used for TwoProd? */
+   bool hasFMA;
+
+   DDCompCtx(JitRuntime &rt,
+             CodeHolder &code,
+             const ExecCtx &ectx);
+
+   /**
+    * Starts the recursive compilation of the expression.
+    * The result is left in (yh, yl).
+    *
+    * @param expr The expression to compile, with user functions inlined
+    */
+   void conv_expr_rec(const Expr *expr);
+
+   /**
+    * Finalizes the compiler
+    *
+    * @return The compiled function
+    */
+   DDFunc end();
+
+private:
+   void conv_unary(const Unary *unary);
+
+   void conv_binary(const Binary *binary);
+
+   void conv_int_pow(int n);
+
+   void conv_apply(const Apply *apply);
+
+   void conv_integral(const Integral *integral);
+
+   /**
+    * Rounds (yh, yl) to a double in yh and calls a plain double function on it.
+    */
+   void invoke_rounded(Func fn);
+
+   /* The emitters below compute into fresh registers before writing their outputs,
+    * so outputs may alias inputs unless noted otherwise.
+    */
+
+   /* s + e = a + b exactly. s and e must not alias a or b. */
+   void emit_two_sum(x86::Xmm s, x86::Xmm e, x86::Xmm a, x86::Xmm b);
+
+   /* s + e = a + b exactly, given |a| >= |b|. s and e must not alias a or b. */
+   void emit_fast_two_sum(x86::Xmm s, x86::Xmm e, x86::Xmm a, x86::Xmm b);
+
+   /* p + e = a * b exactly. p and e must not alias a or b. */
+   void emit_two_prod(x86::Xmm p, x86::Xmm e, x86::Xmm a, x86::Xmm b);
+
+   void emit_neg(x86::Xmm h, x86::Xmm l);
+
+   void emit_add(x86::Xmm rh, x86::Xmm rl,
+                 x86::Xmm ah, x86::Xmm al,
+                 x86::Xmm bh, x86::Xmm bl);
+
+   void emit_mul(x86::Xmm rh, x86::Xmm rl,
+                 x86::Xmm ah, x86::Xmm al,
+                 x86::Xmm bh, x86::Xmm bl);
+
+   void emit_div(x86::Xmm rh, x86::Xmm rl,
+                 x86::Xmm ah, x86::Xmm al,
+                 x86::Xmm bh, x86::Xmm bl);
+};
+
+/**
+ * Converts the provided expression into a double-double function.
+ * User-defined functions are inlined so that they get the extra precision too.
+ *
+ * @param expr The expression to compile
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled function
+ */
+DDFunc conv_expr_dd(const Expr *expr,
+                    JitRuntime &rt,
+                    const ExecCtx &ectx);
+
+/**
+ * Evaluates a compiled double-double function.
+ */
+inline DDouble dd_call(DDFunc fn, DDouble x) {
+   double out[2];
+   fn(x.hi, x.lo, out);
+   return { out[0], out[1] };
+}
+
+#endif
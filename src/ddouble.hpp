@@ -0,0 +1,126 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef DDOUBLE_HPP
+#define DDOUBLE_HPP
+
+#include <cmath>
+
+/* A double-double number, worth about 106 bits of precision.
+ * The value is hi + lo, where |lo| is at most half an ulp of hi.
+ */
+struct DDouble {
+   double hi, lo;
+
+   /**
+    * Create a double-double from a plain double.
+    */
+   static inline DDouble of(double x) {
+      return { x, 0 };
+   }
+
+   /**
+    * Rounds the number to the nearest double.
+    */
+   inline double value() const {
+      return hi + lo;
+   }
+};
+
+/**
+ * Adds two doubles, keeping the rounding error.
+ */
+inline DDouble two_sum(double a, double b) {
+   double s = a + b;
+   double bb = s - a;
+   return { s, (a - (s - bb)) + (b - bb) };
+}
+
+/**
+ * Adds two doubles, keeping the rounding error.
+ * Only valid if |a| >= |b|.
+ */
+inline DDouble fast_two_sum(double a, double b) {
+   double s = a + b;
+   return { s, b - (s - a) };
+}
+
+/**
+ * Multiplies two doubles, keeping the rounding error.
+ */
+inline DDouble two_prod(double a, double b) {
+   double p = a * b;
+   return { p, std::fma(a, b, -p) };
+}
+
+inline DDouble operator-(DDouble a) {
+   return { -a.hi, -a.lo };
+}
+
+inline DDouble operator+(DDouble a, double b) {
+   DDouble s = two_sum(a.hi, b);
+   return fast_two_sum(s.hi, s.lo + a.lo);
+}
+
+inline DDouble operator+(DDouble a, DDouble b) {
+   DDouble s = two_sum(a.hi, b.hi),
+           t = two_sum(a.lo, b.lo);
+
+   s = fast_two_sum(s.hi, s.lo + t.hi);
+   return fast_two_sum(s.hi, s.lo + t.lo);
+}
+
+inline DDouble operator-(DDouble a, DDouble b) {
+   return a + -b;
+}
+
+inline DDouble operator*(DDouble a, double b) {
+   DDouble p = two_prod(a.hi, b);
+   return fast_two_sum(p.hi, p.lo + a.lo * b);
+}
+
+inline DDouble operator*(DDouble a, DDouble b) {
+   DDouble p = two_prod(a.hi, b.hi);
+   return fast_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+inline DDouble operator/(DDouble a, DDouble b) {
+   double q1 = a.hi / b.hi;
+   DDouble r = a - b * q1;
+
+   double q2 = r.hi / b.hi;
+   r = r - b * q2;
+
+   double q3 = r.hi / b.hi;
+   return fast_two_sum(q1, q2) + q3;
+}
+
+/**
+ * Square root of a double-double, by one Newton step from the double result.
+ */
+inline DDouble dd_sqrt(DDouble a) {
+   if (a.hi <= 0) {
+      return DDouble::of(std::sqrt(a.hi));
+   }
+
+   double s = std::sqrt(a.hi);
+   DDouble r = a - two_prod(s, s);
+   return fast_two_sum(s, r.hi / (2.0 * s));
+}
+
+#endif
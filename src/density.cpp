@@ -0,0 +1,75 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "density.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/* Opacity of the densest pixel */
+#define DENSITY_MAX_ALPHA 0xc0
+
+DensityMap::DensityMap()
+   : width(0),
+     height(0),
+     max_total(0)
+{}
+
+void DensityMap::resize(int _width, int _height) {
+   width = _width;
+   height = _height;
+   cells.assign((size_t) width * height, { 0, 0, 0 });
+   max_total = 0;
+}
+
+void DensityMap::clear() {
+   std::fill(cells.begin(), cells.end(), PixelCounts { 0, 0, 0 });
+   max_total = 0;
+}
+
+void DensityMap::tone_map(uint8_t *pixels, int rowstride) const {
+   // Opacity for every count up to the table's size, on a log scale
+   // relative to the densest pixel
+   uint8_t alpha[DENSITY_LUT_SIZE];
+   uint32_t top = std::min(max_total, (uint32_t) DENSITY_LUT_SIZE - 1);
+   double scale = top > 0 ? DENSITY_MAX_ALPHA / std::log1p((double) top) : 0;
+   for (uint32_t n = 0; n < DENSITY_LUT_SIZE; n++) {
+      alpha[n] = (uint8_t) (std::log1p((double) std::min(n, top)) * scale);
+   }
+
+   for (int j = 0; j < height; j++) {
+      const PixelCounts *row = &cells[(size_t) j * width];
+      uint8_t *out = pixels + (size_t) j * rowstride;
+
+      for (int i = 0; i < width; i++, out += 4) {
+         const PixelCounts &c = row[i];
+         uint32_t total = c.pos + c.neg + c.miss;
+         if (total == 0) {
+            out[0] = out[1] = out[2] = out[3] = 0;
+            continue;
+         }
+
+         // Each kind contributes its color in proportion to its share of the pixel
+         uint32_t white = c.miss * 255;
+         out[0] = (uint8_t) ((c.pos * 255 + white) / total);
+         out[1] = (uint8_t) (white / total);
+         out[2] = (uint8_t) ((c.neg * 255 + white) / total);
+         out[3] = alpha[std::min(total, (uint32_t) DENSITY_LUT_SIZE - 1)];
+      }
+   }
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef DENSITY_HPP
+#define DENSITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Number of entries in the tone mapping table. Higher counts all get the last entry. */
+#define DENSITY_LUT_SIZE 4096
+
+/* Where a sample fell relative to the curve */
+enum SampleKind {
+   /* Between the x axis and the curve, above the axis */
+   POS_HIT,
+
+   /* Between the x axis and the curve, below the axis */
+   NEG_HIT,
+
+   MISS
+};
+
+/* Counts of each kind of sample in a pixel */
+struct PixelCounts {
+   uint32_t pos, neg, miss;
+};
+
+/* Accumulates how many samples fell in each pixel, so that the overlay shows
+ * their density rather than just the last sample in every pixel.
+ * Pixels are stored row-major, like the image they are drawn into.
+ */
+class DensityMap {
+   int width, height;
+   std::vector<PixelCounts> cells;
+
+   /* The most samples in any one pixel */
+   uint32_t max_total;
+
+public:
+   DensityMap();
+
+   /**
+    * Changes the size of the map, clearing it.
+    */
+   void resize(int width, int height);
+
+   /**
+    * Sets every count to zero.
+    */
+   void clear();
+
+   /**
+    * Counts a sample, if it's inside the map.
+    *
+    * @param i The pixel's column
+    * @param j The pixel's row, from the top
+    */
+   void add(int i, int j, SampleKind kind) {
+      if (i < 0 || i >= width || j < 0 || j >= height) {
+         return;
+      }
+
+      PixelCounts &c = cells[(size_t) j * width + i];
+      switch (kind) {
+      case POS_HIT: c.pos++;  break;
+      case NEG_HIT: c.neg++;  break;
+      case MISS:    c.miss++; break;
+      }
+
+      uint32_t total = c.pos + c.neg + c.miss;
+      if (total > max_total) {
+         max_total = total;
+      }
+   }
+
+   /**
+    * Draws the map into an RGBA image of the same size.
+    * Hits above the axis are red, those below are blue and misses are white,
+    * with opacity growing with the log of the number of samples.
+    *
+    * @param pixels The image's pixels, row-major with 4 bytes per pixel
+    * @param rowstride The number of bytes between the starts of consecutive rows
+    */
+   void tone_map(uint8_t *pixels, int rowstride) const;
+};
+
+#endif
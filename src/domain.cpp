@@ -0,0 +1,120 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "domain.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DomainColoring::DomainColoring()
+   : width(0),
+     height(0),
+     n_undefined(0)
+{}
+
+void DomainColoring::compute(CxBatchFunc fn,
+                             double xmin, double xmax, double ymin, double ymax,
+                             int _width, int _height,
+                             ThreadPool &pool) {
+   width = _width;
+   height = _height;
+   values.assign(2 * (size_t) width * height, NAN);
+
+   double dx = (xmax - xmin) / width,
+          dy = (ymax - ymin) / height;
+
+   int tiles_x = (width + DOMAIN_TILE - 1) / DOMAIN_TILE,
+       tiles_y = (height + DOMAIN_TILE - 1) / DOMAIN_TILE;
+
+   pool.run((int64_t) tiles_x * tiles_y, [&](int64_t k) {
+      int i0 = (int)(k % tiles_x) * DOMAIN_TILE,
+          j0 = (int)(k / tiles_x) * DOMAIN_TILE,
+          nx = std::min(DOMAIN_TILE, width - i0),
+          ny = std::min(DOMAIN_TILE, height - j0);
+
+      // Every pixel's center in the tile, in one batch
+      std::vector<double> zs(2 * nx * ny), ws(2 * nx * ny);
+      for (int j = 0; j < ny; j++) {
+         for (int i = 0; i < nx; i++) {
+            zs[2 * (j * nx + i)] = xmin + (i0 + i + 0.5) * dx;
+            zs[2 * (j * nx + i) + 1] = ymax - (j0 + j + 0.5) * dy;
+         }
+      }
+
+      fn(zs.data(), ws.data(), nx * ny);
+
+      for (int j = 0; j < ny; j++) {
+         std::copy(ws.begin() + 2 * j * nx,
+                   ws.begin() + 2 * (j + 1) * nx,
+                   values.begin() + 2 * ((size_t)(j0 + j) * width + i0));
+      }
+   });
+
+   n_undefined = 0;
+   for (size_t p = 0; p < values.size(); p += 2) {
+      n_undefined += !std::isfinite(values[p]) || !std::isfinite(values[p + 1]);
+   }
+}
+
+void DomainColoring::tone_map(uint8_t *pixels, int rowstride, ThreadPool &pool) const {
+   pool.run(height, [&](int64_t j) {
+      uint8_t *row = pixels + j * rowstride;
+      for (int i = 0; i < width; i++) {
+         double re = values[2 * (j * width + i)],
+                im = values[2 * (j * width + i) + 1];
+         double modulus = std::hypot(re, im);
+
+         uint8_t *px = row + 4 * i;
+         px[3] = 255;
+         if (!std::isfinite(modulus) || modulus == 0) {
+            px[0] = px[1] = px[2] = 0;
+            continue;
+         }
+
+         // Hue from the argument, with red on the positive real axis
+         double hue = std::atan2(im, re) / (2 * M_PI);
+         hue = 6 * (hue - std::floor(hue));
+
+         double band = std::log2(modulus),
+                value = DOMAIN_BAND_FLOOR + (1 - DOMAIN_BAND_FLOOR) * (band - std::floor(band));
+
+         // Fully saturated HSV to RGB
+         int sector = std::min((int) hue, 5);
+         double rise = hue - sector,
+                up = value * rise,
+                down = value * (1 - rise);
+         double rgb[3];
+         switch (sector) {
+         case 0: rgb[0] = value; rgb[1] = up;    rgb[2] = 0;     break;
+         case 1: rgb[0] = down;  rgb[1] = value; rgb[2] = 0;     break;
+         case 2: rgb[0] = 0;     rgb[1] = value; rgb[2] = up;    break;
+         case 3: rgb[0] = 0;     rgb[1] = down;  rgb[2] = value; break;
+         case 4: rgb[0] = up;    rgb[1] = 0;     rgb[2] = value; break;
+         default: rgb[0] = value; rgb[1] = 0;    rgb[2] = down;  break;
+         }
+
+         for (int c = 0; c < 3; c++) {
+            px[c] = (uint8_t)(255 * rgb[c] + 0.5);
+         }
+      }
+   });
+}
+
+int DomainColoring::undefined() const {
+   return n_undefined;
+}
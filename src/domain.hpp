@@ -0,0 +1,84 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef DOMAIN_HPP
+#define DOMAIN_HPP
+
+#include "cxcompile.hpp"
+#include "threadpool.hpp"
+#include <cstdint>
+#include <vector>
+
+/* Width and height of a tile, in pixels. Tiles are the unit of work for the thread pool. */
+#define DOMAIN_TILE 32
+
+/* Brightness at the bottom of each band of modulus. It rises to full at the top. */
+#define DOMAIN_BAND_FLOOR 0.6
+
+/* A domain coloring of a complex function over a rectangle of the complex plane.
+ * Each pixel's hue is the argument of the function's value there. Its brightness rises
+ *  through each band of modulus between consecutive powers of two, so zeros and poles show up
+ *  as points where every hue meets, ringed by bands.
+ */
+class DomainColoring {
+   /* Size of the plot in pixels */
+   int width, height;
+
+   /* The function's value at the center of each pixel, as (real, imaginary) pairs, row-major */
+   std::vector<double> values;
+
+   /* Number of pixels where the function is undefined */
+   int n_undefined;
+
+public:
+   DomainColoring();
+
+   /**
+    * Evaluates a function over a window, in tiles spread across the thread pool.
+    * Horizontal is the real axis and vertical the imaginary axis.
+    *
+    * @param fn The compiled function
+    * @param xmin The left edge of the window
+    * @param xmax The right edge of the window
+    * @param ymin The bottom edge of the window
+    * @param ymax The top edge of the window
+    * @param width The window's width in pixels
+    * @param height The window's height in pixels
+    * @param pool The threads to evaluate tiles on
+    */
+   void compute(CxBatchFunc fn,
+                double xmin, double xmax, double ymin, double ymax,
+                int width, int height,
+                ThreadPool &pool = ThreadPool::shared());
+
+   /**
+    * Colors the values into an opaque RGBA image of the same size, a row per pool task.
+    * Pixels where the function is undefined are black.
+    *
+    * @param pixels The image's pixels, row-major with 4 bytes per pixel
+    * @param rowstride The number of bytes between the starts of consecutive rows
+    * @param pool The threads to color rows on
+    */
+   void tone_map(uint8_t *pixels, int rowstride,
+                 ThreadPool &pool = ThreadPool::shared()) const;
+
+   /* Number of pixels where the function is undefined in the last plot */
+   int undefined() const;
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include "expr.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 Expr *new_num_expr(double number) {
@@ -30,9 +31,14 @@ Expr *new_num_expr(double number) {
 }
 
 Expr *new_arg_expr() {
+   return new_param_expr(0);
+}
+
+Expr *new_param_expr(int index) {
    Expr *expr = malloc(sizeof(Expr));
    expr->type = ARGUMENT;
-   
+   expr->val.argindex = index;
+
    return expr;
 }
 
@@ -51,11 +57,19 @@ Expr *new_apply(char *funcname, Expr *arg) {
    expr->type = APPLY;
    expr->val.apply = malloc(sizeof(Apply));
    expr->val.apply->funcname = funcname;
-   expr->val.apply->arg = arg;
+   expr->val.apply->n_args = 1;
+   expr->val.apply->args = malloc(sizeof(Expr *));
+   expr->val.apply->args[0] = arg;
 
    return expr;
 }
 
+void push_apply_arg(Expr *apply, Expr *arg) {
+   Apply *inner = apply->val.apply;
+   inner->args = realloc(inner->args, (inner->n_args + 1) * sizeof(Expr *));
+   inner->args[inner->n_args++] = arg;
+}
+
 Expr *new_binary(BOp op, Expr *lhs, Expr *rhs) {
    Expr *expr = malloc(sizeof(Expr));
    expr->type = BINARY;
@@ -67,6 +81,27 @@ Expr *new_binary(BOp op, Expr *lhs, Expr *rhs) {
    return expr;
 }
 
+Expr *new_integral(char *funcname, Expr *lower, Expr *upper) {
+   Expr *expr = malloc(sizeof(Expr));
+   expr->type = INTEGRAL;
+   expr->val.integral = malloc(sizeof(Integral));
+   expr->val.integral->funcname = funcname;
+   expr->val.integral->lower = lower;
+   expr->val.integral->upper = upper;
+
+   return expr;
+}
+
+Expr *new_deriv(char *funcname, int order) {
+   Expr *expr = malloc(sizeof(Expr));
+   expr->type = DERIVATIVE;
+   expr->val.derivative = malloc(sizeof(Derivative));
+   expr->val.derivative->funcname = funcname;
+   expr->val.derivative->order = order;
+
+   return expr;
+}
+
 Expr *new_var_expr(char *varname) {
    Expr *expr = malloc(sizeof(Expr));
    expr->type = VARIABLE;
@@ -75,6 +110,545 @@ Expr *new_var_expr(char *varname) {
    return expr;
 }
 
+int is_const_expr(const Expr *expr) {
+   switch (expr->type) {
+   case UNARY:
+      return is_const_expr(expr->val.unary->inner);
+   case BINARY:
+      return is_const_expr(expr->val.binary->lhs)
+          && is_const_expr(expr->val.binary->rhs);
+   case APPLY:
+      for (int i = 0; i < expr->val.apply->n_args; i++) {
+         if (!is_const_expr(expr->val.apply->args[i])) {
+            return 0;
+         }
+      }
+
+      return 1;
+   case INTEGRAL:
+      return is_const_expr(expr->val.integral->lower)
+          && is_const_expr(expr->val.integral->upper);
+   case ARGUMENT:
+   case DERIVATIVE:
+      return 0;
+   default:
+      return 1;
+   }
+}
+
+int equal_expr(const Expr *a, const Expr *b) {
+   if (a->type != b->type) {
+      return 0;
+   }
+
+   switch (a->type) {
+   case NUMBER:
+      return a->val.number == b->val.number;
+   case VARIABLE:
+      return strcmp(a->val.varname, b->val.varname) == 0;
+   case ARGUMENT:
+      return a->val.argindex == b->val.argindex;
+   case UNARY:
+      return a->val.unary->op == b->val.unary->op
+          && equal_expr(a->val.unary->inner, b->val.unary->inner);
+   case BINARY:
+      return a->val.binary->op == b->val.binary->op
+          && equal_expr(a->val.binary->lhs, b->val.binary->lhs)
+          && equal_expr(a->val.binary->rhs, b->val.binary->rhs);
+   case APPLY:
+      if (strcmp(a->val.apply->funcname, b->val.apply->funcname) != 0
+          || a->val.apply->n_args != b->val.apply->n_args) {
+         return 0;
+      }
+
+      for (int i = 0; i < a->val.apply->n_args; i++) {
+         if (!equal_expr(a->val.apply->args[i], b->val.apply->args[i])) {
+            return 0;
+         }
+      }
+
+      return 1;
+   case INTEGRAL:
+      return strcmp(a->val.integral->funcname, b->val.integral->funcname) == 0
+          && equal_expr(a->val.integral->lower, b->val.integral->lower)
+          && equal_expr(a->val.integral->upper, b->val.integral->upper);
+   case DERIVATIVE:
+      return strcmp(a->val.derivative->funcname, b->val.derivative->funcname) == 0
+          && a->val.derivative->order == b->val.derivative->order;
+   }
+
+   return 0;
+}
+
+Expr *copy_expr(const Expr *expr) {
+   return subst_arg(expr, NULL);
+}
+
+Expr *subst_arg(const Expr *expr, const Expr *arg) {
+   return arg != NULL? subst_args(expr, (Expr *const *)&arg, 1)
+                     : subst_args(expr, NULL, 0);
+}
+
+Expr *subst_args(const Expr *expr, Expr *const *args, int n_args) {
+   switch (expr->type) {
+   case UNARY:
+      return new_unary(expr->val.unary->op,
+                       subst_args(expr->val.unary->inner, args, n_args));
+   case BINARY:
+      return new_binary(expr->val.binary->op,
+                        subst_args(expr->val.binary->lhs, args, n_args),
+                        subst_args(expr->val.binary->rhs, args, n_args));
+   case APPLY:
+      {
+         const Apply *apply = expr->val.apply;
+         Expr *copy = new_apply(strdup(apply->funcname),
+                                subst_args(apply->args[0], args, n_args));
+         for (int i = 1; i < apply->n_args; i++) {
+            push_apply_arg(copy, subst_args(apply->args[i], args, n_args));
+         }
+
+         return copy;
+      }
+   case INTEGRAL:
+      return new_integral(strdup(expr->val.integral->funcname),
+                          subst_args(expr->val.integral->lower, args, n_args),
+                          subst_args(expr->val.integral->upper, args, n_args));
+   case DERIVATIVE:
+      return new_deriv(strdup(expr->val.derivative->funcname),
+                       expr->val.derivative->order);
+   case NUMBER:
+      return new_num_expr(expr->val.number);
+   case VARIABLE:
+      return new_var_expr(strdup(expr->val.varname));
+   case ARGUMENT:
+      if (expr->val.argindex < n_args) {
+         return copy_expr(args[expr->val.argindex]);
+      }
+
+      return new_param_expr(expr->val.argindex);
+   }
+
+   return NULL;
+}
+
+/**
+ * Finds the position of a name in a parameter list.
+ *
+ * @return The index, or -1 if it isn't there
+ */
+static int param_index(const Apply *params, const char *name) {
+   for (int i = 0; i < params->n_args; i++) {
+      const Expr *param = params->args[i];
+      if ((param->type == ARGUMENT && strcmp(name, "x") == 0)
+          || (param->type == VARIABLE && strcmp(name, param->val.varname) == 0)) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+/**
+ * Rewrites the parameters in a definition's body in place.
+ *
+ * @return 0 if x was used without being a parameter, 1 otherwise
+ */
+static int bind_rec(Expr *expr, const Apply *params) {
+   switch (expr->type) {
+   case UNARY:
+      return bind_rec(expr->val.unary->inner, params);
+   case BINARY:
+      return bind_rec(expr->val.binary->lhs, params)
+          && bind_rec(expr->val.binary->rhs, params);
+   case APPLY:
+      for (int i = 0; i < expr->val.apply->n_args; i++) {
+         if (!bind_rec(expr->val.apply->args[i], params)) {
+            return 0;
+         }
+      }
+
+      return 1;
+   case INTEGRAL:
+      return bind_rec(expr->val.integral->lower, params)
+          && bind_rec(expr->val.integral->upper, params);
+   case VARIABLE:
+      {
+         int index = param_index(params, expr->val.varname);
+         if (index >= 0) {
+            free(expr->val.varname);
+            expr->type = ARGUMENT;
+            expr->val.argindex = index;
+         }
+      }
+
+      return 1;
+   case ARGUMENT:
+      expr->val.argindex = param_index(params, "x");
+      return expr->val.argindex >= 0;
+   default:
+      return 1;
+   }
+}
+
+int bind_params(Expr *body, const Apply *params) {
+   for (int i = 0; i < params->n_args; i++) {
+      const Expr *param = params->args[i];
+      if (param->type != ARGUMENT && param->type != VARIABLE) {
+         return -1;
+      }
+
+      const char *name = param->type == ARGUMENT? "x": param->val.varname;
+      if (param_index(params, name) != i) {
+         return -1;
+      }
+   }
+
+   if (!bind_rec(body, params)) {
+      return -1;
+   }
+
+   return params->n_args;
+}
+
+/**
+ * Differentiates a built-in function applied to an inner expression.
+ *
+ * @param apply The function application
+ * @param d_inner The derivative of the inner expression
+ *
+ * @return The derivative, or NULL if the function isn't a known built-in
+ */
+static Expr *derive_apply(const Apply *apply, Expr *d_inner) {
+   const char *name = apply->funcname;
+   const Expr *u = apply->args[0];
+
+   Expr *d_outer;
+   if (apply->n_args != 1) {
+      destroy_expr(d_inner);
+      return NULL;
+   } else if (strcmp(name, "Sin") == 0) {
+      d_outer = new_apply(strdup("Cos"), copy_expr(u));
+   } else if (strcmp(name, "Cos") == 0) {
+      d_outer = new_unary(NEG, new_apply(strdup("Sin"), copy_expr(u)));
+   } else if (strcmp(name, "Tan") == 0) {
+      d_outer = new_binary(DIV,
+                           new_num_expr(1),
+                           new_binary(POW,
+                                      new_apply(strdup("Cos"), copy_expr(u)),
+                                      new_num_expr(2)));
+   } else if (strcmp(name, "Log") == 0) {
+      d_outer = new_binary(DIV, new_num_expr(1), copy_expr(u));
+   } else if (strcmp(name, "Sqrt") == 0) {
+      d_outer = new_binary(DIV,
+                           new_num_expr(1),
+                           new_binary(MUL,
+                                      new_num_expr(2),
+                                      new_apply(strdup("Sqrt"), copy_expr(u))));
+   } else {
+      destroy_expr(d_inner);
+      return NULL;
+   }
+
+   // Chain rule
+   return new_binary(MUL, d_outer, d_inner);
+}
+
+/**
+ * Differentiates a binary operation.
+ *
+ * @param binary The operation
+ * @param du The derivative of the left-hand side
+ * @param dv The derivative of the right-hand side
+ *
+ * @return The derivative
+ */
+static Expr *derive_binary(const Binary *binary, Expr *du, Expr *dv) {
+   const Expr *u = binary->lhs,
+              *v = binary->rhs;
+
+   switch (binary->op) {
+   case ADD:
+   case SUB:
+      return new_binary(binary->op, du, dv);
+   case MUL:
+      return new_binary(ADD,
+                        new_binary(MUL, du, copy_expr(v)),
+                        new_binary(MUL, copy_expr(u), dv));
+   case DIV:
+      return new_binary(DIV,
+                        new_binary(SUB,
+                                   new_binary(MUL, du, copy_expr(v)),
+                                   new_binary(MUL, copy_expr(u), dv)),
+                        new_binary(POW, copy_expr(v), new_num_expr(2)));
+   case POW:
+      if (is_const_expr(v)) {
+         // Power rule
+         destroy_expr(dv);
+         return new_binary(MUL,
+                           new_binary(MUL,
+                                      copy_expr(v),
+                                      new_binary(POW,
+                                                 copy_expr(u),
+                                                 new_binary(SUB,
+                                                            copy_expr(v),
+                                                            new_num_expr(1)))),
+                           du);
+      }
+
+      // General case: d(u^v) = u^v * (v' Log(u) + v u' / u)
+      return new_binary(MUL,
+                        new_binary(POW, copy_expr(u), copy_expr(v)),
+                        new_binary(ADD,
+                                   new_binary(MUL,
+                                              dv,
+                                              new_apply(strdup("Log"), copy_expr(u))),
+                                   new_binary(DIV,
+                                              new_binary(MUL, copy_expr(v), du),
+                                              copy_expr(u))));
+   }
+
+   destroy_expr(du);
+   destroy_expr(dv);
+   return NULL;
+}
+
+Expr *derive_expr(const Expr *expr) {
+   switch (expr->type) {
+   case NUMBER:
+   case VARIABLE:
+      return new_num_expr(0);
+   case ARGUMENT:
+      return new_num_expr(expr->val.argindex == 0? 1: 0);
+   case UNARY:
+      {
+         Expr *du = derive_expr(expr->val.unary->inner);
+         if (du == NULL) {
+            return NULL;
+         }
+
+         if (expr->val.unary->op == NEG) {
+            return new_unary(NEG, du);
+         }
+
+         // d|u| = u' * u / |u|
+         return new_binary(MUL,
+                           du,
+                           new_binary(DIV,
+                                      copy_expr(expr->val.unary->inner),
+                                      copy_expr(expr)));
+      }
+   case BINARY:
+      {
+         Expr *du = derive_expr(expr->val.binary->lhs);
+         Expr *dv = derive_expr(expr->val.binary->rhs);
+         if (du == NULL || dv == NULL) {
+            destroy_expr(du);
+            destroy_expr(dv);
+            return NULL;
+         }
+
+         return derive_binary(expr->val.binary, du, dv);
+      }
+   case APPLY:
+      {
+         // Only built-ins of one argument are left after inlining.
+         if (expr->val.apply->n_args != 1) {
+            return NULL;
+         }
+
+         Expr *du = derive_expr(expr->val.apply->args[0]);
+         if (du == NULL) {
+            return NULL;
+         }
+
+         return derive_apply(expr->val.apply, du);
+      }
+   case INTEGRAL:
+      {
+         // Fundamental theorem of calculus: d/dx of F from a to b is F(b) b' - F(a) a'
+         const Integral *integral = expr->val.integral;
+         Expr *da = derive_expr(integral->lower);
+         Expr *db = derive_expr(integral->upper);
+         if (da == NULL || db == NULL) {
+            destroy_expr(da);
+            destroy_expr(db);
+            return NULL;
+         }
+
+         return new_binary(SUB,
+                           new_binary(MUL,
+                                      new_apply(strdup(integral->funcname),
+                                                copy_expr(integral->upper)),
+                                      db),
+                           new_binary(MUL,
+                                      new_apply(strdup(integral->funcname),
+                                                copy_expr(integral->lower)),
+                                      da));
+      }
+   case DERIVATIVE:
+      // Must be expanded before being differentiated again.
+      return NULL;
+   }
+
+   return NULL;
+}
+
+/**
+ * Replaces an expression with a literal number, freeing the old one.
+ */
+static Expr *replace_num(Expr *expr, double number) {
+   destroy_expr(expr);
+   return new_num_expr(number);
+}
+
+/**
+ * Replaces a binary expression with one of its operands, freeing the rest.
+ *
+ * @param expr The binary expression
+ * @param keep_lhs Whether to keep the left operand or the right one
+ */
+static Expr *replace_operand(Expr *expr, int keep_lhs) {
+   Binary *binary = expr->val.binary;
+   Expr *kept = keep_lhs? binary->lhs: binary->rhs;
+   if (keep_lhs) {
+      binary->lhs = NULL;
+   } else {
+      binary->rhs = NULL;
+   }
+
+   destroy_expr(expr);
+   return kept;
+}
+
+static inline int is_num(const Expr *expr, double number) {
+   return expr->type == NUMBER && expr->val.number == number;
+}
+
+Expr *simplify_expr(Expr *expr) {
+   switch (expr->type) {
+   case UNARY:
+      {
+         Unary *unary = expr->val.unary;
+         unary->inner = simplify_expr(unary->inner);
+
+         Expr *inner = unary->inner;
+         if (inner->type == NUMBER) {
+            return replace_num(expr, unary->op == NEG? -inner->val.number
+                                                     : fabs(inner->val.number));
+         }
+
+         if (unary->op == NEG
+             && inner->type == UNARY
+             && inner->val.unary->op == NEG) {
+            Expr *kept = inner->val.unary->inner;
+            inner->val.unary->inner = NULL;
+            destroy_expr(expr);
+            return kept;
+         }
+      }
+
+      return expr;
+   case BINARY:
+      {
+         Binary *binary = expr->val.binary;
+         binary->lhs = simplify_expr(binary->lhs);
+         binary->rhs = simplify_expr(binary->rhs);
+
+         Expr *lhs = binary->lhs,
+              *rhs = binary->rhs;
+         if (lhs->type == NUMBER && rhs->type == NUMBER) {
+            double a = lhs->val.number,
+                   b = rhs->val.number;
+            switch (binary->op) {
+            case ADD: return replace_num(expr, a + b);
+            case SUB: return replace_num(expr, a - b);
+            case MUL: return replace_num(expr, a * b);
+            case DIV: return replace_num(expr, a / b);
+            case POW: return replace_num(expr, pow(a, b));
+            }
+         }
+
+         switch (binary->op) {
+         case ADD:
+         case SUB:
+            if (is_num(rhs, 0)) return replace_operand(expr, 1);
+            if (is_num(lhs, 0)) {
+               BOp op = binary->op;
+               Expr *kept = replace_operand(expr, 0);
+               return op == ADD? kept: simplify_expr(new_unary(NEG, kept));
+            }
+
+            // a + -b = a - b, and a - -b = a + b
+            if (rhs->type == UNARY && rhs->val.unary->op == NEG) {
+               binary->op = binary->op == ADD? SUB: ADD;
+               binary->rhs = rhs->val.unary->inner;
+               rhs->val.unary->inner = NULL;
+               destroy_expr(rhs);
+            }
+
+            break;
+         case MUL:
+            if (is_num(lhs, 0) || is_num(rhs, 0)) return replace_num(expr, 0);
+
+            // Constants are moved to the left so that they can be combined.
+            if (rhs->type == NUMBER) {
+               binary->lhs = rhs;
+               binary->rhs = lhs;
+               lhs = binary->lhs;
+               rhs = binary->rhs;
+            }
+
+            if (is_num(lhs, 1)) return replace_operand(expr, 0);
+            if (is_num(lhs, -1)) return new_unary(NEG, replace_operand(expr, 0));
+            if (lhs->type == NUMBER
+                && rhs->type == BINARY
+                && rhs->val.binary->op == MUL
+                && rhs->val.binary->lhs->type == NUMBER) {
+               // a * (b * e) = (a * b) * e
+               rhs->val.binary->lhs->val.number *= lhs->val.number;
+               return replace_operand(expr, 0);
+            }
+
+            break;
+         case DIV:
+            if (is_num(lhs, 0)) return replace_num(expr, 0);
+            if (is_num(rhs, 1)) return replace_operand(expr, 1);
+            break;
+         case POW:
+            if (is_num(rhs, 0) || is_num(lhs, 1)) return replace_num(expr, 1);
+            if (is_num(rhs, 1)) return replace_operand(expr, 1);
+            if (rhs->type == NUMBER
+                && lhs->type == BINARY
+                && lhs->val.binary->op == POW
+                && lhs->val.binary->rhs->type == NUMBER
+                && rhs->val.number == floor(rhs->val.number)
+                && lhs->val.binary->rhs->val.number
+                      == floor(lhs->val.binary->rhs->val.number)) {
+               // (u^m)^n = u^(mn) holds for integers m and n
+               lhs->val.binary->rhs->val.number *= rhs->val.number;
+               return replace_operand(expr, 1);
+            }
+
+            break;
+         }
+      }
+
+      return expr;
+   case APPLY:
+      for (int i = 0; i < expr->val.apply->n_args; i++) {
+         expr->val.apply->args[i] = simplify_expr(expr->val.apply->args[i]);
+      }
+
+      return expr;
+   case INTEGRAL:
+      expr->val.integral->lower = simplify_expr(expr->val.integral->lower);
+      expr->val.integral->upper = simplify_expr(expr->val.integral->upper);
+      return expr;
+   default:
+      return expr;
+   }
+}
+
 void print_expr(const Expr *expr, FILE *to) {
    switch (expr->type) {
    case UNARY:
@@ -100,8 +674,32 @@ void print_expr(const Expr *expr, FILE *to) {
       break;
    case APPLY:
       fprintf(to, "%s(", expr->val.apply->funcname);
-      print_expr(expr->val.apply->arg, to);
+      for (int i = 0; i < expr->val.apply->n_args; i++) {
+         if (i > 0) {
+            fprintf(to, ", ");
+         }
+
+         print_expr(expr->val.apply->args[i], to);
+      }
+
       fprintf(to, ")");
+      break;
+   case INTEGRAL:
+      fprintf(to, "Integral(%s, ", expr->val.integral->funcname);
+      print_expr(expr->val.integral->lower, to);
+      fprintf(to, ", ");
+      print_expr(expr->val.integral->upper, to);
+      fprintf(to, ")");
+      break;
+   case DERIVATIVE:
+      if (expr->val.derivative->order == 1) {
+         fprintf(to, "D(%s)", expr->val.derivative->funcname);
+      } else {
+         fprintf(to, "D(%s, %d)",
+                 expr->val.derivative->funcname,
+                 expr->val.derivative->order);
+      }
+
       break;
    case NUMBER:
       fprintf(to, "%.2f", expr->val.number);
@@ -110,7 +708,12 @@ void print_expr(const Expr *expr, FILE *to) {
       fprintf(to, "%s", expr->val.varname);
       break;
    case ARGUMENT:
-      fprintf(to, "X");
+      if (expr->val.argindex == 0) {
+         fprintf(to, "X");
+      } else {
+         fprintf(to, "X%d", expr->val.argindex + 1);
+      }
+
       break;
    }
 }
@@ -130,9 +733,23 @@ void destroy_expr(Expr *expr) {
       break;
    case APPLY:
       free(expr->val.apply->funcname);
-      destroy_expr(expr->val.apply->arg);
+      for (int i = 0; i < expr->val.apply->n_args; i++) {
+         destroy_expr(expr->val.apply->args[i]);
+      }
+
+      free(expr->val.apply->args);
       free(expr->val.apply);
       break;
+   case INTEGRAL:
+      free(expr->val.integral->funcname);
+      destroy_expr(expr->val.integral->lower);
+      destroy_expr(expr->val.integral->upper);
+      free(expr->val.integral);
+      break;
+   case DERIVATIVE:
+      free(expr->val.derivative->funcname);
+      free(expr->val.derivative);
+      break;
    case VARIABLE:
       free(expr->val.varname);
       break;
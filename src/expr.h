@@ -49,11 +49,25 @@ typedef struct {
 /* Function application expression type */
 typedef struct {
    char *funcname;
-   Expr *arg;
+   int n_args;
+   Expr **args;
 } Apply;
 
+/* Definite integral expression type */
+typedef struct {
+   char *funcname;
+   Expr *lower;
+   Expr *upper;
+} Integral;
+
+/* Derivative expression type */
+typedef struct {
+   char *funcname;
+   int order;
+} Derivative;
+
 typedef enum {
-   NUMBER, VARIABLE, ARGUMENT, UNARY, BINARY, APPLY
+   NUMBER, VARIABLE, ARGUMENT, UNARY, BINARY, APPLY, INTEGRAL, DERIVATIVE
 } ExprType;
 
 typedef union {
@@ -61,7 +75,10 @@ typedef union {
    Unary *unary;
    Binary *binary;
    Apply *apply;
+   Integral *integral;
+   Derivative *derivative;
    char *varname;
+   int argindex;
 } ExprVal;
 
 /* Overarching expression type */
@@ -70,6 +87,11 @@ struct Expr {
    ExprVal val;
 };
 
+/* Statements which ask something about a named function, rather than evaluating an expression */
+typedef enum {
+   NO_QUERY, ROOTS_QUERY, EXTREMA_QUERY, SUM_QUERY, LIMIT_QUERY
+} Query;
+
 /**
  * Constructor for an expression representing a literal scalar value
  */
@@ -80,6 +102,13 @@ Expr *new_num_expr(double number);
  */
 Expr *new_arg_expr();
 
+/**
+ * Constructor for an expression representing a parameter of a function
+ *
+ * @param index The parameter's position, x being 0
+ */
+Expr *new_param_expr(int index);
+
 /**
  * Constructor for an expression representing a unary operation
  *
@@ -105,11 +134,109 @@ Expr *new_binary(BOp op, Expr *lhs, Expr *rhs);
  */
 Expr *new_apply(char *funcname, Expr *arg);
 
+/**
+ * Adds another argument to a function application.
+ *
+ * @param apply The function application
+ * @param arg The argument to add
+ */
+void push_apply_arg(Expr *apply, Expr *arg);
+
+/**
+ * Constructor for an expression representing a definite integral
+ *
+ * @param funcname The name of the function being integrated
+ * @param lower The lower integration bound
+ * @param upper The upper integration bound
+ */
+Expr *new_integral(char *funcname, Expr *lower, Expr *upper);
+
+/* The highest order of derivative D(F, n) accepts */
+#define DERIV_MAX_ORDER 16
+
+/**
+ * Constructor for an expression representing the derivative of a named function
+ *
+ * @param funcname The name of the function being differentiated
+ * @param order How many times to differentiate it
+ */
+Expr *new_deriv(char *funcname, int order);
+
 /**
  * Constructor for an expression representing a named variable
  */
 Expr *new_var_expr(char *varname);
 
+/**
+ * Determines if an expression is constant, i.e. does not depend on x.
+ *
+ * @param expr The expression to check
+ *
+ * @return 1 if the expression is constant, 0 otherwise
+ */
+int is_const_expr(const Expr *expr);
+
+/**
+ * Determines if two expressions are structurally identical.
+ *
+ * @return 1 if they are the same, 0 otherwise
+ */
+int equal_expr(const Expr *a, const Expr *b);
+
+/**
+ * Makes a deep copy of an expression.
+ */
+Expr *copy_expr(const Expr *expr);
+
+/**
+ * Makes a deep copy of an expression with every x replaced by another expression.
+ *
+ * @param expr The expression to copy
+ * @param arg What to put in place of x
+ */
+Expr *subst_arg(const Expr *expr, const Expr *arg);
+
+/**
+ * Makes a deep copy of an expression with every parameter replaced by another expression.
+ *
+ * @param expr The expression to copy
+ * @param args What to put in place of each parameter
+ * @param n_args How many parameters to replace
+ */
+Expr *subst_args(const Expr *expr, Expr *const *args, int n_args);
+
+/**
+ * Turns the variables in the body of a definition which name its parameters into
+ * parameter expressions.
+ *
+ * @param body The body of the definition
+ * @param params An application whose arguments are the parameter names
+ *
+ * @return The number of parameters, or -1 if they aren't distinct names
+ *         or the body uses x without it being one of them
+ */
+int bind_params(Expr *body, const Apply *params);
+
+/**
+ * Differentiates an expression with respect to x, the first parameter.
+ * Applications of functions other than the built-ins must be inlined first.
+ *
+ * @param expr The expression to differentiate
+ *
+ * @return A new, unsimplified expression, or NULL if expr can't be differentiated
+ */
+Expr *derive_expr(const Expr *expr);
+
+/**
+ * Folds constants and removes identity operations from an expression.
+ * Takes ownership of the expression, freeing any parts that are dropped.
+ *
+ * @param expr The expression to simplify
+ *
+ * @return The simplified expression
+ */
+Expr *simplify_expr(Expr *expr);
+
 /**
  * Pretty-prints an expression to the console.
  *
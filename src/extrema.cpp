@@ -0,0 +1,213 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "extrema.hpp"
+#include "asymptotes.hpp"
+#include "threadpool.hpp"
+
+#include <cmath>
+
+/* (3 - Sqrt(5)) / 2, the fraction of the bracket golden-section search steps into */
+#define GOLDEN_STEP 0.3819660112501051
+
+double brent_min(Func fn, double a, double b, double sign) {
+   // x is the lowest point found so far, w the second lowest, and v the previous w.
+   double x = a + GOLDEN_STEP * (b - a),
+          w = x, v = x;
+   double fx = sign * fn(x),
+          fw = fx, fv = fx;
+
+   // d is the last step, and e the one before it.
+   double d = 0, e = 0;
+
+   for (int i = 0; i < EXTREMUM_MAX_ITER; i++) {
+      double m = (a + b) / 2,
+             tol = EXTREMUM_REL_TOL * std::fabs(x) + EXTREMUM_TOL,
+             tol2 = 2 * tol;
+
+      if (std::fabs(x - m) <= tol2 - (b - a) / 2) {
+         break;
+      }
+
+      bool golden = true;
+      if (std::fabs(e) > tol) {
+         // Fit a parabola through x, w and v.
+         double r = (x - w) * (fx - fv),
+                q = (x - v) * (fx - fw),
+                p = (x - v) * q - (x - w) * r;
+         q = 2 * (q - r);
+         if (q > 0) {
+            p = -p;
+         } else {
+            q = -q;
+         }
+
+         // Only take its minimum if it's inside the bracket and the steps are shrinking quickly enough.
+         if (std::fabs(p) < std::fabs(q * e / 2) && p > q * (a - x) && p < q * (b - x)) {
+            e = d;
+            d = p / q;
+
+            double u = x + d;
+            if (u - a < tol2 || b - u < tol2) {
+               d = x < m ? tol : -tol;
+            }
+
+            golden = false;
+         }
+      }
+
+      if (golden) {
+         e = (x < m ? b : a) - x;
+         d = GOLDEN_STEP * e;
+      }
+
+      double u = x + (std::fabs(d) >= tol ? d : (d > 0 ? tol : -tol)),
+             fu = sign * fn(u);
+
+      if (fu <= fx) {
+         if (u < x) {
+            b = x;
+         } else {
+            a = x;
+         }
+
+         v = w; fv = fw;
+         w = x; fw = fx;
+         x = u; fx = fu;
+      } else {
+         if (u < x) {
+            a = u;
+         } else {
+            b = u;
+         }
+
+         if (fu <= fw || w == x) {
+            v = w; fv = fw;
+            w = u; fw = fu;
+         } else if (fu <= fv || v == x || v == w) {
+            v = u; fv = fu;
+         }
+      }
+   }
+
+   return x;
+}
+
+/**
+ * Determines if a function goes to infinity between two points.
+ *
+ * @param fn The function
+ * @param lo The lower point
+ * @param hi The upper point
+ * @param xrange The width of the whole interval being searched
+ */
+static bool has_pole(Func fn, double lo, double hi, double xrange) {
+   Point A = Point::of(fn, lo),
+         B = Point::of(fn, hi);
+
+   return goes_pos_inf(fn, A, B, xrange).y != 0 || goes_neg_inf(fn, A, B, xrange).y != 0;
+}
+
+/**
+ * Refines an extremum as a root of the derivative, if the derivative changes sign across the bracket.
+ *
+ * @param deriv The derivative
+ * @param lo The lower end of the bracket
+ * @param hi The upper end of the bracket
+ * @param x Where to write the extremum
+ *
+ * @return false if the derivative couldn't be used
+ */
+static bool deriv_root(Func deriv, double lo, double hi, double *x) {
+   double dlo = deriv(lo),
+          dhi = deriv(hi);
+   if (!std::isfinite(dlo) || !std::isfinite(dhi) || (dlo > 0) == (dhi > 0)) {
+      return false;
+   }
+
+   *x = brent(deriv, lo, hi, dlo, dhi);
+
+   // At a corner, like the minimum of [x], the derivative jumps across 0 instead of reaching it.
+   double dx = std::fabs(deriv(*x));
+   return dx < std::min(std::fabs(dlo), std::fabs(dhi))
+          || dx <= ROOT_RESIDUAL * std::max(std::fabs(dlo), std::fabs(dhi));
+}
+
+std::vector<Extremum> find_extrema(BatchFunc batch, Func fn, double a, double b, Func deriv, int n) {
+   std::vector<Extremum> extrema;
+   if (!(a < b) || n < 2) {
+      return extrema;
+   }
+
+   double h = (b - a) / n;
+   auto x_at = [=](int64_t i) {
+      return i == n ? b : a + i * h;
+   };
+
+   std::vector<double> ys = sample_interval(batch, a, b, n);
+
+   // Each sample lower or higher than its neighbours brackets an extremum.
+   std::vector<int64_t> brackets;
+   for (int64_t i = 1; i < n; i++) {
+      if (!std::isfinite(ys[i - 1]) || !std::isfinite(ys[i]) || !std::isfinite(ys[i + 1])) {
+         continue;
+      }
+
+      if ((ys[i] < ys[i - 1] && ys[i] <= ys[i + 1])
+          || (ys[i] > ys[i - 1] && ys[i] >= ys[i + 1])) {
+         brackets.push_back(i);
+      }
+   }
+
+   // Extrema at asymptotes are left as NaN.
+   std::vector<Extremum> found(brackets.size(), { NAN, NAN, false });
+   ThreadPool::shared().run(brackets.size(), [&](int64_t k) {
+      int64_t i = brackets[k];
+      double lo = x_at(i - 1),
+             hi = x_at(i + 1);
+      bool maximum = ys[i] > ys[i - 1];
+
+      if (has_pole(fn, lo, hi, b - a)) {
+         return;
+      }
+
+      // The derivative's root is found to full precision, where minimization only gets half of it.
+      double x;
+      if (deriv == nullptr || !deriv_root(deriv, lo, hi, &x)) {
+         x = brent_min(fn, lo, hi, maximum ? -1 : 1);
+      }
+
+      double y = fn(x);
+
+      // The sample itself is kept if the refinement didn't improve on it.
+      if (!std::isfinite(y) || (maximum ? y < ys[i] : y > ys[i])) {
+         x = x_at(i);
+         y = ys[i];
+      }
+
+      found[k] = { x, y, maximum };
+   });
+
+   for (const Extremum &ext: found) {
+      if (!std::isnan(ext.x)) {
+         extrema.push_back(ext);
+      }
+   }
+
+   return extrema;
+}
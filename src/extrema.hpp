@@ -0,0 +1,74 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef EXTREMA_HPP
+#define EXTREMA_HPP
+
+#include "compile.hpp"
+#include "roots.hpp"
+#include <vector>
+
+/* Tolerances of the refined extrema when no derivative is available.
+ * A minimum can only be located to about the square root of the machine precision.
+ */
+#define EXTREMUM_TOL 1e-10
+#define EXTREMUM_REL_TOL 1.5e-8
+
+/* Most iterations Brent minimization takes on a bracket */
+#define EXTREMUM_MAX_ITER 200
+
+/* A local minimum or maximum of a function */
+struct Extremum {
+   double x, y;
+   bool maximum;
+};
+
+/**
+ * Refines a local minimum of a function with Brent's method,
+ * which combines golden-section search with parabolic interpolation.
+ * There must be a point inside the bracket lower than both of its ends.
+ *
+ * @param fn The function
+ * @param a The lower end of the bracket
+ * @param b The upper end of the bracket
+ * @param sign -1 to find a maximum instead
+ *
+ * @return The location of the minimum
+ */
+double brent_min(Func fn, double a, double b, double sign = 1);
+
+/**
+ * Finds the local minima and maxima of a function inside an interval.
+ * The interval is sampled in parallel, and every sample lower or higher than both of its
+ * neighbours brackets an extremum. If the derivative is given and changes sign across the bracket,
+ * the extremum is refined as its root. Otherwise it is refined with Brent minimization.
+ * Extrema at asymptotes are thrown out.
+ *
+ * @param batch The function, compiled to evaluate arrays of points, for the scan
+ * @param fn The function, for refining the extrema
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param deriv The derivative of fn, or nullptr if it isn't available
+ * @param n How many pieces to cut the interval into while scanning
+ *
+ * @return The extrema, in increasing order of x
+ */
+std::vector<Extremum> find_extrema(BatchFunc batch, Func fn, double a, double b,
+                                   Func deriv = nullptr, int n = ROOT_SCAN);
+
+#endif
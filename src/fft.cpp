@@ -0,0 +1,181 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "fft.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+/**
+ * Multiplies two complex numbers held as (re, im) pairs.
+ */
+static inline __m128d cmul(__m128d a, __m128d b) {
+   __m128d re = _mm_unpacklo_pd(b, b),
+           im = _mm_unpackhi_pd(b, b),
+           swapped = _mm_shuffle_pd(a, a, 1);
+
+   // (ar br - ai bi, ai br + ar bi)
+   __m128d cross = _mm_mul_pd(swapped, im);
+   cross = _mm_xor_pd(cross, _mm_set_pd(0.0, -0.0));
+   return _mm_add_pd(_mm_mul_pd(a, re), cross);
+}
+
+/**
+ * Multiplies a complex number by -i.
+ */
+static inline __m128d mul_neg_i(__m128d a) {
+   // (re, im) -> (im, -re)
+   return _mm_xor_pd(_mm_shuffle_pd(a, a, 1), _mm_set_pd(-0.0, 0.0));
+}
+
+void fft(std::complex<double> *data, int n) {
+   if (n < 2) {
+      return;
+   }
+
+   // Bit-reversal permutation, so the passes can be done in place
+   for (int i = 1, j = 0; i < n; i++) {
+      int bit = n >> 1;
+      for (; j & bit; bit >>= 1) {
+         j ^= bit;
+      }
+
+      j |= bit;
+      if (i < j) {
+         std::swap(data[i], data[j]);
+      }
+   }
+
+   std::vector<std::complex<double>> twiddles(n);
+   for (int k = 0; k < n; k++) {
+      twiddles[k] = std::polar(1.0, -2 * M_PI * k / n);
+   }
+
+   // std::complex<double> is laid out as (re, im), which is exactly one register.
+   double *d = reinterpret_cast<double *>(data);
+   const double *tw = reinterpret_cast<const double *>(twiddles.data());
+
+   int m = 1;
+   if (__builtin_ctz(n) % 2 == 1) {
+      for (int i = 0; i < n; i += 2) {
+         __m128d a = _mm_loadu_pd(d + 2 * i),
+                 b = _mm_loadu_pd(d + 2 * i + 2);
+         _mm_storeu_pd(d + 2 * i, _mm_add_pd(a, b));
+         _mm_storeu_pd(d + 2 * i + 2, _mm_sub_pd(a, b));
+      }
+
+      m = 2;
+   }
+
+   // Each pass combines four transforms of size m into one of size 4m.
+   // After the bit reversal, the blocks hold the residues 0, 2, 1 and 3 mod 4, in that order.
+   for (; m < n; m *= 4) {
+      int stride = n / (4 * m);
+      for (int base = 0; base < n; base += 4 * m) {
+         for (int j = 0; j < m; j++) {
+            double *p0 = d + 2 * (base + j),
+                   *p2 = p0 + 2 * m,
+                   *p1 = p0 + 4 * m,
+                   *p3 = p0 + 6 * m;
+
+            __m128d w1 = _mm_loadu_pd(tw + 2 * (j * stride)),
+                    w2 = _mm_loadu_pd(tw + 2 * (2 * j * stride)),
+                    w3 = _mm_loadu_pd(tw + 2 * (3 * j * stride));
+
+            __m128d t0 = _mm_loadu_pd(p0),
+                    t1 = cmul(_mm_loadu_pd(p1), w1),
+                    t2 = cmul(_mm_loadu_pd(p2), w2),
+                    t3 = cmul(_mm_loadu_pd(p3), w3);
+
+            __m128d s02 = _mm_add_pd(t0, t2),
+                    d02 = _mm_sub_pd(t0, t2),
+                    s13 = _mm_add_pd(t1, t3),
+                    d13 = mul_neg_i(_mm_sub_pd(t1, t3));
+
+            _mm_storeu_pd(p0, _mm_add_pd(s02, s13));
+            _mm_storeu_pd(p2, _mm_add_pd(d02, d13));
+            _mm_storeu_pd(p1, _mm_sub_pd(s02, s13));
+            _mm_storeu_pd(p3, _mm_sub_pd(d02, d13));
+         }
+      }
+   }
+}
+
+std::vector<double> real_magnitudes(const double *x, int n) {
+   // The even samples are the real parts and the odd ones the imaginary parts of a transform half the size.
+   int half = n / 2;
+   std::vector<std::complex<double>> z(half);
+   for (int k = 0; k < half; k++) {
+      z[k] = { x[2 * k], x[2 * k + 1] };
+   }
+
+   fft(z.data(), half);
+
+   std::vector<double> mags(half + 1);
+   for (int k = 0; k <= half; k++) {
+      std::complex<double> zk = z[k % half],
+                           zc = std::conj(z[(half - k) % half]);
+
+      std::complex<double> even = (zk + zc) / 2.0,
+                           odd = (zk - zc) / std::complex<double>(0, 2);
+      mags[k] = std::abs(even + std::polar(1.0, -2 * M_PI * k / n) * odd);
+   }
+
+   return mags;
+}
+
+size_t Spectrum::peak() const {
+   size_t best = 1;
+   for (size_t k = 2; k < amps.size(); k++) {
+      if (amps[k] > amps[best]) {
+         best = k;
+      }
+   }
+
+   return best;
+}
+
+Spectrum spectrum(BatchFunc batch, double a, double b, int n) {
+   double h = (b - a) / n;
+   std::vector<double> xs(n), ys(n);
+   ThreadPool::shared().run((n + SPECTRUM_BLOCK - 1) / SPECTRUM_BLOCK, [&](int64_t k) {
+      int64_t lo = k * SPECTRUM_BLOCK,
+              hi = std::min<int64_t>(lo + SPECTRUM_BLOCK, n);
+      for (int64_t i = lo; i < hi; i++) {
+         xs[i] = a + i * h;
+      }
+
+      const double *args[1] = { &xs[lo] };
+      batch(args, &ys[lo], hi - lo);
+   });
+
+   // The Hann window sums to n / 2, and a sine's energy is split between two bins.
+   // Samples where the function is undefined are left out.
+   for (int i = 0; i < n; i++) {
+      double w = 0.5 - 0.5 * std::cos(2 * M_PI * i / n);
+      ys[i] = std::isfinite(ys[i]) ? w * ys[i] * 4 / n : 0;
+   }
+
+   Spectrum spec;
+   spec.amps = real_magnitudes(ys.data(), n);
+   spec.amps[0] /= 2;
+   spec.df = 1 / (b - a);
+   return spec;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include "compile.hpp"
+#include <complex>
+#include <vector>
+
+/* Default number of samples in a spectrum. Must be a power of two. */
+#define SPECTRUM_SIZE 4096
+
+/* Largest number of samples a spectrum may be taken from */
+#define SPECTRUM_MAX (1 << 20)
+
+/* Number of samples each pool task evaluates */
+#define SPECTRUM_BLOCK 1024
+
+/**
+ * Computes a discrete Fourier transform in place, with radix-4 passes
+ * and one radix-2 pass when the size is an odd power of two.
+ * Each butterfly works on whole complex numbers in SSE2 registers.
+ *
+ * @param data The data to transform
+ * @param n The number of values. Must be a power of two.
+ */
+void fft(std::complex<double> *data, int n);
+
+/**
+ * Computes the magnitudes of the Fourier transform of real data, using an FFT of half the size.
+ *
+ * @param x The data
+ * @param n The number of values. Must be a power of two, at least 2.
+ *
+ * @return |X_k| for k from 0 to n/2
+ */
+std::vector<double> real_magnitudes(const double *x, int n);
+
+/* The magnitude spectrum of a function sampled over an interval */
+struct Spectrum {
+   /* The amplitude of each frequency, from 0 up to the Nyquist frequency */
+   std::vector<double> amps;
+
+   /* The frequency step between bins, in cycles per unit of x */
+   double df;
+
+   /**
+    * Gets the index of the largest bin, other than the constant term.
+    */
+   size_t peak() const;
+};
+
+/**
+ * Samples a function evenly on [a, b), applies a Hann window and takes the magnitude spectrum.
+ * The samples are computed with the batch kernel across the thread pool.
+ * Amplitudes are scaled so that a sine wave of amplitude A centered on a bin shows as A.
+ *
+ * @param batch The batch kernel of the function
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param n The number of samples. Must be a power of two, at least 2.
+ *
+ * @return The spectrum
+ */
+Spectrum spectrum(BatchFunc batch, double a, double b, int n = SPECTRUM_SIZE);
+
+#endif
@@ -18,7 +18,10 @@
 
 #include "grapher.hpp"
 #include "asymptotes.hpp"
+#include "quadrature.hpp"
+#include "roots.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 bool Grapher::mc_is_paused() {
@@ -26,17 +29,31 @@ bool Grapher::mc_is_paused() {
 }
 
 /**
- * Callback to add a sample to Monte Carlo graph
+ * Callback to draw the newest samples onto the Monte Carlo graph
  */
 gboolean mc_sample(gpointer data) {
    Grapher *grapher = (Grapher *)data;
    if (!grapher->mc_is_paused()) {
-      grapher->mc_add_samples(20000);
+      grapher->mc_draw_new_samples();
    }
 
    return G_SOURCE_CONTINUE;
 }
 
+/**
+ * Callback to follow a Riemann sum being computed in the background
+ */
+gboolean rs_poll(gpointer data) {
+   return ((Grapher *)data)->rs_update();
+}
+
+/**
+ * Idle callback to refine the curve, which is drawn again after each step
+ */
+gboolean curve_fill(gpointer data) {
+   return ((Grapher *)data)->curve_update();
+}
+
 /**
  * "draw" callback for the graphing area.
  * Just calls the Grapher class's internal method,
@@ -65,6 +82,62 @@ void mc_switch(GtkWidget *widget, gpointer data) {
    }
 }
 
+/**
+ * Draws the steps of a curve traced in graph coordinates onto the window.
+ */
+static void draw_curve(cairo_t *cr,
+                       const std::vector<CurveOp> &ops,
+                       double xmin, double xmax, double width,
+                       double ymin, double ymax, double height)
+{
+   bool offscreen = false;
+   for (const CurveOp &op: ops) {
+      Point P = Point{ op.x, op.y }.scale(xmin, xmax, width,
+                                          ymin, ymax, height);
+      if (std::isinf(op.y)) {
+         P.y = op.y > 0? 0: height;
+      }
+
+      switch (op.kind) {
+      case CURVE_MOVE:
+         cairo_move_to(cr, P.x, P.y);
+         break;
+      case CURVE_LINE:
+         cairo_line_to(cr, P.x, P.y);
+         break;
+      case CURVE_STROKE:
+         cairo_stroke(cr);
+         break;
+      case CURVE_EDGE:
+         if (!offscreen) {
+            cairo_line_to(cr, P.x, P.y);
+            cairo_stroke(cr);
+            offscreen = true;
+         } else {
+            cairo_move_to(cr, P.x, P.y);
+         }
+
+         break;
+      case CURVE_POINT:
+         if (P.y < 0 || P.y > height) {
+            if (!offscreen) {
+               cairo_line_to(cr, P.x, P.y);
+               offscreen = true;
+            } else {
+               cairo_move_to(cr, P.x, P.y);
+            }
+         } else {
+            cairo_line_to(cr, P.x, P.y);
+            offscreen = false;
+         }
+
+         break;
+      }
+   }
+
+   cairo_stroke(cr);
+}
+
 gboolean Grapher::draw_graph(cairo_t *cr) {
    static const GdkRGBA BLACK = {0.0, 0.0, 0.0, 1.0},
                         FOG = {0.3, 0.3, 0.3, 1.0},
@@ -74,8 +147,13 @@ gboolean Grapher::draw_graph(cairo_t *cr) {
                             20.0 / 255, 1.0},
                         WHITE = {1.0, 1.0, 1.0, 1.0},
                         RED = {1.0, 0.0, 0.0, 1.0},
+                        YELLOW = {1.0, 1.0, 0.0, 1.0},
+                        CYAN = {0.0, 1.0, 1.0, 1.0},
+                        ORANGE = {1.0, 0.6, 0.0, 1.0},
+                        MAGENTA = {1.0, 0.0, 1.0, 1.0},
                         RED_HALF = {1.0, 0.0, 0.0, 0.5},
-                        BLUE_HALF = {0.0, 0.0, 1.0, 0.5};
+                        BLUE_HALF = {0.0, 0.0, 1.0, 0.5},
+                        CYAN_HALF = {0.0, 1.0, 1.0, 0.5};
 
    GtkStyleContext *ctx = gtk_widget_get_style_context(graphing_area);
    guint width = gtk_widget_get_allocated_width(graphing_area),
@@ -143,56 +221,37 @@ gboolean Grapher::draw_graph(cairo_t *cr) {
 
 
    if (fn != nullptr) {
-      if (mode == RSUM) {
-         double sum = 0;
-         int last_x_line = (int) std::floor(width * (rs_lower - rs_step - xmin) / xrange);
-         int step_width = (int) std::ceil(width * rs_step / xrange);
-         for (double x = rs_lower;
-              x < rs_upper;
-              x += rs_step) {
-            double y = fn(x + rs_step / 2.0);
-            // NaNs are skipped in both the calculation of the sum and the drawing.
-            if (!std::isnan(y)) {
-               sum += rs_step * y;
+      if (mode == RSUM && !rs.running()) {
+         // The sum itself was computed when it was requested. Only its rectangles are drawn here.
+         for (const SumRect &rect: rs.get_rects()) {
+            if (std::isnan(rect.left) || std::isnan(rect.right)) {
+               continue;
             }
 
-            // Drawing a rectangle for every point gets too expensive at low step sizes.
-            // This makes sure only 1 rectangle is drawn per pixel wide.
-            int x_lo_line = (int) std::floor(width * (x - xmin) / xrange);
-            if (x_lo_line - last_x_line >= step_width) {
-               if (!std::isnan(y)) {
-                  double y_line = height * (1 - (y - ymin) / yrange);
-                  if (y_line < 0) {
-                     y_line = 0;
-                  } else if (y_line > height) {
-                     y_line = height;
-                  }
-
-                  if (y < 0) {
-                     gdk_cairo_set_source_rgba(cr, &BLUE_HALF);
-                     cairo_rectangle(cr,
-                                     last_x_line + step_width,
-                                     y_zero_line,
-                                     x_lo_line - last_x_line,
-                                     y_line - y_zero_line);
-                  } else {
-                     gdk_cairo_set_source_rgba(cr, &RED_HALF);
-                     cairo_rectangle(cr,
-                                     last_x_line + step_width,
-                                     y_line,
-                                     x_lo_line - last_x_line,
-                                     y_zero_line - y_line);
-                  }
-
-                  cairo_fill(cr);
-               }
+            double x_lo_line = width * (rect.x - xmin) / xrange,
+                   x_hi_line = width * (rect.x + rect.width - xmin) / xrange;
+            if (x_hi_line < 0 || x_lo_line > width) {
+               continue;
+            }
+
+            double y_left_line = height * (1 - (rect.left - ymin) / yrange),
+                   y_right_line = height * (1 - (rect.right - ymin) / yrange);
+            y_left_line = std::min(std::max(y_left_line, 0.0), (double) height);
+            y_right_line = std::min(std::max(y_right_line, 0.0), (double) height);
 
-               last_x_line = x_lo_line;
+            if (rect.left + rect.right < 0) {
+               gdk_cairo_set_source_rgba(cr, &BLUE_HALF);
+            } else {
+               gdk_cairo_set_source_rgba(cr, &RED_HALF);
             }
+
+            cairo_move_to(cr, x_lo_line, y_zero_line);
+            cairo_line_to(cr, x_lo_line, y_left_line);
+            cairo_line_to(cr, x_hi_line, y_right_line);
+            cairo_line_to(cr, x_hi_line, y_zero_line);
+            cairo_close_path(cr);
+            cairo_fill(cr);
          }
-            
-         std::string res = std::to_string(sum);
-         gtk_label_set_text(GTK_LABEL(rs_res_area), res.c_str());
       } else if (mode == MCARLO) {
          if (!mc_initialized) {
             int graph_width = gtk_widget_get_allocated_width(graphing_area),
@@ -207,29 +266,20 @@ gboolean Grapher::draw_graph(cairo_t *cr) {
          }
          
          if (!mc_calling_back) {
-            mc_points = 0;
-            mc_sum = 0;
-
-            // the Monte Carlo drawing layer must be cleared
-            int channels = gdk_pixbuf_get_n_channels(mc_pixbuf),
-                width = gdk_pixbuf_get_width(mc_pixbuf),
-                height = gdk_pixbuf_get_height(mc_pixbuf),
-                rowstride = gdk_pixbuf_get_rowstride(mc_pixbuf);
-
-            guchar *pixels = gdk_pixbuf_get_pixels(mc_pixbuf);
-            for (int i = 0; i < width; i++) {
-               for (int j = 0; j < height; j++) {
-                  uint32_t *p = (uint32_t *)(pixels + j * rowstride + i * channels);
-                  
-                  *p = 0;
-               }
-            }
+            mc_seed = (uint64_t) g_get_real_time();
+
+            // The samplers count every sample in the window's pixels, starting from a clear map.
+            mc.set_view(gdk_pixbuf_get_width(mc_pixbuf), gdk_pixbuf_get_height(mc_pixbuf),
+                        xmin, xmax, ymin, ymax);
+            mc.reset({ mc_xmin, mc_xmax, mc_ymin, mc_ymax, mc_seed,
+                       mc_stratify, mc_importance, mc_tol });
 
             mc_sample_tag = g_timeout_add(100,
                                           G_SOURCE_FUNC(mc_sample),
                                           this);
             mc_calling_back = true;
             mc_paused = false;
+            mc.start();
             gtk_button_set_label(GTK_BUTTON(mc_button), "Stop");
             g_signal_handler_disconnect(G_OBJECT(mc_button),
                                         mc_button_handler_id);
@@ -238,148 +288,183 @@ gboolean Grapher::draw_graph(cairo_t *cr) {
                                 G_CALLBACK(mc_switch), this);
          }
 
+         mc.tone_map(gdk_pixbuf_get_pixels(mc_pixbuf),
+                     gdk_pixbuf_get_rowstride(mc_pixbuf));
          gdk_cairo_set_source_pixbuf(cr, mc_pixbuf, 0, 0);
          cairo_rectangle(cr, 0, 0, width, height);
          cairo_fill(cr);
 
-         std::string res = std::to_string(mc_area);
+         std::string res = std::to_string(mc.area());
          gtk_label_set_text(GTK_LABEL(mc_res_area), res.c_str());
 
-         res = std::to_string((int) mc_points);
+         char err[80] = "";
+         if (!std::isnan(mc.error())) {
+            double area = mc.area(),
+                   half = mc.half_width();
+            snprintf(err, sizeof(err), "± %.3g (95%%: %.6f to %.6f)%s",
+                     mc.error(), area - half, area + half,
+                     mc.converged() ? ", done" : "");
+         }
+
+         gtk_label_set_text(GTK_LABEL(mc_err_area), err);
+
+         res = std::to_string(mc.samples());
          gtk_label_set_text(GTK_LABEL(mc_n_area), res.c_str());
+      } else if (mode == IMPLICIT) {
+         if (im_heatmap && im_pixbuf != nullptr) {
+            gdk_cairo_set_source_pixbuf(cr, im_pixbuf, 0, 0);
+            cairo_rectangle(cr, 0, 0, width, height);
+            cairo_fill(cr);
+         }
+
+         // Segments are in pixels of the window the plot was computed for
+         gdk_cairo_set_source_rgba(cr, &WHITE);
+         cairo_set_line_width(cr, 2);
+         for (const ContourSegment &seg: im_plot.get_segments()) {
+            cairo_move_to(cr, seg.x0, seg.y0);
+            cairo_line_to(cr, seg.x1, seg.y1);
+         }
+
+         cairo_stroke(cr);
+         cairo_set_line_width(cr, 1);
+      } else if (mode == DOMAIN && dc_pixbuf != nullptr) {
+         gdk_cairo_set_source_pixbuf(cr, dc_pixbuf, 0, 0);
+         cairo_rectangle(cr, 0, 0, width, height);
+         cairo_fill(cr);
+      }
+
+      // Drawing the same view again evaluates nothing. Columns the curve doesn't cover yet
+      //  get a coarse pass right away, unless the old curve can stand in for them,
+      //  and the rest is refined in idle time.
+      curve.set_view(xmin, xmax, width);
+      if (!curve.covered() && !curve.has_preview()) {
+         curve.cover();
+      }
+
+      if (!curve.complete() && !curve_pending) {
+         g_idle_add(G_SOURCE_FUNC(curve_fill), this);
+         curve_pending = true;
       }
 
       gdk_cairo_set_source_rgba(cr, &GREEN);
-      bool offscreen = false;
-      Point B = Point::of(fn, xmin);
-      Point A;
-      for (guint i = 0; i < width; i++) {
-         // x := x(i) + 1px delta
-         double x = ((double)(i + 1) / width) * xrange + xmin;
-         
-         A = B;
-         B = Point::of(fn, x);
+      draw_curve(cr, curve.get_ops(), xmin, xmax, width, ymin, ymax, height);
 
-         if (std::isnan(A.y) || std::isnan(B.y)) {
-            cairo_stroke(cr);
-            continue;
-         }
+      gdk_cairo_set_source_rgba(cr, &YELLOW);
+      cairo_set_line_width(cr, 2);
+      for (double r: roots) {
+         cairo_arc(cr, width * (r - xmin) / xrange, y_zero_line, 4, 0, 2 * G_PI);
+         cairo_stroke(cr);
+      }
 
-         Point mid = midpoint(A, B);
-         if (std::isinf(mid.y)) {
-            if (!offscreen) {
-               if (mid.y > 0) {
-                  cairo_line_to(cr, width * (x - xmin) / xrange, 0);
-               } else {
-                  cairo_line_to(cr, width * (x - xmin) / xrange, height);
-               }
+      gdk_cairo_set_source_rgba(cr, &CYAN);
+      for (const Extremum &ext: extrema) {
+         Point P = Point{ ext.x, ext.y }.scale(xmin, xmax, width,
+                                              ymin, ymax, height);
+         cairo_arc(cr, P.x, P.y, 4, 0, 2 * G_PI);
+         cairo_stroke(cr);
+
+         // Maxima are labelled above the curve, and minima below it.
+         char label[64];
+         snprintf(label, sizeof(label), "(%.3g, %.3g)", ext.x, ext.y);
+         cairo_move_to(cr, P.x + 6, ext.maximum ? P.y - 6 : P.y + 14);
+         cairo_show_text(cr, label);
+      }
 
-               cairo_stroke(cr);
-               offscreen = true;
-            } else if (mid.y > 0) {
-               cairo_move_to(cr, width * (x - xmin) / xrange, 0);
+      if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(antideriv_check))
+          && cumul.covers(xmin, xmax)) {
+         // The antiderivative which is 0 at x = 0, or at the left edge if 0 isn't in the table.
+         // The curve is broken wherever it crosses a pole.
+         double anchor = cumul.lower() <= 0 && 0 <= cumul.upper() ? 0 : cumul.lower(),
+                base = cumul.at(anchor),
+                last_x = NAN;
+
+         gdk_cairo_set_source_rgba(cr, &MAGENTA);
+         cairo_set_line_width(cr, 2);
+         for (guint i = 0; i <= width; i++) {
+            double x = std::min(xmin + xrange * i / width, cumul.upper()),
+                   y = cumul.at(x) - base;
+            double j = height * (1 - (y - ymin) / yrange);
+
+            if (std::isnan(y) || std::fabs(j) > 1e6) {
+               last_x = NAN;
+            } else if (std::isnan(last_x) || !cumul.continuous(last_x, x)) {
+               cairo_move_to(cr, i, j);
+               last_x = x;
             } else {
-               cairo_move_to(cr, width * (x - xmin) / xrange, height);
+               cairo_line_to(cr, i, j);
+               last_x = x;
             }
+         }
 
-            continue;
+         cairo_stroke(cr);
+      }
+
+      if (mode == SPECTRUM && sp.amps.size() > 1) {
+         // The spectrum gets its own axes: frequency from 0 to Nyquist across the width,
+         //  and amplitude up from the bottom, scaled to the largest bin.
+         double top = 0;
+         for (double amp: sp.amps) {
+            top = std::max(top, amp);
          }
 
-         Point pos_inf = goes_pos_inf(fn, A, B, xrange);
-         Point neg_inf = { 0, 0 };
-         if (pos_inf.y != 0) {
-            // Check if it goes to infinity from the left or the right.
-            // Assumes a continuous ascent from whichever side
-            double lhs_mid = fn((A.x + pos_inf.x) / 2.0);
-            if (lhs_mid > A.y) {
-               // We assume it comes from the left
-               cairo_line_to(cr, width * (pos_inf.x - xmin) / xrange, 0);
-
-               // What's on the other side?
-               neg_inf = goes_neg_inf(fn, pos_inf, B, xrange);
-               if (neg_inf.y != 0) {
-                  cairo_stroke(cr);
-                  cairo_move_to(cr, width * (neg_inf.x - xmin) / xrange, height);
-               } else {
-                  pos_inf = goes_pos_inf(fn, pos_inf, B, xrange);
-                  if (pos_inf.y == 0) {
-                     // It doesn't go to infinity and come back.
-                     // There's some other kind of jump. 
-                     cairo_stroke(cr);
-                  }
-               }
-            } else {
-               // We assume it comes from the right.
-               // But then what happens on the left side?
-               neg_inf = goes_neg_inf(fn, A, pos_inf, xrange);
-               if (neg_inf.y != 0) {
-                  cairo_line_to(cr, width * (neg_inf.x - xmin) / xrange, height);
-                  cairo_stroke(cr);
-               } else {
-                  Point lhs_pos_inf = goes_pos_inf(fn, A, pos_inf, xrange);
-                  if (lhs_pos_inf.y == 0) {
-                     cairo_stroke(cr);
-                  }
+         if (top > 0) {
+            gdk_cairo_set_source_rgba(cr, &CYAN_HALF);
+            size_t bins = sp.amps.size() - 1;
+            cairo_move_to(cr, 0, height);
+            for (guint i = 0; i <= width; i++) {
+               // Each column shows the largest bin that falls in it.
+               size_t lo = bins * i / (width + 1),
+                      hi = std::max(lo + 1, bins * (i + 1) / (width + 1));
+               double amp = 0;
+               for (size_t k = lo; k < hi && k <= bins; k++) {
+                  amp = std::max(amp, sp.amps[k]);
                }
 
-               cairo_move_to(cr, width * (pos_inf.x - xmin) / xrange, 0);
-            }
-         } else {
-            // The mirror image of the above.
-            neg_inf = goes_neg_inf(fn, A, B, xrange);
-            if (neg_inf.y != 0) {
-               double lhs_mid = fn((A.x + neg_inf.x) / 2.0);
-               if (lhs_mid < A.y) {
-                  cairo_line_to(cr, width * (neg_inf.x - xmin) / xrange, height);
-
-                  pos_inf = goes_pos_inf(fn, neg_inf, B, xrange);
-                  if (pos_inf.y != 0) {
-                     cairo_stroke(cr);
-                     cairo_move_to(cr, width * (pos_inf.x - xmin) / xrange, 0);
-                  } else {
-                     neg_inf = goes_neg_inf(fn, neg_inf, B, xrange);
-                     if (neg_inf.y == 0) {
-                        cairo_stroke(cr);
-                     }
-                  }
-               } else {
-                  pos_inf = goes_pos_inf(fn, neg_inf, A, xrange);
-                  if (pos_inf.y != 0) {
-                     cairo_line_to(cr, width * (pos_inf.x - xmin) / xrange, 0);
-                     cairo_stroke(cr);
-                  } else {
-                     Point lhs_neg_inf = goes_neg_inf(fn, neg_inf, A, xrange);
-                     if (lhs_neg_inf.y == 0) {
-                        cairo_stroke(cr);
-                     }
-                  }
-
-                  cairo_move_to(cr, width * (neg_inf.x - xmin) / xrange, 0);
-               }
+               cairo_line_to(cr, i, height * (1 - 0.9 * amp / top));
             }
+
+            cairo_line_to(cr, width, height);
+            cairo_close_path(cr);
+            cairo_fill(cr);
+
+            char label[64];
+            snprintf(label, sizeof(label), "0 to %.4g cycles per unit", sp.df * bins);
+            gdk_cairo_set_source_rgba(cr, &CYAN);
+            cairo_move_to(cr, 6, 14);
+            cairo_show_text(cr, label);
          }
+      }
 
-         if (pos_inf.y == 0 && neg_inf.y == 0) {
-            // No discontinuity. We draw the line through the midpoint.
-            Point next = midpoint(A, B).scale(xmin, xmax, width,
-                                              ymin, ymax, height);
-            
-            if (next.y < 0 || next.y > height) {
-               if (!offscreen) {
-                  cairo_line_to(cr, next.x, next.y);
-                  offscreen = true;
+      if (mode == ODE) {
+         // Each solution is drawn through every column it reached.
+         gdk_cairo_set_source_rgba(cr, &ORANGE);
+         cairo_set_line_width(cr, 2);
+         for (size_t k = 0; k < ode_fwd.size(); k++) {
+            bool drawing = false;
+            for (guint i = 0; i <= width; i++) {
+               double x = xmin + xrange * i / width,
+                      y = x >= ode_x0 ? ode_fwd[k].at(x) : ode_back[k].at(x);
+               double j = height * (1 - (y - ymin) / yrange);
+
+               if (std::isnan(y) || std::fabs(j) > 1e6) {
+                  drawing = false;
+               } else if (!drawing) {
+                  cairo_move_to(cr, i, j);
+                  drawing = true;
                } else {
-                  cairo_move_to(cr, next.x, next.y);
+                  cairo_line_to(cr, i, j);
                }
-            } else {
-               cairo_line_to(cr, next.x, next.y);
-               offscreen = false;
             }
+
+            cairo_stroke(cr);
+
+            double y0 = ode_y0 + k * ode_dy;
+            cairo_arc(cr, width * (ode_x0 - xmin) / xrange,
+                      height * (1 - (y0 - ymin) / yrange), 4, 0, 2 * G_PI);
+            cairo_fill(cr);
          }
       }
 
-      cairo_stroke(cr);
-
       if (mode == TRACE) {
          int i = (int)(width * (tr_xval - xmin) / xrange);
          double y = fn(tr_xval);
@@ -428,6 +513,51 @@ bool get_double_from_gtk_entry(GtkWidget *entry,
    return !failed;
 }
 
+/**
+ * Parses an expression in x and y from a GtkEntry widget,
+ * as the definition of a function of the two
+ * Fills in an error field if it failed
+ *
+ * @param entry The widget to take input from
+ * @param err_label Where to write the error message to
+ * @param arity_msg The message to write if it depends on anything else
+ *
+ * @return The expression, or nullptr if there was an error
+ */
+Expr *get_xy_expr_from_gtk_entry(GtkWidget *entry,
+                                 GtkWidget *err_label,
+                                 const char *arity_msg) {
+   const char *body = gtk_entry_get_text(GTK_ENTRY(entry));
+   std::string def = std::string("Fxy(x, y) = ") + body + "\n";
+
+   Expr *expr = nullptr;
+   char *funcname = nullptr,
+        *varname = nullptr;
+
+   char *err = nullptr;
+   int arity = 1;
+   Query query = NO_QUERY;
+
+   yy_scan_string(def.c_str());
+   yyparse(&expr, &funcname, &varname, &arity, &err, &query);
+   yylex_destroy();
+   free(funcname);
+
+   if (err != nullptr) {
+      gtk_label_set_text(GTK_LABEL(err_label), err);
+      free(err);
+      return nullptr;
+   }
+
+   if (arity != 2) {
+      gtk_label_set_text(GTK_LABEL(err_label), arity_msg);
+      destroy_expr(expr);
+      return nullptr;
+   }
+
+   return expr;
+}
+
 bool Grapher::load_xval() {
    return get_double_from_gtk_entry(
             tr_xval_entry,
@@ -437,6 +567,8 @@ bool Grapher::load_xval() {
 }
 
 bool Grapher::load_rs_vars() {
+   double levels;
+
    // Takes advantage of short-circuiting
    bool success =
          get_double_from_gtk_entry(
@@ -453,8 +585,16 @@ bool Grapher::load_rs_vars() {
             rs_step_entry,
             &rs_step,
             err_area,
-            "Error: could not parse integration step size.");
-   
+            "Error: could not parse integration step size.")
+      && get_double_from_gtk_entry(
+            rs_levels_entry,
+            &levels,
+            err_area,
+            "Error: could not parse number of levels.");
+
+   rs_dd = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(rs_dd_check));
+   rs_rule = (SumRule) gtk_combo_box_get_active(GTK_COMBO_BOX(rs_rule_combo));
+
    if (success) {
       if (rs_upper < rs_lower) {
          gtk_label_set_text(GTK_LABEL(err_area),
@@ -464,12 +604,109 @@ bool Grapher::load_rs_vars() {
          gtk_label_set_text(GTK_LABEL(err_area),
                             "Error: step size too small.");
          success = false;
+      } else if (levels < 1 || levels > MAX_SUM_LEVELS) {
+         gtk_label_set_text(GTK_LABEL(err_area),
+                            "Error: number of levels out of range.");
+         success = false;
       }
    }
 
+   rs_levels = success? (int)levels: 1;
+
    return success;
 }
 
+bool Grapher::load_ode_vars() {
+   double n;
+   bool success =
+         get_double_from_gtk_entry(
+            ode_x0_entry,
+            &ode_x0,
+            err_area,
+            "Error: could not parse initial x.")
+      && get_double_from_gtk_entry(
+            ode_y0_entry,
+            &ode_y0,
+            err_area,
+            "Error: could not parse initial y.")
+      && get_double_from_gtk_entry(
+            ode_n_entry,
+            &n,
+            err_area,
+            "Error: could not parse number of curves.")
+      && get_double_from_gtk_entry(
+            ode_dy_entry,
+            &ode_dy,
+            err_area,
+            "Error: could not parse spacing of curves.");
+
+   if (!success) {
+      return false;
+   }
+
+   if (n < 1 || n > ODE_MAX_CURVES) {
+      gtk_label_set_text(GTK_LABEL(err_area), "Error: number of curves out of range.");
+      return false;
+   }
+
+   ode_n = (int)n;
+
+   Expr *expr = get_xy_expr_from_gtk_entry(
+                   ode_rhs_entry,
+                   err_area,
+                   "Error: y' can only depend on x and y.");
+   if (expr == nullptr) {
+      return false;
+   }
+
+   if (ode_rhs != nullptr) {
+      destroy_expr(ode_rhs);
+   }
+
+   ode_rhs = expr;
+   return true;
+}
+
+bool Grapher::load_sp_vars() {
+   double n;
+   if (!get_double_from_gtk_entry(
+            sp_n_entry,
+            &n,
+            err_area,
+            "Error: could not parse number of points.")) {
+      return false;
+   }
+
+   // The FFT only takes powers of two.
+   if (n < 4 || n > SPECTRUM_MAX || n != std::exp2(std::round(std::log2(n)))) {
+      gtk_label_set_text(GTK_LABEL(err_area),
+                         "Error: number of points must be a power of two, 4 to 2^20.");
+      return false;
+   }
+
+   sp_n = (int)n;
+   return true;
+}
+
+bool Grapher::load_im_vars() {
+   im_heatmap = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(im_heat_check));
+
+   Expr *expr = get_xy_expr_from_gtk_entry(
+                   im_expr_entry,
+                   err_area,
+                   "Error: the expression can only depend on x and y.");
+   if (expr == nullptr) {
+      return false;
+   }
+
+   if (im_expr != nullptr) {
+      destroy_expr(im_expr);
+   }
+
+   im_expr = expr;
+   return true;
+}
+
 bool Grapher::load_mc_vars() {
    bool success =
          get_double_from_gtk_entry(
@@ -493,6 +730,20 @@ bool Grapher::load_mc_vars() {
             err_area,
             "Error: could not parse top bound for approx. area.");
 
+   mc_qmc = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mc_qmc_check));
+   mc_stratify = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mc_strat_check));
+   mc_importance = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mc_imp_check));
+
+   // An empty tolerance means sampling until stopped
+   mc_tol = 0;
+   if (success && gtk_entry_get_text_length(GTK_ENTRY(mc_tol_entry)) > 0) {
+      success = get_double_from_gtk_entry(
+            mc_tol_entry,
+            &mc_tol,
+            err_area,
+            "Error: could not parse tolerance for approx. area.");
+   }
+
    if (success) {
       if (mc_xmax < mc_xmin) {
          gtk_label_set_text(GTK_LABEL(err_area),
@@ -519,7 +770,264 @@ void activate(GtkApplication *app, gpointer data) {
 }
 
 void Grapher::apply_expr(const Expr *expr) {
-   fn = conv_expr(expr, rt, ectx);
+   // The old functions stay in place if the new ones can't be compiled.
+   Func new_fn = conv_expr(expr, rt, ectx),
+        new_dfn;
+   BatchFunc new_batch;
+   try {
+      new_dfn = conv_expr_deriv(expr, rt, ectx);
+   } catch (ReportingException *e) {
+      rt.release(new_fn);
+      throw;
+   }
+
+   try {
+      new_batch = conv_expr_batch(expr, 1, rt, ectx);
+   } catch (ReportingException *e) {
+      rt.release(new_fn);
+      if (new_dfn != nullptr) {
+         rt.release(new_dfn);
+      }
+
+      throw;
+   }
+
+   if (fn != nullptr) {
+      rt.release(fn);
+   }
+
+   if (dfn != nullptr) {
+      rt.release(dfn);
+   }
+
+   if (fn_batch != nullptr) {
+      rt.release(fn_batch);
+   }
+
+   fn = new_fn;
+   dfn = new_dfn;
+   fn_batch = new_batch;
+   cumul.set_expr(expr, rt, ectx);
+   curve.set_expr(expr, rt, ectx);
+
+   Expr *inlined = inline_expr(expr, ectx);
+   fn_is_poly = as_polynomial(inlined, ectx, fn_poly);
+   destroy_expr(inlined);
+
+   if (auto_y) {
+      // The y bounds are filled in before anything is drawn with them.
+      YRange range = auto_yrange(fn_batch, fn, xmin, xmax);
+
+      if (range.found) {
+         ymin = range.ymin;
+         ymax = range.ymax;
+
+         char bound[32];
+         snprintf(bound, sizeof(bound), "%.4g", ymin);
+         gtk_entry_set_text(GTK_ENTRY(ymin_entry), bound);
+         snprintf(bound, sizeof(bound), "%.4g", ymax);
+         gtk_entry_set_text(GTK_ENTRY(ymax_entry), bound);
+      }
+   }
+
+   if (mode == RSUM) {
+      // Only recomputed if the expression or the settings changed
+      rs.set_expr(expr, rt, ectx);
+      rs.set_settings({ rs_lower, rs_upper, rs_step, rs_rule, rs_dd, rs_levels });
+      rs.compute_async();
+      if (!fn_is_poly) {
+         cumul.cover(xmin, xmax);
+      }
+
+      rs_update_exact();
+
+      // The result is shown by the poll once the sum is done
+      if (!rs.running()) {
+         rs_update();
+      } else if (!rs_polling) {
+         g_timeout_add(50, G_SOURCE_FUNC(rs_poll), this);
+         rs_polling = true;
+      }
+   } else if (mode == MCARLO) {
+      mc.set_expr(expr, mc_qmc ? SOBOL : RANDOM, rt, ectx);
+
+      // The estimate counts the area between the axis and the curve inside the box,
+      //  which for a polynomial is the integral of the curve clamped to the box above and below the axis.
+      if (fn_is_poly) {
+         double width = mc_xmax - mc_xmin,
+                pos_lo = std::max(mc_ymin, 0.0),
+                pos_hi = std::max(mc_ymax, 0.0),
+                neg_lo = std::min(mc_ymin, 0.0),
+                neg_hi = std::min(mc_ymax, 0.0);
+         double exact = fn_poly.clamped_integral(mc_xmin, mc_xmax, pos_lo, pos_hi) - pos_lo * width
+                      + fn_poly.clamped_integral(mc_xmin, mc_xmax, neg_lo, neg_hi) - neg_hi * width;
+
+         char res[48];
+         snprintf(res, sizeof(res), "Exact: %.12g", exact);
+         gtk_label_set_text(GTK_LABEL(mc_exact_area), res);
+      } else {
+         gtk_label_set_text(GTK_LABEL(mc_exact_area), "");
+      }
+   } else if (mode == ODE) {
+      StepFunc step = conv_ode_step(ode_rhs, rt, ectx);
+
+      std::vector<double> y0s;
+      for (int k = 0; k < ode_n; k++) {
+         y0s.push_back(ode_y0 + k * ode_dy);
+      }
+
+      ode_fwd = solve_ode_many(step, ode_x0, y0s, std::max(xmax, ode_x0));
+      ode_back = solve_ode_many(step, ode_x0, y0s, std::min(xmin, ode_x0));
+      rt.release(step);
+
+      size_t steps = 0;
+      int incomplete = 0;
+      for (int k = 0; k < ode_n; k++) {
+         steps += ode_fwd[k].n_steps() + ode_back[k].n_steps();
+         incomplete += !ode_fwd[k].complete + !ode_back[k].complete;
+      }
+
+      std::string res = std::to_string(steps) + " steps";
+      if (incomplete > 0) {
+         res += ", " + std::to_string(incomplete) + " stopped early";
+      }
+
+      gtk_label_set_text(GTK_LABEL(ode_res_area), res.c_str());
+   } else if (mode == SPECTRUM) {
+      BatchFunc batch = conv_expr_batch(expr, 1, rt, ectx);
+      sp = spectrum(batch, xmin, xmax, sp_n);
+      rt.release(batch);
+
+      size_t peak = sp.peak();
+      char res[96];
+      snprintf(res, sizeof(res), "Peak: %.6g per unit (amplitude %.4g)",
+               peak * sp.df, sp.amps[peak]);
+      gtk_label_set_text(GTK_LABEL(sp_res_area), res);
+   } else if (mode == IMPLICIT) {
+      int graph_width = gtk_widget_get_allocated_width(graphing_area),
+          graph_height = gtk_widget_get_allocated_height(graphing_area);
+
+      BatchFunc batch = conv_expr_batch(im_expr, 2, rt, ectx);
+      Expr *inlined = inline_expr(im_expr, ectx);
+      im_plot.compute(batch, inlined, ectx.varTable, xmin, xmax, ymin, ymax,
+                      graph_width, graph_height, im_heatmap);
+      destroy_expr(inlined);
+      rt.release(batch);
+
+      if (im_heatmap) {
+         if (im_pixbuf == nullptr
+             || gdk_pixbuf_get_width(im_pixbuf) != graph_width
+             || gdk_pixbuf_get_height(im_pixbuf) != graph_height) {
+            if (im_pixbuf != nullptr) {
+               g_object_unref(im_pixbuf);
+            }
+
+            im_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB,
+                                       true,
+                                       8,
+                                       graph_width,
+                                       graph_height);
+         }
+
+         im_plot.tone_map(gdk_pixbuf_get_pixels(im_pixbuf),
+                          gdk_pixbuf_get_rowstride(im_pixbuf));
+      }
+
+      std::string res = std::to_string(im_plot.pruned()) + " of "
+                      + std::to_string(im_plot.tiles()) + " tiles skipped";
+      gtk_label_set_text(GTK_LABEL(im_res_area), res.c_str());
+   } else if (mode == DOMAIN) {
+      int graph_width = gtk_widget_get_allocated_width(graphing_area),
+          graph_height = gtk_widget_get_allocated_height(graphing_area);
+
+      CxBatchFunc cx_fn = conv_expr_cx(expr, rt, ectx);
+      dc.compute(cx_fn, xmin, xmax, ymin, ymax, graph_width, graph_height);
+      rt.release(cx_fn);
+
+      if (dc_pixbuf == nullptr
+          || gdk_pixbuf_get_width(dc_pixbuf) != graph_width
+          || gdk_pixbuf_get_height(dc_pixbuf) != graph_height) {
+         if (dc_pixbuf != nullptr) {
+            g_object_unref(dc_pixbuf);
+         }
+
+         dc_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB,
+                                    true,
+                                    8,
+                                    graph_width,
+                                    graph_height);
+      }
+
+      dc.tone_map(gdk_pixbuf_get_pixels(dc_pixbuf),
+                  gdk_pixbuf_get_rowstride(dc_pixbuf));
+
+      std::string res = std::to_string(dc.undefined()) + " of "
+                      + std::to_string(graph_width * graph_height) + " points undefined";
+      gtk_label_set_text(GTK_LABEL(dc_res_area), res.c_str());
+   }
+
+   load_marks();
+}
+
+void Grapher::load_marks() {
+   if (fn != nullptr && gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(roots_check))) {
+      roots = fn_is_poly ? fn_poly.roots(xmin, xmax) : find_roots(fn_batch, fn, xmin, xmax);
+   } else {
+      roots.clear();
+   }
+
+   if (fn != nullptr && gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(extrema_check))) {
+      extrema = find_extrema(fn_batch, fn, xmin, xmax, dfn);
+   } else {
+      extrema.clear();
+   }
+
+   if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(antideriv_check))) {
+      cumul.cover(xmin, xmax);
+   }
+}
+
+void Grapher::reload_marks() {
+   load_marks();
+   gtk_widget_queue_draw(graphing_area);
+}
+
+void Grapher::rs_update_exact() {
+   static const char *fmt = "%lf%c";
+   double lo, hi;
+   char extra;
+
+   // The bounds are read as they're typed, so they are only used once both can be parsed.
+   if (fn == nullptr
+       || sscanf(gtk_entry_get_text(GTK_ENTRY(rs_lower_entry)), fmt, &lo, &extra) != 1
+       || sscanf(gtk_entry_get_text(GTK_ENTRY(rs_upper_entry)), fmt, &hi, &extra) != 1) {
+      gtk_label_set_text(GTK_LABEL(rs_exact_area), "");
+      return;
+   }
+
+   // Only a polynomial's integral is exact. Otherwise bounds inside the window are looked up
+   //  in the table, which is only built when the graph is, and any others are integrated
+   //  directly, so typing a far-off bound never rebuilds the table.
+   double value;
+   if (fn_is_poly) {
+      gtk_label_set_text(GTK_LABEL(rs_exact_label), "Exact integral:");
+      value = fn_poly.integral(lo, hi);
+   } else if (cumul.contains(std::min(lo, hi), std::max(lo, hi))) {
+      gtk_label_set_text(GTK_LABEL(rs_exact_label), "Integral (table):");
+      value = cumul.integral(lo, hi);
+   } else {
+      gtk_label_set_text(GTK_LABEL(rs_exact_label), "Integral (adaptive):");
+      value = integrate(fn, lo, hi);
+   }
+
+   char res[32];
+   if (std::isnan(value)) {
+      snprintf(res, sizeof(res), "undefined");
+   } else {
+      snprintf(res, sizeof(res), "%.12g", value);
+   }
+
+   gtk_label_set_text(GTK_LABEL(rs_exact_area), res);
 }
 
 void Grapher::apply_fn_str(const char *in) {
@@ -529,25 +1037,33 @@ void Grapher::apply_fn_str(const char *in) {
         *varname = nullptr;
 
    char *err = nullptr;
+   int arity = 1;
+   Query query = NO_QUERY;
 
    yy_scan_string(in);
-   yyparse(&expr, &funcname, &varname, &err);
-   
+   yyparse(&expr, &funcname, &varname, &arity, &err, &query);
+   yylex_destroy();
+   free(funcname);
+   free(varname);
+
    if (err != nullptr) {
       gtk_label_set_text(GTK_LABEL(err_area), err);
-      return;
-   }
-
-   apply_expr(expr);
-
-   if (funcname != nullptr) {
-      free(funcname);
+      free(err);
+   } else if (query != NO_QUERY) {
+      gtk_label_set_text(GTK_LABEL(err_area), "Error: queries can only be answered in the REPL.");
+   } else if (arity != 1) {
+      gtk_label_set_text(GTK_LABEL(err_area), "Error: only functions of one variable can be graphed.");
+   } else {
+      try {
+         apply_expr(expr);
+      } catch (ReportingException *e) {
+         destroy_expr(expr);
+         throw;
+      }
    }
 
-   if (varname != nullptr) {
-      free(varname);
-   }
-   yylex_destroy();
+   // Everything apply_expr keeps is copied or compiled from the expression.
+   destroy_expr(expr);
 }
 
 /**
@@ -560,68 +1076,96 @@ void load_expr(GtkWidget *widget, gpointer data) {
    ((Grapher *)data)->reload_expr(PLAIN);
 }
 
-void Grapher::mc_add_sample() {
-   static const uint32_t PXRED = 0x800000ff,
-                         PXBLUE = 0x80ff0000,
-                         PXWHITE = 0x40ffffff;
-
-   int channels = gdk_pixbuf_get_n_channels(mc_pixbuf),
-       rowstride = gdk_pixbuf_get_rowstride(mc_pixbuf),
-       width = gdk_pixbuf_get_width(mc_pixbuf),
-       height = gdk_pixbuf_get_height(mc_pixbuf);
-   
-   double xrange = mc_xmax - mc_xmin;
-   double yrange = mc_ymax - mc_ymin;
-   double x = (double)(rand()) / (double)(RAND_MAX) * xrange + mc_xmin,
-          y = (double)(rand()) / (double)(RAND_MAX) * yrange + mc_ymin;
-   
-   int i = (int)(width * (x - xmin) / (xmax - xmin)),
-       j = (int)(height * (1 - ((y - ymin) / (ymax - ymin))));
+/**
+ * Callback to update the points marked on the graph
+ *
+ * @param widget The caller
+ * @param data The Grapher object
+ */
+void toggle_marks(GtkWidget *widget, gpointer data) {
+   ((Grapher *)data)->reload_marks();
+}
 
-   double y_actual = fn(x);
-   uint32_t color = 0;
+/**
+ * Callback for edits to the Riemann sum bounds
+ *
+ * @param widget The caller
+ * @param data The Grapher object
+ */
+void rs_bounds_changed(GtkWidget *widget, gpointer data) {
+   ((Grapher *)data)->rs_update_exact();
+}
 
-   mc_points += 1.0;
-   if (y_actual > 0) {
-      if (0 < y && y < y_actual) {
-         color = PXRED;
-         mc_sum += 1.0;
-      } else {
-         color = PXWHITE;
-      }
-   } else {
-      if (0 > y && y > y_actual) {
-         color = PXBLUE;
-         mc_sum -= 1.0;
-      } else {
-         color = PXWHITE;
-      }
+void Grapher::mc_draw_new_samples() {
+   // The samples are taken and counted in the density map by the engine's threads.
+   // All that's left is to turn the map into an image once per frame.
+   // The engine stops by itself once the tolerance is met
+   if (!mc.running() && !mc_paused) {
+      mc_button_go();
    }
 
-   mc_area = (xrange * yrange) * (mc_sum / mc_points);
+   gtk_widget_queue_draw(graphing_area);
+}
 
-   if (0 <= i && i < width && 0 <= j && j < height) {
-      guchar *pixels = gdk_pixbuf_get_pixels(mc_pixbuf);
-      uint32_t *p = (uint32_t *)(pixels + j * rowstride + i * channels);
-      *p = color;
+gboolean Grapher::curve_update() {
+   bool more = curve.refine(CURVE_BUDGET);
+   gtk_widget_queue_draw(graphing_area);
+   if (more) {
+      return G_SOURCE_CONTINUE;
    }
+
+   curve_pending = false;
+   return G_SOURCE_REMOVE;
 }
 
-void Grapher::mc_add_samples(int n) {
-   for (int i = 0; i < n; i++) {
-      mc_add_sample();
+gboolean Grapher::rs_update() {
+   if (rs.running()) {
+      gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(rs_progress), rs.progress());
+      return G_SOURCE_CONTINUE;
+   }
+
+   rs.wait();
+   gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(rs_progress), 1);
+
+   char res[32];
+   snprintf(res, sizeof(res), "%.15g", rs.value());
+   gtk_label_set_text(GTK_LABEL(rs_res_area), res);
+
+   // One line per level, with the extrapolation next to each sum, under the number of
+   //  levels there was room for. That can be fewer than asked for, since every level
+   //  needs a whole number of steps.
+   std::string study;
+   const std::vector<SumLevel> &levels = rs.get_study();
+   if (rs_levels > 1) {
+      char line[64];
+      snprintf(line, sizeof(line), "%zu of %d levels", levels.size(), rs_levels);
+      study = line;
    }
 
+   for (size_t k = 0; levels.size() > 1 && k < levels.size(); k++) {
+      char line[96];
+      snprintf(line, sizeof(line), "\n%lld: %.12g -> %.15g",
+               (long long) levels[k].steps,
+               levels[k].estimate, levels[k].extrapolated);
+      study += line;
+   }
+
+   gtk_label_set_text(GTK_LABEL(rs_study_area), study.c_str());
    gtk_widget_queue_draw(graphing_area);
+
+   rs_polling = false;
+   return G_SOURCE_REMOVE;
 }
 
 void Grapher::mc_button_go() {
    mc_paused = true;
+   mc.stop();
    gtk_button_set_label(GTK_BUTTON(mc_button), "Continue");
 }
 
 void Grapher::mc_button_stop() {
    mc_paused = false;
+   mc.start();
    gtk_button_set_label(GTK_BUTTON(mc_button), "Stop");
 }
 
@@ -656,10 +1200,51 @@ void load_expr_mc(GtkWidget *widget, gpointer data) {
    ((Grapher *)data)->reload_expr(MCARLO);
 }
 
+/**
+ * Callback to reload expression and redraw graph with ODE solutions
+ *
+ * @param widget The caller
+ * @param data The Grapher object
+ */
+void load_expr_ode(GtkWidget *widget, gpointer data) {
+   ((Grapher *)data)->reload_expr(ODE);
+}
+
+/**
+ * Callback to reload expression and redraw graph with its spectrum
+ *
+ * @param widget The caller
+ * @param data The Grapher object
+ */
+void load_expr_sp(GtkWidget *widget, gpointer data) {
+   ((Grapher *)data)->reload_expr(SPECTRUM);
+}
+
+/**
+ * Callback to reload expression and redraw graph with an implicit curve
+ *
+ * @param widget The caller
+ * @param data The Grapher object
+ */
+void load_expr_im(GtkWidget *widget, gpointer data) {
+   ((Grapher *)data)->reload_expr(IMPLICIT);
+}
+
+/**
+ * Callback to reload expression and redraw graph as a coloring of the complex plane
+ *
+ * @param widget The caller
+ * @param data The Grapher object
+ */
+void load_expr_dc(GtkWidget *widget, gpointer data) {
+   ((Grapher *)data)->reload_expr(DOMAIN);
+}
+
 void Grapher::reload_expr(GraphMode _mode) {
    mode = _mode;
 
    gtk_label_set_text(GTK_LABEL(err_area), "");
+   auto_y = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(auto_y_check));
    bool all_parsed =
       get_double_from_gtk_entry(
          xmin_entry,
@@ -671,16 +1256,17 @@ void Grapher::reload_expr(GraphMode _mode) {
          &xmax,
          err_area,
          "Error: could not parse xmax.")
-   && get_double_from_gtk_entry(
-         ymin_entry,
-         &ymin,
-         err_area,
-         "Error: could not parse ymin.")
-   && get_double_from_gtk_entry(
-         ymax_entry,
-         &ymax,
-         err_area,
-         "Error: could not parse ymax.");
+   && (auto_y
+       || (get_double_from_gtk_entry(
+              ymin_entry,
+              &ymin,
+              err_area,
+              "Error: could not parse ymin.")
+           && get_double_from_gtk_entry(
+              ymax_entry,
+              &ymax,
+              err_area,
+              "Error: could not parse ymax.")));
 
    if (all_parsed) {
       switch (mode) {
@@ -693,6 +1279,16 @@ void Grapher::reload_expr(GraphMode _mode) {
       case MCARLO:
          if (!load_mc_vars()) mode = PLAIN;
          break;
+      case ODE:
+         if (!load_ode_vars()) mode = PLAIN;
+         break;
+      case SPECTRUM:
+         if (!load_sp_vars())  mode = PLAIN;
+         break;
+      case IMPLICIT:
+         if (!load_im_vars())  mode = PLAIN;
+         break;
+      case DOMAIN:
       case PLAIN:
          break;
       }
@@ -700,6 +1296,7 @@ void Grapher::reload_expr(GraphMode _mode) {
       if (mc_calling_back) {
          g_source_remove(mc_sample_tag);
          mc_calling_back = false;
+         mc.stop();
 
          gtk_button_set_label(GTK_BUTTON(mc_button), "Go");
          g_signal_handler_disconnect(G_OBJECT(mc_button),
@@ -720,6 +1317,12 @@ void Grapher::reload_expr(GraphMode _mode) {
       } catch (ParseError *e) {
          gtk_label_set_text(GTK_LABEL(err_area), e->what());
          delete e;
+      } catch (ArityFail *e) {
+         gtk_label_set_text(GTK_LABEL(err_area), e->what());
+         delete e;
+      } catch (DiffFail *e) {
+         gtk_label_set_text(GTK_LABEL(err_area), e->what());
+         delete e;
       }
    }
 }
@@ -767,6 +1370,11 @@ void Grapher::make_settings() {
    GtkWidget *dim_label = gtk_label_new("Window:");
    gtk_grid_attach(GTK_GRID(grid), dim_label, 0, 8, 1, 1);
 
+   auto_y_check = gtk_check_button_new_with_label("Auto y");
+   gtk_grid_attach(GTK_GRID(grid), auto_y_check, 0, 7, 1, 1);
+   g_signal_connect(G_OBJECT(auto_y_check), "toggled",
+                    G_CALLBACK(load_expr), this);
+
    xmin_entry = gtk_entry_new();
    gtk_entry_set_text(GTK_ENTRY(xmin_entry), "-10.0");
    gtk_grid_attach(GTK_GRID(grid), xmin_entry, 1, 8, 1, 1);
@@ -797,6 +1405,24 @@ void Grapher::make_settings() {
 
    err_area = gtk_label_new("");
    gtk_grid_attach(GTK_GRID(grid), err_area, 0, 9, 5, 1);
+
+   GtkWidget *mark_label = gtk_label_new("Mark:");
+   gtk_grid_attach(GTK_GRID(grid), mark_label, 0, 10, 1, 1);
+
+   roots_check = gtk_check_button_new_with_label("Roots");
+   gtk_grid_attach(GTK_GRID(grid), roots_check, 1, 10, 1, 1);
+   g_signal_connect(G_OBJECT(roots_check), "toggled",
+                    G_CALLBACK(toggle_marks), this);
+
+   extrema_check = gtk_check_button_new_with_label("Extrema");
+   gtk_grid_attach(GTK_GRID(grid), extrema_check, 2, 10, 1, 1);
+   g_signal_connect(G_OBJECT(extrema_check), "toggled",
+                    G_CALLBACK(toggle_marks), this);
+
+   antideriv_check = gtk_check_button_new_with_label("Antiderivative");
+   gtk_grid_attach(GTK_GRID(grid), antideriv_check, 3, 10, 1, 1);
+   g_signal_connect(G_OBJECT(antideriv_check), "toggled",
+                    G_CALLBACK(toggle_marks), this);
 }
 
 void Grapher::make_analysis() {
@@ -871,16 +1497,59 @@ void Grapher::make_analysis() {
    g_signal_connect(G_OBJECT(rs_step_entry), "activate",
                     G_CALLBACK(load_expr_rs), this);
 
+   GtkWidget *rs_rule_label = gtk_label_new("rule: ");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_rule_label, 0, 3, 1, 1);
+
+   // The entries are in the same order as SumRule.
+   rs_rule_combo = gtk_combo_box_text_new();
+   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(rs_rule_combo), "Left");
+   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(rs_rule_combo), "Right");
+   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(rs_rule_combo), "Midpoint");
+   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(rs_rule_combo), "Trapezoid");
+   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(rs_rule_combo), "Simpson");
+   gtk_combo_box_set_active(GTK_COMBO_BOX(rs_rule_combo), MIDPOINT);
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_rule_combo, 1, 3, 1, 1);
+
+   GtkWidget *rs_levels_label = gtk_label_new("levels: ");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_levels_label, 0, 4, 1, 1);
+
+   rs_levels_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(rs_levels_entry), "1");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_levels_entry, 1, 4, 1, 1);
+   g_signal_connect(G_OBJECT(rs_levels_entry), "activate",
+                    G_CALLBACK(load_expr_rs), this);
+
+   rs_dd_check = gtk_check_button_new_with_label("Double-double precision");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_dd_check, 0, 5, 2, 1);
+
    GtkWidget *sum_button = gtk_button_new_with_label("Sum");
-   gtk_grid_attach(GTK_GRID(rs_grid), sum_button, 0, 3, 2, 1);
+   gtk_grid_attach(GTK_GRID(rs_grid), sum_button, 0, 6, 2, 1);
    g_signal_connect(G_OBJECT(sum_button), "clicked",
                     G_CALLBACK(load_expr_rs), this);
 
    GtkWidget *rs_res_label = gtk_label_new("Integral estimate:");
-   gtk_grid_attach(GTK_GRID(rs_grid), rs_res_label, 0, 4, 2, 1);
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_res_label, 0, 7, 2, 1);
 
    rs_res_area = gtk_label_new("");
-   gtk_grid_attach(GTK_GRID(rs_grid), rs_res_area, 0, 5, 2, 1);
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_res_area, 0, 8, 2, 1);
+
+   rs_study_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_study_area, 0, 9, 2, 1);
+
+   rs_progress = gtk_progress_bar_new();
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_progress, 0, 10, 2, 1);
+
+   rs_exact_label = gtk_label_new("Exact integral:");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_exact_label, 0, 11, 2, 1);
+
+   rs_exact_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(rs_grid), rs_exact_area, 0, 12, 2, 1);
+
+   // The integral follows the bounds as they're edited, without a new sum.
+   g_signal_connect(G_OBJECT(rs_lower_entry), "changed",
+                    G_CALLBACK(rs_bounds_changed), this);
+   g_signal_connect(G_OBJECT(rs_upper_entry), "changed",
+                    G_CALLBACK(rs_bounds_changed), this);
 
    // Making Monte Carlo menu
    GtkWidget *mc_grid = gtk_grid_new();
@@ -926,28 +1595,216 @@ void Grapher::make_analysis() {
    g_signal_connect(G_OBJECT(mc_ymax_entry), "activate",
                     G_CALLBACK(load_expr_mc), this);
 
+   GtkWidget *mc_tol_label = gtk_label_new("tol: ");
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_tol_label, 0, 4, 1, 1);
+
+   mc_tol_entry = gtk_entry_new();
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_tol_entry, 1, 4, 1, 1);
+   g_signal_connect(G_OBJECT(mc_tol_entry), "activate",
+                    G_CALLBACK(load_expr_mc), this);
+
+   mc_qmc_check = gtk_check_button_new_with_label("Quasi-random (Sobol) points");
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_qmc_check, 0, 5, 2, 1);
+
+   mc_strat_check = gtk_check_button_new_with_label("Stratify by x");
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_strat_check, 0, 6, 2, 1);
+
+   mc_imp_check = gtk_check_button_new_with_label("Sample y near the curve");
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_imp_check, 0, 7, 2, 1);
+
    mc_button = gtk_button_new_with_label("Go");
-   gtk_grid_attach(GTK_GRID(mc_grid), mc_button, 0, 4, 2, 1);
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_button, 0, 8, 2, 1);
    mc_button_handler_id = 
       g_signal_connect(G_OBJECT(mc_button), "clicked",
                        G_CALLBACK(load_expr_mc), this);
 
    GtkWidget *approx_label = gtk_label_new("Integral estimate:");
-   gtk_grid_attach(GTK_GRID(mc_grid), approx_label, 0, 5, 2, 1);
+   gtk_grid_attach(GTK_GRID(mc_grid), approx_label, 0, 9, 2, 1);
 
    mc_res_area = gtk_label_new("");
-   gtk_grid_attach(GTK_GRID(mc_grid), mc_res_area, 0, 6, 2, 1);
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_res_area, 0, 10, 2, 1);
+
+   mc_err_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_err_area, 0, 11, 2, 1);
 
    GtkWidget *n_label = gtk_label_new("n = ");
-   gtk_grid_attach(GTK_GRID(mc_grid), n_label, 0, 7, 1, 1);
+   gtk_grid_attach(GTK_GRID(mc_grid), n_label, 0, 12, 1, 1);
 
    mc_n_area = gtk_label_new("");
-   gtk_grid_attach(GTK_GRID(mc_grid), mc_n_area, 1, 7, 1, 1);
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_n_area, 1, 12, 1, 1);
+
+   mc_exact_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(mc_grid), mc_exact_area, 0, 13, 2, 1);
+
+   // Making the ODE menu
+   GtkWidget *ode_grid = gtk_grid_new();
+   gtk_grid_set_row_spacing(GTK_GRID(ode_grid), 10);
+   gtk_widget_set_margin_top(ode_grid, 10);
+   gtk_widget_set_margin_left(ode_grid, 10);
+   gtk_widget_set_margin_right(ode_grid, 10);
+
+   GtkWidget *ode_label = gtk_label_new("ODE");
+   gtk_notebook_append_page(GTK_NOTEBOOK(analysis_nb),
+                            ode_grid,
+                            ode_label);
+
+   GtkWidget *ode_rhs_label = gtk_label_new("y' = ");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_rhs_label, 0, 0, 1, 1);
+
+   ode_rhs_entry = gtk_entry_new();
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_rhs_entry, 1, 0, 1, 1);
+   g_signal_connect(G_OBJECT(ode_rhs_entry), "activate",
+                    G_CALLBACK(load_expr_ode), this);
+
+   GtkWidget *ode_x0_label = gtk_label_new("x0: ");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_x0_label, 0, 1, 1, 1);
+
+   ode_x0_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(ode_x0_entry), "0");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_x0_entry, 1, 1, 1, 1);
+   g_signal_connect(G_OBJECT(ode_x0_entry), "activate",
+                    G_CALLBACK(load_expr_ode), this);
+
+   GtkWidget *ode_y0_label = gtk_label_new("y0: ");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_y0_label, 0, 2, 1, 1);
+
+   ode_y0_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(ode_y0_entry), "1");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_y0_entry, 1, 2, 1, 1);
+   g_signal_connect(G_OBJECT(ode_y0_entry), "activate",
+                    G_CALLBACK(load_expr_ode), this);
+
+   GtkWidget *ode_n_label = gtk_label_new("Curves: ");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_n_label, 0, 3, 1, 1);
+
+   ode_n_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(ode_n_entry), "1");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_n_entry, 1, 3, 1, 1);
+   g_signal_connect(G_OBJECT(ode_n_entry), "activate",
+                    G_CALLBACK(load_expr_ode), this);
+
+   GtkWidget *ode_dy_label = gtk_label_new("Spacing: ");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_dy_label, 0, 4, 1, 1);
+
+   ode_dy_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(ode_dy_entry), "1");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_dy_entry, 1, 4, 1, 1);
+   g_signal_connect(G_OBJECT(ode_dy_entry), "activate",
+                    G_CALLBACK(load_expr_ode), this);
+
+   GtkWidget *solve_button = gtk_button_new_with_label("Solve");
+   gtk_grid_attach(GTK_GRID(ode_grid), solve_button, 0, 5, 2, 1);
+   g_signal_connect(G_OBJECT(solve_button), "clicked",
+                    G_CALLBACK(load_expr_ode), this);
+
+   ode_res_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(ode_grid), ode_res_area, 0, 6, 2, 1);
+
+   // Making the spectrum menu
+   GtkWidget *sp_grid = gtk_grid_new();
+   gtk_grid_set_row_spacing(GTK_GRID(sp_grid), 10);
+   gtk_widget_set_margin_top(sp_grid, 10);
+   gtk_widget_set_margin_left(sp_grid, 10);
+   gtk_widget_set_margin_right(sp_grid, 10);
+
+   GtkWidget *sp_label = gtk_label_new("Spectrum");
+   gtk_notebook_append_page(GTK_NOTEBOOK(analysis_nb),
+                            sp_grid,
+                            sp_label);
+
+   GtkWidget *sp_n_label = gtk_label_new("Points: ");
+   gtk_grid_attach(GTK_GRID(sp_grid), sp_n_label, 0, 0, 1, 1);
+
+   sp_n_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(sp_n_entry), "4096");
+   gtk_grid_attach(GTK_GRID(sp_grid), sp_n_entry, 1, 0, 1, 1);
+   g_signal_connect(G_OBJECT(sp_n_entry), "activate",
+                    G_CALLBACK(load_expr_sp), this);
+
+   GtkWidget *sp_button = gtk_button_new_with_label("Analyze");
+   gtk_grid_attach(GTK_GRID(sp_grid), sp_button, 0, 1, 2, 1);
+   g_signal_connect(G_OBJECT(sp_button), "clicked",
+                    G_CALLBACK(load_expr_sp), this);
+
+   sp_res_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(sp_grid), sp_res_area, 0, 2, 2, 1);
+
+   // Making the implicit plot menu
+   GtkWidget *im_grid = gtk_grid_new();
+   gtk_grid_set_row_spacing(GTK_GRID(im_grid), 10);
+   gtk_widget_set_margin_top(im_grid, 10);
+   gtk_widget_set_margin_left(im_grid, 10);
+   gtk_widget_set_margin_right(im_grid, 10);
+
+   GtkWidget *im_label = gtk_label_new("Implicit");
+   gtk_notebook_append_page(GTK_NOTEBOOK(analysis_nb),
+                            im_grid,
+                            im_label);
+
+   GtkWidget *im_expr_label = gtk_label_new("f(x, y) = ");
+   gtk_grid_attach(GTK_GRID(im_grid), im_expr_label, 0, 0, 1, 1);
+
+   im_expr_entry = gtk_entry_new();
+   gtk_entry_set_text(GTK_ENTRY(im_expr_entry), "x^2 + y^2 - 25");
+   gtk_grid_attach(GTK_GRID(im_grid), im_expr_entry, 1, 0, 1, 1);
+   g_signal_connect(G_OBJECT(im_expr_entry), "activate",
+                    G_CALLBACK(load_expr_im), this);
+
+   im_heat_check = gtk_check_button_new_with_label("Heatmap");
+   gtk_grid_attach(GTK_GRID(im_grid), im_heat_check, 0, 1, 2, 1);
+
+   GtkWidget *im_button = gtk_button_new_with_label("Plot");
+   gtk_grid_attach(GTK_GRID(im_grid), im_button, 0, 2, 2, 1);
+   g_signal_connect(G_OBJECT(im_button), "clicked",
+                    G_CALLBACK(load_expr_im), this);
+
+   im_res_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(im_grid), im_res_area, 0, 3, 2, 1);
+
+   // Making the complex plane menu
+   GtkWidget *dc_grid = gtk_grid_new();
+   gtk_grid_set_row_spacing(GTK_GRID(dc_grid), 10);
+   gtk_widget_set_margin_top(dc_grid, 10);
+   gtk_widget_set_margin_left(dc_grid, 10);
+   gtk_widget_set_margin_right(dc_grid, 10);
+
+   GtkWidget *dc_label = gtk_label_new("Complex");
+   gtk_notebook_append_page(GTK_NOTEBOOK(analysis_nb),
+                            dc_grid,
+                            dc_label);
+
+   GtkWidget *dc_info = gtk_label_new("x is taken as complex, with the y axis imaginary.\n"
+                                      "Hue shows the argument, and bands the modulus.");
+   gtk_grid_attach(GTK_GRID(dc_grid), dc_info, 0, 0, 1, 1);
+
+   GtkWidget *dc_button = gtk_button_new_with_label("Color");
+   gtk_grid_attach(GTK_GRID(dc_grid), dc_button, 0, 1, 1, 1);
+   g_signal_connect(G_OBJECT(dc_button), "clicked",
+                    G_CALLBACK(load_expr_dc), this);
+
+   dc_res_area = gtk_label_new("");
+   gtk_grid_attach(GTK_GRID(dc_grid), dc_res_area, 0, 2, 1, 1);
 }
 
 void Grapher::make_all() {
    mc_initialized = false;
    mc_calling_back = false;
+   rs_dd = false;
+   rs_rule = MIDPOINT;
+   rs_levels = 1;
+   curve_pending = false;
+   mc_qmc = false;
+   mc_stratify = false;
+   mc_importance = false;
+   mc_tol = 0;
+   rs_polling = false;
+   im_expr = nullptr;
+   fn = nullptr;
+   dfn = nullptr;
+   fn_batch = nullptr;
+   fn_is_poly = false;
+   im_pixbuf = nullptr;
+   dc_pixbuf = nullptr;
 
    GtkWidget *window = gtk_application_window_new(app);
    gtk_window_set_title(GTK_WINDOW(window), "Grapher");
@@ -19,11 +19,22 @@
 #ifndef GRAPHER_HPP
 #define GRAPHER_HPP
 
+#include "autorange.hpp"
 #include "compile.hpp"
+#include "cumulative.hpp"
+#include "curve.hpp"
+#include "domain.hpp"
+#include "extrema.hpp"
+#include "fft.hpp"
+#include "implicit.hpp"
+#include "mcarlo.hpp"
+#include "ode.hpp"
+#include "poly.hpp"
+#include "rsum.hpp"
 #include <gtk/gtk.h>
 
 enum GraphMode {
-   PLAIN, TRACE, RSUM, MCARLO
+   PLAIN, TRACE, RSUM, MCARLO, ODE, SPECTRUM, IMPLICIT, DOMAIN
 };
 
 /* A class representing the graphing dialog. */
@@ -39,12 +50,23 @@ class Grapher {
              *xmax_entry,
              *ymin_entry,
              *ymax_entry,
+             *auto_y_check,
+             *roots_check,
+             *extrema_check,
+             *antideriv_check,
              *err_area;
 
    /* Graph window settings */
    double xmin, xmax,
           ymin, ymax;
 
+   /* Should ymin and ymax be found from the function instead of entered? */
+   bool auto_y;
+
+   /* The roots and extrema of the function in the window, if they are being marked */
+   std::vector<double> roots;
+   std::vector<Extremum> extrema;
+
    /* Components of the trace menu */
    GtkWidget *tr_xval_entry,
              *tr_res_area;
@@ -56,23 +78,57 @@ class Grapher {
    GtkWidget *rs_lower_entry,
              *rs_upper_entry,
              *rs_step_entry,
-             *rs_res_area;
+             *rs_rule_combo,
+             *rs_levels_entry,
+             *rs_dd_check,
+             *rs_res_area,
+             *rs_study_area,
+             *rs_exact_label,
+             *rs_exact_area,
+             *rs_progress;
 
    /* Riemann sum input data */
    double rs_lower, rs_upper, rs_step;
 
+   /* Should the Riemann sum evaluate the function in double-double precision? */
+   bool rs_dd;
+
+   /* Where the Riemann sum samples each step */
+   SumRule rs_rule;
+
+   /* Number of sums in the convergence study, the last one having the step above */
+   int rs_levels;
+
+   /* Is the callback that follows a Riemann sum in the background active? */
+   bool rs_polling;
+
    /* Components of Monte Carlo menu */
    GtkWidget *mc_xmin_entry,
              *mc_xmax_entry,
              *mc_ymin_entry,
              *mc_ymax_entry,
+             *mc_tol_entry,
+             *mc_qmc_check,
+             *mc_strat_check,
+             *mc_imp_check,
              *mc_button,
              *mc_res_area,
-             *mc_n_area;
+             *mc_err_area,
+             *mc_n_area,
+             *mc_exact_area;
 
    /* Monte Carlo input data */
    double mc_xmin, mc_xmax, mc_ymin, mc_ymax;
 
+   /* Should the samples come from Sobol sequences instead of a random stream? */
+   bool mc_qmc;
+
+   /* Variance reduction for the Monte Carlo estimate */
+   bool mc_stratify, mc_importance;
+
+   /* Sampling stops once the 95% confidence interval is this narrow. 0 for never. */
+   double mc_tol;
+
    /* The bitmap representing the Monte Carlo sampling */
    GdkPixbuf *mc_pixbuf;
 
@@ -82,8 +138,8 @@ class Grapher {
    /* Has the Monte Carlo sampling callback been created? */
    bool mc_calling_back;
 
-   /* Monte Carlo sampling data */
-   double mc_points, mc_sum, mc_area;
+   /* Seed of the random stream the samples are taken from */
+   uint64_t mc_seed;
 
    /* Timeout tag for the Monte Carlo sampling callback */
    gint mc_sample_tag;
@@ -94,11 +150,90 @@ class Grapher {
    /* The id of the active handler function for the Monte Carlo button */
    gulong mc_button_handler_id;
 
+   /* Components of the ODE menu */
+   GtkWidget *ode_rhs_entry,
+             *ode_x0_entry,
+             *ode_y0_entry,
+             *ode_n_entry,
+             *ode_dy_entry,
+             *ode_res_area;
+
+   /* ODE input data. There are ode_n initial values, ode_dy apart, starting at ode_y0. */
+   double ode_x0, ode_y0, ode_dy;
+   int ode_n;
+
+   /* The right-hand side F(x, y) of y' = F(x, y) */
+   Expr *ode_rhs;
+
+   /* The solutions from x0 to xmax and from x0 back to xmin */
+   std::vector<ODESolution> ode_fwd, ode_back;
+
+   /* Components of the spectrum menu */
+   GtkWidget *sp_n_entry,
+             *sp_res_area;
+
+   /* Number of samples the spectrum is taken from. Always a power of two. */
+   int sp_n;
+
+   /* The magnitude spectrum of the function over the window */
+   Spectrum sp;
+
+   /* Components of the implicit plot menu */
+   GtkWidget *im_expr_entry,
+             *im_heat_check,
+             *im_res_area;
+
+   /* The function f(x, y) whose zero set is plotted */
+   Expr *im_expr;
+
+   /* Should the values of f be shown as a heatmap behind the curve? */
+   bool im_heatmap;
+
+   /* The curve and the values of f in the window */
+   ImplicitPlot im_plot;
+
+   /* The heatmap, if it's shown */
+   GdkPixbuf *im_pixbuf;
+
+   /* Components of the complex plane menu */
+   GtkWidget *dc_res_area;
+
+   /* The function's values over the window as the complex plane */
+   DomainColoring dc;
+
+   /* The colored plane */
+   GdkPixbuf *dc_pixbuf;
+
    /* Objects used for the compilation of expressions. */
    const ExecCtx ectx;
    JitRuntime rt;
    Func fn;
 
+   /* The derivative of fn, or nullptr if it couldn't be differentiated */
+   Func dfn;
+
+   /* fn compiled to evaluate arrays of points, for scanning the window */
+   BatchFunc fn_batch;
+
+   /* Computes and keeps the Riemann sum */
+   RSumEngine rs;
+
+   /* The integral of fn from a point, for exact integrals and the antiderivative curve */
+   CumulativeIntegral cumul;
+
+   /* The plotted curve of fn, kept between draws */
+   CurveCache curve;
+
+   /* Is the callback that refines the curve active? */
+   bool curve_pending;
+
+   /* fn's coefficients, if it's a polynomial, for integrals and roots in closed form */
+   Polynomial fn_poly;
+   bool fn_is_poly;
+
+   /* Takes the Monte Carlo samples in the background */
+   MCEngine mc;
+
    /* Which analysis to do, if any */
    GraphMode mode;
 
@@ -123,6 +258,27 @@ class Grapher {
     */
    bool load_mc_vars();
 
+   /**
+    * Loads ODE vars, and parses the right-hand side
+    *
+    * @return true if there were no errors
+    */
+   bool load_ode_vars();
+
+   /**
+    * Loads spectrum vars
+    *
+    * @return true if there were no errors
+    */
+   bool load_sp_vars();
+
+   /**
+    * Loads implicit plot vars, and parses f(x, y)
+    *
+    * @return true if there were no errors
+    */
+   bool load_im_vars();
+
    /**
     * Sets the function being graphed
     *
@@ -130,6 +286,11 @@ class Grapher {
     */
    void apply_expr(const Expr *expr);
 
+   /**
+    * Finds the roots and extrema to mark in the window, and the antiderivative, if they are asked for
+    */
+   void load_marks();
+
    /**
     * Parses an expression string and graphs the expression
     *
@@ -165,6 +326,17 @@ public:
     */
    void reload_expr(GraphMode mode);
 
+   /**
+    * Updates the points marked on the graph, and redraws it
+    */
+   void reload_marks();
+
+   /**
+    * Shows the exact integral between the Riemann sum bounds, as they are typed.
+    * Looked up in the cumulative integral table, so the sum isn't recomputed.
+    */
+   void rs_update_exact();
+
    /**
     * Runs the graphing program
     *
@@ -185,15 +357,23 @@ public:
    gboolean draw_graph(cairo_t *cr);
 
    /**
-    * Adds a new sample to the Monte Carlo view
+    * Updates the progress of the Riemann sum, and shows its result once it's done
+    *
+    * @return G_SOURCE_CONTINUE while the sum is still being computed
+    */
+   gboolean rs_update();
+
+   /**
+    * Refines the curve for a while and draws it
+    *
+    * @return G_SOURCE_CONTINUE until the curve is traced one column at a time
     */
-   void mc_add_sample();
+   gboolean curve_update();
 
    /**
-    * Adds n new samples to the Monte Carlo view
-    *  and requests a redraw
+    * Requests a redraw of the Monte Carlo view, whose density map the samplers fill
     */
-   void mc_add_samples(int n);
+   void mc_draw_new_samples();
 
    /* Is the Monte Carlo button "Stop" or "Go?" */
    bool mc_is_paused();
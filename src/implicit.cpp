@@ -0,0 +1,278 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "implicit.hpp"
+#include "interval.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Interleaves the bits of two tile coordinates, so that sorting by the result
+ *  walks the tiles along a Z-order curve.
+ */
+static uint32_t morton(uint32_t x, uint32_t y) {
+   uint32_t code = 0;
+   for (int bit = 0; bit < 16; bit++) {
+      code |= ((x >> bit) & 1) << (2 * bit);
+      code |= ((y >> bit) & 1) << (2 * bit + 1);
+   }
+
+   return code;
+}
+
+/* A contour segment before it's checked, with the smaller sample magnitude on the edge at each end */
+struct Candidate {
+   ContourSegment seg;
+   double near0, near1;
+};
+
+/**
+ * Finds where the contour crosses the cells of a grid of samples, with marching squares.
+ *
+ * @param vals The samples, row-major
+ * @param nx The number of samples in each row
+ * @param ny The number of rows
+ * @param i0 The column of the first sample, in pixels
+ * @param j0 The row of the first sample, in pixels
+ * @param out Where to add the segments
+ */
+static void march(const double *vals, int nx, int ny, int i0, int j0, std::vector<Candidate> &out) {
+   // For each corner sign pattern, the edges the contour joins, in pairs.
+   // Corners are numbered a (top left), b (top right), c (bottom right), d (bottom left),
+   //  and edges 0 (top), 1 (right), 2 (bottom), 3 (left).
+   // The saddles, 5 and 10, are listed for a negative center.
+   static const int EDGES[16][4] = {
+      { -1, -1, -1, -1 }, { 3, 0, -1, -1 }, { 0, 1, -1, -1 }, { 3, 1, -1, -1 },
+      { 1, 2, -1, -1 },   { 3, 0, 1, 2 },   { 0, 2, -1, -1 }, { 3, 2, -1, -1 },
+      { 2, 3, -1, -1 },   { 0, 2, -1, -1 }, { 0, 1, 2, 3 },   { 1, 2, -1, -1 },
+      { 3, 1, -1, -1 },   { 0, 1, -1, -1 }, { 3, 0, -1, -1 }, { -1, -1, -1, -1 }
+   };
+
+   // The same saddles for a positive center
+   static const int SADDLE_5[4] = { 0, 1, 2, 3 },
+                    SADDLE_10[4] = { 3, 0, 1, 2 };
+
+   for (int j = 0; j + 1 < ny; j++) {
+      for (int i = 0; i + 1 < nx; i++) {
+         double a = vals[j * nx + i],
+                b = vals[j * nx + i + 1],
+                c = vals[(j + 1) * nx + i + 1],
+                d = vals[(j + 1) * nx + i];
+         if (std::isnan(a) || std::isnan(b) || std::isnan(c) || std::isnan(d)) {
+            continue;
+         }
+
+         int index = (a > 0) | (b > 0) << 1 | (c > 0) << 2 | (d > 0) << 3;
+         if (index == 0 || index == 15) {
+            continue;
+         }
+
+         const int *edges = EDGES[index];
+         if ((index == 5 || index == 10) && a + b + c + d > 0) {
+            edges = index == 5 ? SADDLE_5 : SADDLE_10;
+         }
+
+         // Where the contour crosses each edge, by linear interpolation, relative to a
+         auto cross = [&](int edge, float &x, float &y, double &near) {
+            switch (edge) {
+            case 0: x = a / (a - b); y = 0;           near = std::min(std::fabs(a), std::fabs(b)); break;
+            case 1: x = 1;           y = b / (b - c); near = std::min(std::fabs(b), std::fabs(c)); break;
+            case 2: x = d / (d - c); y = 1;           near = std::min(std::fabs(d), std::fabs(c)); break;
+            case 3: x = 0;           y = a / (a - d); near = std::min(std::fabs(a), std::fabs(d)); break;
+            }
+
+            // Samples are at pixel centers.
+            x += i0 + i + 0.5f;
+            y += j0 + j + 0.5f;
+         };
+
+         for (int k = 0; k < 4 && edges[k] >= 0; k += 2) {
+            Candidate cand;
+            cross(edges[k], cand.seg.x0, cand.seg.y0, cand.near0);
+            cross(edges[k + 1], cand.seg.x1, cand.seg.y1, cand.near1);
+            out.push_back(cand);
+         }
+      }
+   }
+}
+
+ImplicitPlot::ImplicitPlot()
+   : width(0),
+     height(0),
+     scale(1),
+     n_tiles(0),
+     n_pruned(0)
+{}
+
+void ImplicitPlot::compute(BatchFunc batch, const Expr *expr, const VarTable &vars,
+                           double xmin, double xmax, double ymin, double ymax,
+                           int _width, int _height, bool heatmap,
+                           ThreadPool &pool) {
+   width = _width;
+   height = _height;
+   values.assign((size_t) width * height, NAN);
+   segments.clear();
+
+   double dx = (xmax - xmin) / width,
+          dy = (ymax - ymin) / height;
+
+   int tiles_x = (width + IMPLICIT_TILE - 1) / IMPLICIT_TILE,
+       tiles_y = (height + IMPLICIT_TILE - 1) / IMPLICIT_TILE;
+
+   std::vector<std::pair<uint32_t, int>> order;
+   for (int ty = 0; ty < tiles_y; ty++) {
+      for (int tx = 0; tx < tiles_x; tx++) {
+         order.push_back({ morton(tx, ty), ty * tiles_x + tx });
+      }
+   }
+
+   std::sort(order.begin(), order.end());
+   n_tiles = order.size();
+
+   std::vector<std::vector<ContourSegment>> tile_segments(n_tiles);
+   std::vector<char> pruned(n_tiles, 0);
+   pool.run(n_tiles, [&](int64_t k) {
+      int tile = order[k].second,
+          i0 = (tile % tiles_x) * IMPLICIT_TILE,
+          j0 = (tile / tiles_x) * IMPLICIT_TILE;
+
+      // Each tile samples one past its own pixels, so that the cells between tiles have all their corners.
+      int i1 = std::min(i0 + IMPLICIT_TILE, width - 1),
+          j1 = std::min(j0 + IMPLICIT_TILE, height - 1),
+          nx = i1 - i0 + 1,
+          ny = j1 - j0 + 1;
+
+      Interval box[2] = {
+         { xmin + (i0 + 0.5) * dx, xmin + (i1 + 0.5) * dx },
+         { ymax - (j1 + 0.5) * dy, ymax - (j0 + 0.5) * dy }
+      };
+
+      bool may_cross = eval_interval(expr, box, vars).contains(0);
+      pruned[k] = !may_cross;
+      if (!may_cross && !heatmap) {
+         return;
+      }
+
+      std::vector<double> xs(nx * ny), ys(nx * ny), vals(nx * ny);
+      for (int j = 0; j < ny; j++) {
+         for (int i = 0; i < nx; i++) {
+            xs[j * nx + i] = xmin + (i0 + i + 0.5) * dx;
+            ys[j * nx + i] = ymax - (j0 + j + 0.5) * dy;
+         }
+      }
+
+      const double *args[2] = { xs.data(), ys.data() };
+      batch(args, vals.data(), nx * ny);
+
+      // Only the tile's own pixels are written, so no two tiles write the same one.
+      int own_x = std::min(IMPLICIT_TILE, width - i0),
+          own_y = std::min(IMPLICIT_TILE, height - j0);
+      for (int j = 0; j < own_y; j++) {
+         for (int i = 0; i < own_x; i++) {
+            values[(size_t) (j0 + j) * width + i0 + i] = vals[j * nx + i];
+         }
+      }
+
+      if (!may_cross) {
+         return;
+      }
+
+      std::vector<Candidate> cands;
+      march(vals.data(), nx, ny, i0, j0, cands);
+      if (cands.empty()) {
+         return;
+      }
+
+      // Along a smooth crossing, interpolation leaves the function much smaller than the samples on the edge.
+      // Across a pole it doesn't.
+      size_t n = cands.size();
+      std::vector<double> ends_x(2 * n), ends_y(2 * n), ends(2 * n);
+      for (size_t c = 0; c < n; c++) {
+         ends_x[2 * c] = xmin + cands[c].seg.x0 * dx;
+         ends_y[2 * c] = ymax - cands[c].seg.y0 * dy;
+         ends_x[2 * c + 1] = xmin + cands[c].seg.x1 * dx;
+         ends_y[2 * c + 1] = ymax - cands[c].seg.y1 * dy;
+      }
+
+      const double *end_args[2] = { ends_x.data(), ends_y.data() };
+      batch(end_args, ends.data(), 2 * n);
+      for (size_t c = 0; c < n; c++) {
+         if (std::fabs(ends[2 * c]) <= IMPLICIT_POLE_RESIDUAL * cands[c].near0
+             && std::fabs(ends[2 * c + 1]) <= IMPLICIT_POLE_RESIDUAL * cands[c].near1) {
+            tile_segments[k].push_back(cands[c].seg);
+         }
+      }
+   });
+
+   n_pruned = 0;
+   for (int k = 0; k < n_tiles; k++) {
+      n_pruned += pruned[k];
+      segments.insert(segments.end(), tile_segments[k].begin(), tile_segments[k].end());
+   }
+
+   // The colors are scaled to the median size of the function, from a sparse sample of the pixels.
+   std::vector<float> sizes;
+   for (size_t p = 0; p < values.size(); p += 61) {
+      if (std::isfinite(values[p])) {
+         sizes.push_back(std::fabs(values[p]));
+      }
+   }
+
+   scale = 1;
+   if (!sizes.empty()) {
+      std::nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+      if (sizes[sizes.size() / 2] > 0) {
+         scale = sizes[sizes.size() / 2];
+      }
+   }
+}
+
+void ImplicitPlot::tone_map(uint8_t *pixels, int rowstride) const {
+   for (int j = 0; j < height; j++) {
+      const float *row = &values[(size_t) j * width];
+      uint8_t *out = pixels + (size_t) j * rowstride;
+
+      for (int i = 0; i < width; i++, out += 4) {
+         float v = row[i];
+         if (!std::isfinite(v)) {
+            out[0] = out[1] = out[2] = out[3] = 0;
+            continue;
+         }
+
+         // The median size maps to about three quarters of full brightness.
+         uint8_t level = (uint8_t) (255 * std::tanh(std::fabs(v) / scale));
+         out[0] = v > 0 ? level : 0;
+         out[1] = 0;
+         out[2] = v > 0 ? 0 : level;
+         out[3] = IMPLICIT_ALPHA;
+      }
+   }
+}
+
+const std::vector<ContourSegment> &ImplicitPlot::get_segments() const {
+   return segments;
+}
+
+int ImplicitPlot::tiles() const {
+   return n_tiles;
+}
+
+int ImplicitPlot::pruned() const {
+   return n_pruned;
+}
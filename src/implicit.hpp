@@ -0,0 +1,106 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef IMPLICIT_HPP
+#define IMPLICIT_HPP
+
+#include "compile.hpp"
+#include "threadpool.hpp"
+#include <cstdint>
+#include <vector>
+
+/* Width and height of a tile, in pixels. Tiles are the unit of work for the thread pool. */
+#define IMPLICIT_TILE 32
+
+/* Opacity of the heatmap */
+#define IMPLICIT_ALPHA 160
+
+/* A contour segment is dropped if the function at either end is more than this fraction
+ *  of the smaller sample on the edge it interpolates, which happens where the sign changes across a pole.
+ */
+#define IMPLICIT_POLE_RESIDUAL 0.5
+
+/* A piece of the f(x, y) = 0 contour, in pixel coordinates */
+struct ContourSegment {
+   float x0, y0, x1, y1;
+};
+
+/* The values of a function of x and y over a pixel grid, and the curve where it is 0.
+ * Each pixel is sampled at its center. The grid is split into tiles which are
+ *  evaluated in Morton order, so neighbouring tiles are usually taken up together.
+ * Tiles which interval arithmetic shows can't contain the curve are skipped,
+ *  unless their values are needed for the heatmap.
+ * The contour is found with marching squares, and its segments are checked
+ *  by evaluating the function where they end.
+ */
+class ImplicitPlot {
+   int width, height;
+
+   /* The function at each pixel, row-major. NaN where it wasn't evaluated. */
+   std::vector<float> values;
+
+   /* The contour, in the order of the tiles it was found in */
+   std::vector<ContourSegment> segments;
+
+   /* The typical size of the function, which the heatmap's colors are scaled to */
+   float scale;
+
+   int n_tiles, n_pruned;
+
+public:
+   ImplicitPlot();
+
+   /**
+    * Evaluates a function over the window, and finds its zero contour.
+    *
+    * @param batch The batch kernel of the function, taking x then y
+    * @param expr The function's expression with user-defined functions inlined, for interval bounds
+    * @param vars The values of variables in expr
+    * @param xmin The left edge of the window
+    * @param xmax The right edge of the window
+    * @param ymin The bottom edge of the window
+    * @param ymax The top edge of the window
+    * @param width The window's width in pixels
+    * @param height The window's height in pixels
+    * @param heatmap Are the values needed everywhere, or only near the contour?
+    * @param pool The threads to evaluate tiles on
+    */
+   void compute(BatchFunc batch, const Expr *expr, const VarTable &vars,
+                double xmin, double xmax, double ymin, double ymax,
+                int width, int height, bool heatmap,
+                ThreadPool &pool = ThreadPool::shared());
+
+   /**
+    * Draws the values into an RGBA image of the same size.
+    * Positive values are red and negative ones blue, brighter the larger they are.
+    *
+    * @param pixels The image's pixels, row-major with 4 bytes per pixel
+    * @param rowstride The number of bytes between the starts of consecutive rows
+    */
+   void tone_map(uint8_t *pixels, int rowstride) const;
+
+   const std::vector<ContourSegment> &get_segments() const;
+
+   /* Number of tiles in the last plot */
+   int tiles() const;
+
+   /* Number of those that were shown not to contain the contour */
+   int pruned() const;
+};
+
+#endif
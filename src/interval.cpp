@@ -0,0 +1,241 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "interval.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+Interval Interval::entire() {
+   return { -INFINITY, INFINITY };
+}
+
+Interval Interval::empty() {
+   return { INFINITY, -INFINITY };
+}
+
+bool Interval::is_empty() const {
+   return lo > hi;
+}
+
+bool Interval::contains(double v) const {
+   return lo <= v && v <= hi;
+}
+
+/**
+ * Widens an interval by an ulp on both sides, to cover rounding in the operation that made it.
+ * Undefined bounds make it the entire line.
+ */
+static Interval outward(double lo, double hi) {
+   if (std::isnan(lo) || std::isnan(hi)) {
+      return Interval::entire();
+   }
+
+   return { std::nextafter(lo, -INFINITY), std::nextafter(hi, INFINITY) };
+}
+
+static Interval add(Interval a, Interval b) {
+   return outward(a.lo + b.lo, a.hi + b.hi);
+}
+
+static Interval sub(Interval a, Interval b) {
+   return outward(a.lo - b.hi, a.hi - b.lo);
+}
+
+static Interval mul(Interval a, Interval b) {
+   double p[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+   return outward(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+}
+
+static Interval div(Interval a, Interval b) {
+   if (b.lo == 0 && b.hi == 0) {
+      return Interval::empty();
+   } else if (b.contains(0)) {
+      return Interval::entire();
+   }
+
+   return mul(a, outward(1 / b.hi, 1 / b.lo));
+}
+
+static Interval abs(Interval a) {
+   if (a.contains(0)) {
+      return { 0, std::max(-a.lo, a.hi) };
+   }
+
+   return a.lo > 0 ? a : Interval{ -a.hi, -a.lo };
+}
+
+/**
+ * Raises an interval to an integer power.
+ */
+static Interval ipow(Interval a, int n) {
+   if (n == 0) {
+      return { 1, 1 };
+   } else if (n < 0) {
+      return div({ 1, 1 }, ipow(a, -n));
+   } else if (n % 2 == 1) {
+      return outward(std::pow(a.lo, n), std::pow(a.hi, n));
+   }
+
+   Interval m = abs(a);
+   return outward(std::pow(m.lo, n), std::pow(m.hi, n));
+}
+
+static Interval exp(Interval a) {
+   return outward(std::exp(a.lo), std::exp(a.hi));
+}
+
+/**
+ * Takes the log of the positive part of an interval. The rest is undefined.
+ */
+static Interval log(Interval a) {
+   if (a.hi <= 0) {
+      return Interval::empty();
+   }
+
+   return outward(a.lo <= 0 ? -INFINITY : std::log(a.lo), std::log(a.hi));
+}
+
+static Interval sqrt(Interval a) {
+   if (a.hi < 0) {
+      return Interval::empty();
+   }
+
+   return outward(std::sqrt(std::max(a.lo, 0.0)), std::sqrt(a.hi));
+}
+
+static Interval pow(Interval a, Interval b) {
+   if (b.lo == b.hi && b.lo == std::floor(b.lo) && std::fabs(b.lo) < 1024) {
+      return ipow(a, (int)b.lo);
+   } else if (a.lo < 0) {
+      // Negative bases only have real powers at some exponents.
+      return Interval::entire();
+   }
+
+   return exp(mul(b, log(a)));
+}
+
+static Interval sin(Interval a) {
+   if (!(a.hi - a.lo < 2 * M_PI)) {
+      return { -1, 1 };
+   }
+
+   double lo = std::min(std::sin(a.lo), std::sin(a.hi)),
+          hi = std::max(std::sin(a.lo), std::sin(a.hi));
+
+   // Peaks are at pi/2 + 2k pi, and troughs at -pi/2 + 2k pi.
+   if (std::floor((a.hi - M_PI / 2) / (2 * M_PI)) > std::floor((a.lo - M_PI / 2) / (2 * M_PI))) {
+      hi = 1;
+   }
+
+   if (std::floor((a.hi + M_PI / 2) / (2 * M_PI)) > std::floor((a.lo + M_PI / 2) / (2 * M_PI))) {
+      lo = -1;
+   }
+
+   return outward(lo, hi);
+}
+
+static Interval cos(Interval a) {
+   return sin(add(a, { M_PI / 2, M_PI / 2 }));
+}
+
+static Interval tan(Interval a) {
+   // Asymptotes are at pi/2 + k pi.
+   if (!(a.hi - a.lo < M_PI)
+       || std::floor((a.hi - M_PI / 2) / M_PI) > std::floor((a.lo - M_PI / 2) / M_PI)) {
+      return Interval::entire();
+   }
+
+   return outward(std::tan(a.lo), std::tan(a.hi));
+}
+
+Interval eval_interval(const Expr *expr, const Interval *args, const VarTable &vars) {
+   switch (expr->type) {
+   case NUMBER:
+      return { expr->val.number, expr->val.number };
+   case VARIABLE:
+      {
+         auto var = vars.find(expr->val.varname);
+         if (var == vars.end()) {
+            return Interval::entire();
+         }
+
+         return { var->second, var->second };
+      }
+   case ARGUMENT:
+      return args[expr->val.argindex];
+   case UNARY:
+      {
+         Interval inner = eval_interval(expr->val.unary->inner, args, vars);
+         if (inner.is_empty()) {
+            return inner;
+         }
+
+         return expr->val.unary->op == NEG ? Interval{ -inner.hi, -inner.lo } : abs(inner);
+      }
+   case BINARY:
+      {
+         Interval lhs = eval_interval(expr->val.binary->lhs, args, vars),
+                  rhs = eval_interval(expr->val.binary->rhs, args, vars);
+         if (lhs.is_empty() || rhs.is_empty()) {
+            return Interval::empty();
+         }
+
+         switch (expr->val.binary->op) {
+         case ADD: return add(lhs, rhs);
+         case SUB: return sub(lhs, rhs);
+         case MUL: return mul(lhs, rhs);
+         case DIV: return div(lhs, rhs);
+         case POW: return pow(lhs, rhs);
+         }
+      }
+      break;
+   case APPLY:
+      {
+         const Apply *apply = expr->val.apply;
+         if (apply->n_args != 1) {
+            break;
+         }
+
+         Interval arg = eval_interval(apply->args[0], args, vars);
+         if (arg.is_empty()) {
+            return arg;
+         }
+
+         const char *name = apply->funcname;
+         if (strcmp(name, "Sqrt") == 0) {
+            return sqrt(arg);
+         } else if (strcmp(name, "Log") == 0) {
+            return log(arg);
+         } else if (strcmp(name, "Sin") == 0) {
+            return sin(arg);
+         } else if (strcmp(name, "Cos") == 0) {
+            return cos(arg);
+         } else if (strcmp(name, "Tan") == 0) {
+            return tan(arg);
+         }
+      }
+      break;
+   case INTEGRAL:
+   case DERIVATIVE:
+      break;
+   }
+
+   return Interval::entire();
+}
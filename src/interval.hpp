@@ -0,0 +1,59 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef INTERVAL_HPP
+#define INTERVAL_HPP
+
+#include "compile.hpp"
+
+/* A closed range of real numbers, which an expression's value is known to lie in.
+ * The range is empty if lo > hi, which happens where the expression is undefined everywhere.
+ */
+struct Interval {
+   double lo, hi;
+
+   /**
+    * The interval of every real number, used whenever nothing better is known.
+    */
+   static Interval entire();
+
+   /**
+    * The interval with no numbers in it.
+    */
+   static Interval empty();
+
+   bool is_empty() const;
+
+   bool contains(double v) const;
+};
+
+/**
+ * Bounds an expression over a box of argument values with interval arithmetic.
+ * Every operation rounds outward, so the true range is always inside the result,
+ *  though the result may be much wider than the true range.
+ * User-defined functions should already have been inlined. Anything else unknown gives the entire line.
+ *
+ * @param expr The expression
+ * @param args The range of each argument
+ * @param vars The values of variables
+ *
+ * @return An interval containing every value the expression takes over the box
+ */
+Interval eval_interval(const Expr *expr, const Interval *args, const VarTable &vars);
+
+#endif
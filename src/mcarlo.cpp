@@ -0,0 +1,307 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "mcarlo.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+MCEngine::MCEngine(ThreadPool &_pool)
+   : pool(_pool),
+     rt(nullptr),
+     kernel(nullptr),
+     params({ 0, 0, 0, 0, 0, 0, 0, 0, 1 }),
+     batch(nullptr),
+     settings({ 0, 0, 0, 0, 0, false, false, 0 }),
+     source(RANDOM),
+     sampling(false),
+     stopping(false),
+     finished(false),
+     view_width(0),
+     view_height(0),
+     view_xmin(0),
+     view_xmax(1),
+     view_ymin(0),
+     view_ymax(1)
+{
+   clear();
+}
+
+MCEngine::~MCEngine() {
+   stop();
+   release();
+}
+
+void MCEngine::release() {
+   if (kernel != nullptr) {
+      rt->release(kernel);
+      kernel = nullptr;
+   }
+
+   if (batch != nullptr) {
+      rt->release(batch);
+      batch = nullptr;
+   }
+}
+
+void MCEngine::clear() {
+   {
+      std::lock_guard<std::mutex> guard(count_lock);
+      n_samples = 0;
+      std::fill(sums, sums + MC_REPLICATES, 0);
+   }
+
+   std::lock_guard<std::mutex> guard(density_lock);
+   density.clear();
+}
+
+void MCEngine::set_expr(const Expr *expr,
+                        KernelSource _source,
+                        JitRuntime &_rt,
+                        const ExecCtx &ectx) {
+   stop();
+   release();
+
+   rt = &_rt;
+   source = _source;
+   kernel = conv_reduce(expr, source, _rt, ectx);
+   batch = conv_expr_batch(expr, 1, _rt, ectx);
+   clear();
+}
+
+void MCEngine::reset(const MCSettings &_settings) {
+   stop();
+   settings = _settings;
+   params = { 0, 0, 0,
+              settings.xmin, settings.xmax - settings.xmin,
+              settings.ymin, settings.ymax - settings.ymin,
+              settings.seed,
+              (uint64_t)(settings.stratify ? MC_STRATA : 1) };
+   clear();
+}
+
+void MCEngine::set_view(int width, int height,
+                        double xmin, double xmax, double ymin, double ymax) {
+   stop();
+   view_width = width;
+   view_height = height;
+   view_xmin = xmin;
+   view_xmax = xmax;
+   view_ymin = ymin;
+   view_ymax = ymax;
+
+   std::lock_guard<std::mutex> guard(density_lock);
+   density.resize(width, height);
+}
+
+void MCEngine::tone_map(uint8_t *pixels, int rowstride) const {
+   std::lock_guard<std::mutex> guard(density_lock);
+   density.tone_map(pixels, rowstride);
+}
+
+uint64_t MCEngine::replicate_seed(int r) const {
+   return splitmix_at(params.seed, r);
+}
+
+void MCEngine::point(int64_t n, double *x, double *y) const {
+   uint64_t seed = replicate_seed(n % MC_REPLICATES);
+   int64_t i = n / MC_REPLICATES;
+
+   if (source == SOBOL) {
+      *x = params.xmin + sobol_at(seed, i, 0) * params.xrange;
+      *y = params.ymin + sobol_at(seed, i, 1) * params.yrange;
+   } else {
+      // The same arithmetic as the kernel
+      double col = (double)(i & (params.strata - 1));
+      *x = params.xmin + (col + uniform_at(seed, 2 * i)) * (params.xrange / params.strata);
+      *y = params.ymin + uniform_at(seed, 2 * i + 1) * params.yrange;
+   }
+}
+
+void MCEngine::classify(int r, int64_t lo, int64_t hi, uint32_t *out) const {
+   int64_t n = hi - lo;
+   std::vector<double> xs(n), ys(n), fs(n);
+   for (int64_t i = 0; i < n; i++) {
+      point((lo + i) * MC_REPLICATES + r, &xs[i], &ys[i]);
+   }
+
+   // The function is evaluated a whole block at a time.
+   const double *args[] = { xs.data() };
+   batch(args, fs.data(), n);
+
+   for (int64_t i = 0; i < n; i++) {
+      int col = (int) (view_width * (xs[i] - view_xmin) / (view_xmax - view_xmin)),
+          row = (int) (view_height * (1 - (ys[i] - view_ymin) / (view_ymax - view_ymin)));
+      if (col < 0 || col >= view_width || row < 0 || row >= view_height) {
+         out[i] = UINT32_MAX;
+         continue;
+      }
+
+      SampleKind kind = MISS;
+      if (0 < ys[i] && ys[i] < fs[i]) {
+         kind = POS_HIT;
+      } else if (fs[i] < ys[i] && ys[i] < 0) {
+         kind = NEG_HIT;
+      }
+
+      out[i] = ((uint32_t) row * view_width + col) * 3 + kind;
+   }
+}
+
+void MCEngine::sample(int64_t n) {
+   int64_t per_replicate = (n + MC_REPLICATES - 1) / MC_REPLICATES;
+   per_replicate = (per_replicate + params.strata - 1) / params.strata * params.strata;
+
+   int64_t begin = samples() / MC_REPLICATES,
+           n_blocks = (per_replicate + MC_BLOCK - 1) / MC_BLOCK;
+
+   // Each block writes only its own slot, and the slots are added up in order afterwards,
+   // so the totals don't depend on which thread finished first.
+   std::vector<double> partials(MC_REPLICATES * n_blocks);
+   bool counting = view_width > 0 && view_height > 0 && batch != nullptr;
+   std::vector<uint32_t> codes(counting ? MC_REPLICATES * n_blocks * MC_BLOCK : 0, UINT32_MAX);
+   pool.run(MC_REPLICATES * n_blocks, [&](int64_t k) {
+      int r = k / n_blocks;
+      int64_t lo = begin + (k % n_blocks) * MC_BLOCK,
+              hi = std::min(lo + MC_BLOCK, begin + per_replicate);
+
+      KernelParams p = params;
+      p.seed = replicate_seed(r);
+
+      Reduction res = run_reduce(kernel, p, lo, hi);
+      partials[k] = settings.importance ? res.height : res.hits;
+
+      if (counting) {
+         classify(r, lo, hi, &codes[k * MC_BLOCK]);
+      }
+   });
+
+   // Counting in block order keeps the map the same for any number of threads.
+   if (counting) {
+      std::lock_guard<std::mutex> guard(density_lock);
+      for (uint32_t code: codes) {
+         if (code != UINT32_MAX) {
+            uint32_t pixel = code / 3;
+            density.add(pixel % view_width, pixel / view_width, (SampleKind) (code % 3));
+         }
+      }
+   }
+
+   std::lock_guard<std::mutex> guard(count_lock);
+   n_samples += per_replicate * MC_REPLICATES;
+   for (int64_t k = 0; k < MC_REPLICATES * n_blocks; k++) {
+      sums[k / n_blocks] += partials[k];
+   }
+}
+
+void MCEngine::run() {
+   int64_t batch = (int64_t) MC_BATCH_BLOCKS * MC_BLOCK;
+   while (!stopping && !converged()) {
+      sample(batch);
+   }
+
+   finished = true;
+}
+
+void MCEngine::start() {
+   if (sampling) {
+      if (!finished) {
+         return;
+      }
+
+      stop();
+   }
+
+   if (kernel == nullptr || converged()) {
+      return;
+   }
+
+   stopping = false;
+   finished = false;
+   sampling = true;
+   worker = std::thread(&MCEngine::run, this);
+}
+
+void MCEngine::stop() {
+   if (!sampling) {
+      return;
+   }
+
+   stopping = true;
+   worker.join();
+   sampling = false;
+}
+
+bool MCEngine::running() const {
+   return sampling && !finished;
+}
+
+bool MCEngine::converged() const {
+   return settings.tolerance > 0
+       && samples() >= MC_MIN_SAMPLES
+       && half_width() <= settings.tolerance;
+}
+
+int64_t MCEngine::samples() const {
+   std::lock_guard<std::mutex> guard(count_lock);
+   return n_samples;
+}
+
+double MCEngine::area() const {
+   std::lock_guard<std::mutex> guard(count_lock);
+   if (n_samples == 0) {
+      return 0;
+   }
+
+   double total = 0;
+   for (double sum: sums) {
+      total += sum;
+   }
+
+   return params.xrange * params.yrange * (total / n_samples);
+}
+
+double MCEngine::error() const {
+   std::lock_guard<std::mutex> guard(count_lock);
+   if (n_samples == 0) {
+      return NAN;
+   }
+
+   // The sequences are independent, so the spread of their estimates
+   // gives the error of their mean.
+   double points = (double) n_samples / MC_REPLICATES,
+          box = params.xrange * params.yrange,
+          mean = 0, var = 0;
+   for (double sum: sums) {
+      mean += box * sum / points;
+   }
+
+   mean /= MC_REPLICATES;
+   for (double sum: sums) {
+      double d = box * sum / points - mean;
+      var += d * d;
+   }
+
+   return std::sqrt(var / (MC_REPLICATES - 1) / MC_REPLICATES);
+}
+
+double MCEngine::half_width() const {
+   return MC_T95 * error();
+}
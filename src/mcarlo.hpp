@@ -0,0 +1,242 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef MCARLO_HPP
+#define MCARLO_HPP
+
+#include "compile.hpp"
+#include "density.hpp"
+#include "reduce.hpp"
+#include "threadpool.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* Number of samples in each block handed to a thread. */
+#define MC_BLOCK (1 << 14)
+
+/* Number of blocks in each batch the background sampler takes.
+ * Fixed, so that the batches, and so the results, are the same on any machine.
+ */
+#define MC_BATCH_BLOCKS 64
+
+/* Number of independent sequences sampled side by side.
+ * The spread of their estimates gives the error estimate.
+ */
+#define MC_REPLICATES 8
+
+/* Student's t quantile for a 95% confidence interval with MC_REPLICATES - 1 degrees of freedom */
+#define MC_T95 2.365
+
+/* Number of x columns in stratified sampling */
+#define MC_STRATA 256
+
+/* The fewest samples the error estimate is trusted for when stopping automatically */
+#define MC_MIN_SAMPLES (MC_REPLICATES * MC_BLOCK)
+
+/* What to sample, and when to stop */
+struct MCSettings {
+   /* The box samples are taken from */
+   double xmin, xmax, ymin, ymax;
+
+   uint64_t seed;
+
+   /* Should every x column get an equal share of the samples? Only used for random points. */
+   bool stratify;
+
+   /* Should y be sampled only between the axis and the curve, weighting each sample
+    * by the height of that interval? This is the best possible density for y,
+    * and leaves only the variance in x.
+    */
+   bool importance;
+
+   /* The background sampler stops once the 95% confidence interval is narrower than
+    * this on either side. 0 to keep going.
+    */
+   double tolerance;
+};
+
+/* Estimates the signed area between a function and the x axis by sampling a box.
+ * Sample i is always the same point for a given seed, so runs are reproducible
+ * no matter how many threads take part.
+ * Every sample is also counted in a density map of the window it's drawn in.
+ */
+class MCEngine {
+   ThreadPool &pool;
+
+   JitRuntime *rt;
+   ReduceFunc kernel;
+   KernelParams params;
+
+   /* The function itself, to tell where each sample fell in the density map */
+   BatchFunc batch;
+   MCSettings settings;
+
+   /* RANDOM for pseudo-random points, SOBOL for quasi-random ones */
+   KernelSource source;
+
+   /* The background sampler, if there is one */
+   std::thread worker;
+   std::atomic<bool> sampling, stopping, finished;
+
+   /* Samples taken, and the sum of their values in each sequence.
+    * Sample i is point i / MC_REPLICATES of sequence i % MC_REPLICATES.
+    * Only updated together, between batches.
+    */
+   mutable std::mutex count_lock;
+   int64_t n_samples;
+   double sums[MC_REPLICATES];
+
+   /* How many samples fell in each pixel of the window, and the window's bounds.
+    * Each block of samples is classified on its own thread, and the blocks are
+    * counted in order after each batch.
+    */
+   DensityMap density;
+   int view_width, view_height;
+   double view_xmin, view_xmax, view_ymin, view_ymax;
+   mutable std::mutex density_lock;
+
+   /**
+    * Gets the seed of one of the sequences.
+    */
+   uint64_t replicate_seed(int r) const;
+
+   /**
+    * Sets all the counts to zero.
+    */
+   void clear();
+
+   /**
+    * Releases the compiled kernel.
+    */
+   void release();
+
+   /**
+    * Takes batches of samples until stopped or converged.
+    */
+   void run();
+
+   /**
+    * Works out which pixel of the density map each sample of a block fell in, and how.
+    *
+    * @param r The sequence
+    * @param lo The first point of the sequence
+    * @param hi One past the last point
+    * @param out Where to put one code per sample: 3 times the pixel's index plus its
+    *            SampleKind, or UINT32_MAX if it's outside the window
+    */
+   void classify(int r, int64_t lo, int64_t hi, uint32_t *out) const;
+
+public:
+   /**
+    * @param pool The threads to take samples on
+    */
+   MCEngine(ThreadPool &pool = ThreadPool::background());
+
+   ~MCEngine();
+
+   MCEngine(const MCEngine &) = delete;
+
+   /**
+    * Compiles the function to sample. Stops the sampler and starts over.
+    *
+    * @param source RANDOM or SOBOL
+    */
+   void set_expr(const Expr *expr,
+                 KernelSource source,
+                 JitRuntime &rt,
+                 const ExecCtx &ectx);
+
+   /**
+    * Changes what is sampled. Stops the sampler and starts over.
+    */
+   void reset(const MCSettings &settings);
+
+   /**
+    * Sets the window samples are counted in, clearing the density map.
+    * Stops the sampler.
+    *
+    * @param width, height The size of the window in pixels
+    * @param xmin, xmax, ymin, ymax The bounds of the window
+    */
+   void set_view(int width, int height, double xmin, double xmax, double ymin, double ymax);
+
+   /**
+    * Draws the density map into an RGBA image the size of the window.
+    */
+   void tone_map(uint8_t *pixels, int rowstride) const;
+
+   /**
+    * Gets the point a sample is taken at. With importance sampling,
+    * y is where the sample would be in the whole box.
+    *
+    * @param n The index of the sample
+    * @param x, y Where to put the coordinates
+    */
+   void point(int64_t n, double *x, double *y) const;
+
+   /**
+    * Takes the next n samples on the calling thread and the pool.
+    * n is rounded up so that every sequence, and every column, gets the same number.
+    * Must not be called while the background sampler is running.
+    */
+   void sample(int64_t n);
+
+   /**
+    * Starts taking samples in the background, unless it already is
+    * or the tolerance has been met.
+    */
+   void start();
+
+   /**
+    * Stops the background sampler, if it's running.
+    */
+   void stop();
+
+   /**
+    * Is the background sampler running?
+    */
+   bool running() const;
+
+   /**
+    * Has the estimate met the tolerance?
+    */
+   bool converged() const;
+
+   /**
+    * Gets the number of samples taken so far.
+    */
+   int64_t samples() const;
+
+   /**
+    * Gets the current estimate of the area.
+    */
+   double area() const;
+
+   /**
+    * Gets the standard error of the estimate, or NaN before any samples are taken.
+    */
+   double error() const;
+
+   /**
+    * Gets the half-width of the 95% confidence interval around the estimate.
+    */
+   double half_width() const;
+};
+
+#endif
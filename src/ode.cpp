@@ -0,0 +1,258 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "ode.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace asmjit;
+
+/* The Dormand-Prince tableau. The last row of A is also the 5th order solution. */
+static const double C[7] = { 0, 1.0 / 5, 3.0 / 10, 4.0 / 5, 8.0 / 9, 1, 1 };
+
+static const double A[7][6] = {
+   { 0 },
+   { 1.0 / 5 },
+   { 3.0 / 40, 9.0 / 40 },
+   { 44.0 / 45, -56.0 / 15, 32.0 / 9 },
+   { 19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729 },
+   { 9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656 },
+   { 35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84 }
+};
+
+/* The 5th order solution minus the embedded 4th order one */
+static const double E[7] = {
+   71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40
+};
+
+/* Coefficients of the dense output, from Hairer and Wanner's DOPRI5 */
+static const double D[7] = {
+   -12715105075.0 / 11282082432, 0, 87487479700.0 / 32700410799, -10690763975.0 / 1880347072,
+   701980252875.0 / 199316789632, -1453857185.0 / 822651844, 69997945.0 / 29380423
+};
+
+StepCtx::StepCtx(JitRuntime &_rt,
+                 CodeHolder &_code,
+                 const ExecCtx &_ectx)
+   : CompCtx(_rt, _code, _ectx,
+             FuncSignatureT<void, const double *, double *>())
+{
+   in = cc.newIntPtr();
+   out = cc.newIntPtr();
+
+   func->setArg(0, in);
+   func->setArg(1, out);
+
+   args.push_back(cc.newXmm());
+}
+
+void StepCtx::conv_step(const Expr *expr) {
+   x86::Xmm x0 = cc.newXmm(),
+            y0 = cc.newXmm(),
+            h = cc.newXmm(),
+            t = cc.newXmm(),
+            sum = cc.newXmm();
+
+   cc.movsd(x0, x86::ptr(in, 0));
+   cc.movsd(y0, x86::ptr(in, 8));
+   cc.movsd(h, x86::ptr(in, 16));
+
+   std::vector<x86::Xmm> k;
+   k.push_back(cc.newXmm());
+   cc.movsd(k[0], x86::ptr(in, 24));
+
+   // Adds the stages, weighted by a row of coefficients, into sum.
+   auto weigh = [&](const double *weights, int n) {
+      cc.xorpd(sum, sum);
+      for (int j = 0; j < n; j++) {
+         if (weights[j] != 0) {
+            cc.movsd(t, cc.newDoubleConst(ConstPoolScope::kLocal, weights[j]));
+            cc.mulsd(t, k[j]);
+            cc.addsd(sum, t);
+         }
+      }
+   };
+
+   for (int s = 1; s < 7; s++) {
+      // x = x0 + c h
+      cc.movsd(args[0], cc.newDoubleConst(ConstPoolScope::kLocal, C[s]));
+      cc.mulsd(args[0], h);
+      cc.addsd(args[0], x0);
+
+      // y = y0 + h (a_1 k1 + ... + a_s ks)
+      weigh(A[s], s);
+      cc.mulsd(sum, h);
+      cc.addsd(sum, y0);
+      cc.movsd(args[1], sum);
+
+      if (s == 6) {
+         cc.movsd(x86::ptr(out, 0), sum);
+      }
+
+      conv_expr_rec(expr);
+      k.push_back(cc.newXmm());
+      cc.movsd(k[s], y);
+      cc.movsd(x86::ptr(out, 8 * (s + 1)), k[s]);
+   }
+
+   weigh(E, 7);
+   cc.mulsd(sum, h);
+   cc.movsd(x86::ptr(out, 8), sum);
+}
+
+StepFunc StepCtx::end() {
+   cc.ret();
+   cc.endFunc();
+   cc.finalize();
+
+   StepFunc fn;
+   Error err = rt.add(&fn, &code);
+   if (err) {
+      printf("AsmJit failed: %s\n", DebugUtils::errorAsString(err));
+      exit(1);
+   }
+
+   return fn;
+}
+
+StepFunc conv_ode_step(const Expr *expr, JitRuntime &rt, const ExecCtx &ectx) {
+   CodeHolder code;
+   code.init(rt.environment(), rt.cpuFeatures());
+
+   StepCtx ctx(rt, code, ectx);
+   ctx.conv_step(expr);
+
+   return ctx.end();
+}
+
+ODESolution::ODESolution()
+   : x0(0), x1(0), complete(false)
+{}
+
+ODESolution::ODESolution(StepFunc step, double _x0, double y0, double x_end, double tol)
+   : x0(_x0), x1(_x0), complete(x_end == _x0)
+{
+   double in[4], out[8];
+
+   // With a step of 0, every stage is evaluated at (x0, y0), so k2 is F(x0, y0).
+   in[0] = x0;
+   in[1] = y0;
+   in[2] = 0;
+   in[3] = 0;
+   step(in, out);
+   double k1 = out[2];
+
+   double x = x0, y = y0,
+          h = ODE_FIRST_STEP * (x_end - x0);
+
+   for (int i = 0; i < ODE_MAX_STEPS && !complete; i++) {
+      if (!std::isfinite(y) || !std::isfinite(k1)) {
+         break;
+      }
+
+      // The last step lands exactly on the end.
+      bool last = std::fabs(h) >= std::fabs(x_end - x);
+      if (last) {
+         h = x_end - x;
+      }
+
+      in[0] = x;
+      in[1] = y;
+      in[2] = h;
+      in[3] = k1;
+      step(in, out);
+
+      double y1 = out[0],
+             scale = tol + tol * std::max(std::fabs(y), std::fabs(y1)),
+             err = std::fabs(out[1]) / scale;
+
+      if (!std::isfinite(err)) {
+         // Something blew up inside the step. Try again with a smaller one.
+         h *= ODE_MIN_SCALE;
+      } else if (err <= 1) {
+         double k[7] = { k1, out[2], out[3], out[4], out[5], out[6], out[7] };
+         double ydiff = y1 - y,
+                bspl = h * k[0] - ydiff,
+                dense = 0;
+         for (int j = 0; j < 7; j++) {
+            dense += D[j] * k[j];
+         }
+
+         steps.push_back({ x, h, { y, ydiff, bspl, ydiff - h * k[6] - bspl, h * dense } });
+
+         x = last ? x_end : x + h;
+         y = y1;
+         k1 = k[6];
+         x1 = x;
+         complete = last;
+      }
+
+      // The error of a 5th order step scales with h^5.
+      if (std::isfinite(err)) {
+         double factor = err == 0 ? ODE_MAX_SCALE : 0.9 * std::pow(err, -0.2);
+         h *= std::min(ODE_MAX_SCALE, std::max(ODE_MIN_SCALE, factor));
+      }
+
+      if (std::fabs(h) <= 1e-14 * std::max(std::fabs(x), 1.0)) {
+         break;
+      }
+   }
+}
+
+double ODESolution::at(double x) const {
+   if (steps.empty() || std::isnan(x)) {
+      return NAN;
+   }
+
+   // The steps run away from x0 in whichever direction the solution went.
+   double dir = steps[0].h > 0 ? 1 : -1;
+   if (dir * (x - x0) < 0 || dir * (x - x1) > 0) {
+      return NAN;
+   }
+
+   // The last step starting at or before x
+   auto it = std::upper_bound(steps.begin(), steps.end(), x,
+                              [dir](double x, const ODEStep &st) {
+                                 return dir * x < dir * st.x;
+                              });
+   const ODEStep &st = *(it == steps.begin() ? it : it - 1);
+
+   double theta = (x - st.x) / st.h,
+          theta1 = 1 - theta;
+   const double *r = st.rcont;
+   return r[0] + theta * (r[1] + theta1 * (r[2] + theta * (r[3] + theta1 * r[4])));
+}
+
+size_t ODESolution::n_steps() const {
+   return steps.size();
+}
+
+std::vector<ODESolution> solve_ode_many(StepFunc step,
+                                        double x0,
+                                        const std::vector<double> &y0s,
+                                        double x_end,
+                                        double tol) {
+   std::vector<ODESolution> solutions(y0s.size());
+   ThreadPool::shared().run(y0s.size(), [&](int64_t i) {
+      solutions[i] = ODESolution(step, x0, y0s[i], x_end, tol);
+   });
+
+   return solutions;
+}
@@ -0,0 +1,148 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef ODE_HPP
+#define ODE_HPP
+
+#include "compile.hpp"
+#include <vector>
+
+/* Default tolerance on the error of each step, both absolute and relative to y */
+#define ODE_TOL 1e-8
+
+/* The first step tried is this fraction of the interval */
+#define ODE_FIRST_STEP 1e-2
+
+/* Most steps taken for one solution */
+#define ODE_MAX_STEPS 100000
+
+/* Most initial values the grapher solves from at once */
+#define ODE_MAX_CURVES 64
+
+/* Limits on how much the step size changes at once */
+#define ODE_MIN_SCALE 0.2
+#define ODE_MAX_SCALE 5.0
+
+/* A compiled Dormand-Prince step of y' = F(x, y).
+ * in holds x, y, the step h, and k1 = F(x, y).
+ * out receives the new y, the estimate of its error, and the stages k2 to k7.
+ * k7 is F(x + h, y_new), which is the k1 of the next step.
+ */
+typedef void (*StepFunc)(const double *in, double *out);
+
+/* A class to store information for the compilation of a Dormand-Prince step.
+ * Every stage is evaluated in the same function, with the right-hand side inlined each time.
+ */
+class StepCtx : public CompCtx {
+public:
+   StepCtx(JitRuntime &rt,
+           CodeHolder &code,
+           const ExecCtx &ectx);
+
+   /**
+    * Compiles all the stages of a step.
+    *
+    * @param expr The right-hand side, with x as its first parameter and y as its second
+    */
+   void conv_step(const Expr *expr);
+
+   /**
+    * Finalizes the compiler
+    *
+    * @return The compiled step
+    */
+   StepFunc end();
+
+private:
+   x86::Gp in, out;
+};
+
+/**
+ * Compiles a Dormand-Prince step for y' = F(x, y).
+ *
+ * @param expr The right-hand side, with x as its first parameter and y as its second
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled step
+ */
+StepFunc conv_ode_step(const Expr *expr, JitRuntime &rt, const ExecCtx &ectx);
+
+/* An accepted step of a solution, with the coefficients of its interpolating polynomial */
+struct ODEStep {
+   double x, h;
+   double rcont[5];
+};
+
+/* A solution of y' = F(x, y), which can be evaluated anywhere it reached */
+class ODESolution {
+   std::vector<ODEStep> steps;
+
+public:
+   /* Where the solution starts, and how far it got */
+   double x0, x1;
+
+   /* Did it reach the end of the interval it was asked for? */
+   bool complete;
+
+   /**
+    * Solves y' = F(x, y) with the adaptive Dormand-Prince method, RK5(4).
+    * x_end may be less than x0, to solve backwards.
+    * Stops early if the solution blows up or the steps get too small.
+    *
+    * @param step The compiled step
+    * @param x0 The initial x
+    * @param y0 y(x0)
+    * @param x_end Where to stop
+    * @param tol The error tolerance of each step
+    */
+   ODESolution(StepFunc step, double x0, double y0, double x_end, double tol = ODE_TOL);
+
+   ODESolution();
+
+   /**
+    * Evaluates the solution with the dense output of the step containing x.
+    *
+    * @return y(x), or NaN if the solution didn't reach x
+    */
+   double at(double x) const;
+
+   /**
+    * Gets the number of steps taken.
+    */
+   size_t n_steps() const;
+};
+
+/**
+ * Solves y' = F(x, y) from many initial values at once, across the thread pool.
+ *
+ * @param step The compiled step
+ * @param x0 The initial x
+ * @param y0s The values of y(x0)
+ * @param x_end Where to stop
+ * @param tol The error tolerance of each step
+ *
+ * @return The solutions, in the same order as y0s
+ */
+std::vector<ODESolution> solve_ode_many(StepFunc step,
+                                        double x0,
+                                        const std::vector<double> &y0s,
+                                        double x_end,
+                                        double tol = ODE_TOL);
+
+#endif
@@ -20,7 +20,7 @@
    #include "../src/expr.h"
    #include "lexer.h"
 
-   void yyerror(Expr **, char **, char **, char **err, const char *s);
+   void yyerror(Expr **, char **, char **, int *, char **err, Query *, const char *s);
 
 
 %}
@@ -34,17 +34,19 @@
 %parse-param {Expr **root}
 %parse-param {char **funcname}
 %parse-param {char **varname}
+%parse-param {int *arity}
 %parse-param {char **err}
+%parse-param {Query *query}
 
 %define parse.error detailed
 
-%token NUM VAR ARG FUNC ENDL
+%token NUM VAR ARG FUNC INTEG DERIV ROOTS EXTREMA SUM LIMIT ENDL
 
 %nonassoc '=' '+' '-' '*' '/' '^'
 
 %type <fval> NUM
 %type <sval> FUNC VAR
-%type <expr> isolate pow cmul neg mul expr stmt
+%type <expr> isolate args pow cmul neg mul expr stmt
 
 %destructor { free($$); } FUNC VAR
 
@@ -55,6 +57,18 @@ stmt:
       {
          *funcname = $1;
          *root = $$ = $3;
+         YYABORT;
+      }
+   | FUNC '(' args ')' '=' expr ENDL
+      {
+         *funcname = $1;
+         *root = $$ = $6;
+         *arity = bind_params($6, $3->val.apply);
+         destroy_expr($3);
+         if (*arity < 0) {
+            *err = strdup("parameters must be distinct names, and include x if it is used");
+         }
+
          YYABORT;
       }
    | VAR '=' expr ENDL
@@ -68,6 +82,37 @@ stmt:
          *root = $$ = $1;
          YYABORT;
       }
+   | ROOTS '(' FUNC ',' expr ',' expr ')' ENDL
+      {
+         // The bounds are kept as the arguments of an application with no function.
+         *funcname = $3;
+         *query = ROOTS_QUERY;
+         *root = $$ = new_apply(NULL, $5);
+         push_apply_arg($$, $7);
+         YYABORT;
+      }
+   | EXTREMA '(' FUNC ',' expr ',' expr ')' ENDL
+      {
+         *funcname = $3;
+         *query = EXTREMA_QUERY;
+         *root = $$ = new_apply(NULL, $5);
+         push_apply_arg($$, $7);
+         YYABORT;
+      }
+   | SUM '(' FUNC ',' expr ')' ENDL
+      {
+         *funcname = $3;
+         *query = SUM_QUERY;
+         *root = $$ = new_apply(NULL, $5);
+         YYABORT;
+      }
+   | LIMIT '(' FUNC ',' expr ')' ENDL
+      {
+         *funcname = $3;
+         *query = LIMIT_QUERY;
+         *root = $$ = new_apply(NULL, $5);
+         YYABORT;
+      }
    ;
 
 isolate:
@@ -91,9 +136,10 @@ isolate:
       {
          *root = $$ = new_unary(ABS, $2);
       }
-   | FUNC '(' expr ')'
+   | FUNC '(' args ')'
       {
-         *root = $$ = new_apply($1, $3);
+         $3->val.apply->funcname = $1;
+         *root = $$ = $3;
       }
    | FUNC '[' expr ']'
       {
@@ -103,6 +149,41 @@ isolate:
       {
          *root = $$ = new_apply($1, new_num_expr(0));
       }
+   | INTEG '(' FUNC ',' expr ',' expr ')'
+      {
+         *root = $$ = new_integral($3, $5, $7);
+      }
+   | DERIV '(' FUNC ')'
+      {
+         *root = $$ = new_deriv($3, 1);
+      }
+   | DERIV '(' FUNC ',' NUM ')'
+      {
+         // Checked before the cast, which is undefined for numbers too big for an int
+         if (!($5 >= 1 && $5 <= DERIV_MAX_ORDER) || $5 != (int)$5) {
+            char msg[80];
+            snprintf(msg, sizeof(msg),
+                     "the order of a derivative must be a whole number from 1 to %d",
+                     DERIV_MAX_ORDER);
+            *err = strdup(msg);
+            free($3);
+            YYABORT;
+         }
+
+         *root = $$ = new_deriv($3, (int)$5);
+      }
+   ;
+
+args:
+     expr
+      {
+         *root = $$ = new_apply(NULL, $1);
+      }
+   | args ',' expr
+      {
+         push_apply_arg($1, $3);
+         *root = $$ = $1;
+      }
    ;
 
 pow:
@@ -174,7 +255,7 @@ expr:
 
 %%
 
-void yyerror(Expr **, char **, char **, char **err, const char *s) {
+void yyerror(Expr **, char **, char **, int *, char **err, Query *, const char *s) {
    *err = strdup(s);
 }
 
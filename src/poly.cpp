@@ -0,0 +1,543 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "poly.hpp"
+#include "roots.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Polynomial::Polynomial() {}
+
+Polynomial::Polynomial(std::vector<double> _coeffs) : coeffs(_coeffs) {
+   trim();
+}
+
+void Polynomial::trim() {
+   while (!coeffs.empty() && coeffs.back() == 0) {
+      coeffs.pop_back();
+   }
+}
+
+int Polynomial::degree() const {
+   return (int)coeffs.size() - 1;
+}
+
+const std::vector<double> &Polynomial::get_coeffs() const {
+   return coeffs;
+}
+
+double Polynomial::operator()(double x) const {
+   double y = 0;
+   for (size_t k = coeffs.size(); k-- > 0;) {
+      y = y * x + coeffs[k];
+   }
+
+   return y;
+}
+
+Polynomial Polynomial::operator+(const Polynomial &other) const {
+   std::vector<double> sum(std::max(coeffs.size(), other.coeffs.size()), 0);
+   for (size_t k = 0; k < coeffs.size(); k++) {
+      sum[k] += coeffs[k];
+   }
+
+   for (size_t k = 0; k < other.coeffs.size(); k++) {
+      sum[k] += other.coeffs[k];
+   }
+
+   return Polynomial(sum);
+}
+
+Polynomial Polynomial::operator-(const Polynomial &other) const {
+   return *this + other * -1;
+}
+
+Polynomial Polynomial::operator*(const Polynomial &other) const {
+   if (coeffs.empty() || other.coeffs.empty()) {
+      return Polynomial();
+   }
+
+   std::vector<double> product(coeffs.size() + other.coeffs.size() - 1, 0);
+   for (size_t i = 0; i < coeffs.size(); i++) {
+      for (size_t j = 0; j < other.coeffs.size(); j++) {
+         product[i + j] += coeffs[i] * other.coeffs[j];
+      }
+   }
+
+   return Polynomial(product);
+}
+
+Polynomial Polynomial::operator*(double factor) const {
+   std::vector<double> scaled = coeffs;
+   for (double &c: scaled) {
+      c *= factor;
+   }
+
+   return Polynomial(scaled);
+}
+
+Polynomial Polynomial::operator/(double divisor) const {
+   std::vector<double> scaled = coeffs;
+   for (double &c: scaled) {
+      c /= divisor;
+   }
+
+   return Polynomial(scaled);
+}
+
+Polynomial Polynomial::derivative() const {
+   std::vector<double> deriv;
+   for (size_t k = 1; k < coeffs.size(); k++) {
+      deriv.push_back(k * coeffs[k]);
+   }
+
+   return Polynomial(deriv);
+}
+
+Polynomial Polynomial::antiderivative() const {
+   std::vector<double> anti = { 0 };
+   for (size_t k = 0; k < coeffs.size(); k++) {
+      anti.push_back(coeffs[k] / (k + 1));
+   }
+
+   return Polynomial(anti);
+}
+
+double Polynomial::integral(double a, double b) const {
+   Polynomial anti = antiderivative();
+   return anti(b) - anti(a);
+}
+
+double Polynomial::clamped_integral(double a, double b, double lo, double hi) const {
+   if (b < a) {
+      return -clamped_integral(b, a, lo, hi);
+   }
+
+   // Between consecutive cuts, the polynomial stays below, inside, or above the range.
+   std::vector<double> cuts = { a, b };
+   for (double level: { lo, hi }) {
+      for (double x: (*this - Polynomial({ level })).roots(a, b)) {
+         cuts.push_back(x);
+      }
+   }
+
+   std::sort(cuts.begin(), cuts.end());
+
+   double total = 0;
+   for (size_t k = 0; k + 1 < cuts.size(); k++) {
+      double x0 = cuts[k],
+             x1 = cuts[k + 1];
+      if (x1 <= x0) {
+         continue;
+      }
+
+      double y = (*this)((x0 + x1) / 2);
+      if (y <= lo) {
+         total += lo * (x1 - x0);
+      } else if (y >= hi) {
+         total += hi * (x1 - x0);
+      } else {
+         total += integral(x0, x1);
+      }
+   }
+
+   return total;
+}
+
+/**
+ * Builds the Sturm sequence of a polynomial: the polynomial, its derivative,
+ *  and then the negated remainder of each division of one by the next, until it's 0.
+ * Each is scaled so that its largest coefficient is 1, which keeps the signs.
+ */
+static std::vector<Polynomial> sturm_sequence(const Polynomial &p) {
+   auto normalize = [](const Polynomial &q) {
+      double top = 0;
+      for (double c: q.get_coeffs()) {
+         top = std::max(top, std::fabs(c));
+      }
+
+      return q / top;
+   };
+
+   std::vector<Polynomial> seq = { normalize(p) };
+   Polynomial next = p.derivative();
+   while (next.degree() >= 0) {
+      seq.push_back(normalize(next));
+
+      const std::vector<double> &u = seq[seq.size() - 2].get_coeffs(),
+                                &v = seq.back().get_coeffs();
+      int m = (int)v.size() - 1;
+      std::vector<double> rem = u;
+      for (int k = (int)u.size() - 1 - m; k >= 0; k--) {
+         double q = rem[k + m] / v[m];
+         for (int j = 0; j <= m; j++) {
+            rem[k + j] -= q * v[j];
+         }
+      }
+
+      // What's left of the top coefficients is rounding error, since the divisor's largest is 1.
+      rem.resize(m);
+      while (!rem.empty() && std::fabs(rem.back()) <= POLY_EPS) {
+         rem.pop_back();
+      }
+
+      next = Polynomial(rem) * -1;
+   }
+
+   return seq;
+}
+
+/**
+ * Counts the sign changes along a Sturm sequence at a point, skipping zeros.
+ */
+static int sign_changes(const std::vector<Polynomial> &seq, double x) {
+   int changes = 0;
+   double last = 0;
+   for (const Polynomial &q: seq) {
+      double y = q(x);
+      if (y != 0) {
+         changes += last != 0 && (y < 0) != (last < 0);
+         last = y;
+      }
+   }
+
+   return changes;
+}
+
+/**
+ * Refines a root where a polynomial changes sign, with Newton steps
+ *  kept inside a bracket that is halved whenever they leave it.
+ */
+static double newton_bisect(const Polynomial &p, const Polynomial &dp, double lo, double hi) {
+   bool lo_neg = p(lo) < 0;
+   double x = (lo + hi) / 2;
+   for (int i = 0; i < ROOT_MAX_ITER; i++) {
+      double y = p(x);
+      if (y == 0) {
+         return x;
+      }
+
+      if ((y < 0) == lo_neg) {
+         lo = x;
+      } else {
+         hi = x;
+      }
+
+      double next = x - y / dp(x);
+      if (!(next > lo && next < hi)) {
+         next = (lo + hi) / 2;
+      }
+
+      if (std::fabs(next - x) <= ROOT_TOL * std::max(1.0, std::fabs(x))) {
+         return next;
+      }
+
+      x = next;
+   }
+
+   return x;
+}
+
+std::vector<double> Polynomial::roots(double a, double b) const {
+   std::vector<double> found;
+   if (degree() < 1 || !(a < b)) {
+      return found;
+   }
+
+   std::vector<Polynomial> seq = sturm_sequence(*this);
+   Polynomial deriv = derivative();
+
+   // The Sturm sequences of the gcd of the polynomial and its derivative, which is the last
+   //  element of its sequence, then of the gcd of that and its derivative, and so on.
+   // A root of multiplicity m is a root of the first m of them.
+   std::vector<std::vector<Polynomial>> factors = { seq };
+   while (factors.back().back().degree() >= 1) {
+      factors.push_back(sturm_sequence(factors.back().back()));
+   }
+
+   // The roots in (lo, hi] number changes(lo) - changes(hi).
+   struct Piece {
+      double lo, hi;
+      int v_lo, v_hi;
+   };
+
+   if ((*this)(a) == 0) {
+      found.push_back(a);
+   }
+
+   // Pieces are taken from the left, so the roots come out in order.
+   std::vector<Piece> pieces = { { a, b, sign_changes(seq, a), sign_changes(seq, b) } };
+   while (!pieces.empty()) {
+      Piece piece = pieces.back();
+      pieces.pop_back();
+
+      int count = piece.v_lo - piece.v_hi;
+      double mid = (piece.lo + piece.hi) / 2;
+      bool narrow = piece.hi - piece.lo <= ROOT_TOL * std::max(1.0, std::fabs(mid));
+      if (count <= 0) {
+         continue;
+      }
+
+      if (count > 1 && !narrow) {
+         int v_mid = sign_changes(seq, mid);
+         pieces.push_back({ mid, piece.hi, v_mid, piece.v_hi });
+         pieces.push_back({ piece.lo, mid, piece.v_lo, v_mid });
+         continue;
+      }
+
+      double lo = piece.lo, hi = piece.hi,
+             y_lo = (*this)(lo), y_hi = (*this)(hi);
+      if (y_hi == 0) {
+         found.push_back(hi);
+         continue;
+      }
+
+      // The piece holds one distinct root, and it has multiplicity m if it's also a root of the first m - 1 gcds.
+      bool crosses = y_lo != 0 && (y_lo < 0) != (y_hi < 0);
+      int mult = 1;
+      while (mult < (int)factors.size()
+             && sign_changes(factors[mult], piece.lo) > sign_changes(factors[mult], piece.hi)) {
+         mult++;
+      }
+
+      if (crosses && mult == 1) {
+         found.push_back(newton_bisect(*this, deriv, lo, hi));
+         continue;
+      }
+
+      if (crosses) {
+         // An odd multiplicity still changes sign, which places it roughly.
+         lo = hi = newton_bisect(*this, deriv, lo, hi);
+      } else {
+         // A root of even multiplicity. Only the Sturm sequence can tell which half it's in.
+         mult = std::max(mult, 2);
+         int v_lo = piece.v_lo, v_hi = piece.v_hi;
+         for (int i = 0; i < ROOT_MAX_ITER && hi - lo > ROOT_TOL * std::max(1.0, std::fabs(lo)); i++) {
+            double half = (lo + hi) / 2;
+            int v_half = sign_changes(seq, half);
+            if (v_lo > v_half) {
+               hi = half;
+               v_hi = v_half;
+            } else if (v_half > v_hi) {
+               lo = half;
+               v_lo = v_half;
+            } else {
+               break;
+            }
+         }
+      }
+
+      // Rounding leaves that only roughly where the root is, but a root of multiplicity m
+      //  is a simple root of the (m - 1)th derivative, which can be found precisely.
+      // It's kept as long as the window it was found in still holds just the one root.
+      double x = (lo + hi) / 2,
+             spread = POLY_MULTIPLE_SPREAD * std::max(1.0, std::fabs(x)),
+             near_lo = std::max(piece.lo, x - spread),
+             near_hi = std::min(piece.hi, x + spread);
+      Polynomial higher = deriv;
+      for (int k = 2; k < mult; k++) {
+         higher = higher.derivative();
+      }
+
+      double h_lo = higher(near_lo),
+             h_hi = higher(near_hi);
+      if (h_lo != 0 && h_hi != 0 && (h_lo < 0) != (h_hi < 0)
+          && sign_changes(seq, near_lo) - sign_changes(seq, near_hi) == 1) {
+         x = newton_bisect(higher, higher.derivative(), near_lo, near_hi);
+      }
+
+      if (crosses) {
+         found.push_back(x);
+         continue;
+      }
+
+      // Complex roots close to the axis can look like a real one through rounding.
+      double size = 0, power = 1;
+      for (double c: coeffs) {
+         size += std::fabs(c) * power;
+         power *= std::fabs(x);
+      }
+
+      if (std::fabs((*this)(x)) <= POLY_TOUCH_RESIDUAL * size) {
+         found.push_back(x);
+      }
+   }
+
+   return found;
+}
+
+Expr *Polynomial::to_expr() const {
+   if (coeffs.empty()) {
+      return new_num_expr(0);
+   }
+
+   Expr *expr = new_num_expr(coeffs.back());
+   for (size_t k = coeffs.size() - 1; k-- > 0;) {
+      expr = new_binary(MUL, new_arg_expr(), expr);
+      if (coeffs[k] != 0) {
+         expr = new_binary(ADD, new_num_expr(coeffs[k]), expr);
+      }
+   }
+
+   return expr;
+}
+
+/**
+ * Finds the coefficients of a polynomial expression, as in as_polynomial,
+ *  but without checking that they're finite.
+ */
+static bool to_polynomial(const Expr *expr, const ExecCtx &ectx, Polynomial &poly) {
+   switch (expr->type) {
+   case NUMBER:
+      poly = Polynomial({ expr->val.number });
+      return true;
+   case VARIABLE:
+      {
+         auto var = ectx.varTable.find(expr->val.varname);
+         if (var == ectx.varTable.end()) {
+            return false;
+         }
+
+         poly = Polynomial({ var->second });
+         return true;
+      }
+   case ARGUMENT:
+      if (expr->val.argindex != 0) {
+         return false;
+      }
+
+      poly = Polynomial({ 0, 1 });
+      return true;
+   case UNARY:
+      {
+         Polynomial inner;
+         if (!to_polynomial(expr->val.unary->inner, ectx, inner)) {
+            return false;
+         }
+
+         if (expr->val.unary->op == NEG) {
+            poly = inner * -1;
+            return true;
+         }
+
+         // |p| is only a polynomial if p is constant.
+         if (inner.degree() > 0) {
+            return false;
+         }
+
+         poly = Polynomial({ std::fabs(inner(0)) });
+         return true;
+      }
+   case BINARY:
+      {
+         Polynomial lhs, rhs;
+         if (!to_polynomial(expr->val.binary->lhs, ectx, lhs)
+             || !to_polynomial(expr->val.binary->rhs, ectx, rhs)) {
+            return false;
+         }
+
+         switch (expr->val.binary->op) {
+         case ADD:
+            poly = lhs + rhs;
+            return true;
+         case SUB:
+            poly = lhs - rhs;
+            return true;
+         case MUL:
+            if (lhs.degree() + rhs.degree() > POLY_MAX_DEGREE) {
+               return false;
+            }
+
+            poly = lhs * rhs;
+            return true;
+         case DIV:
+            // Division by 0 is left to the compiled function.
+            if (rhs.degree() != 0) {
+               return false;
+            }
+
+            poly = lhs / rhs(0);
+            return true;
+         case POW:
+            {
+               if (rhs.degree() > 0) {
+                  return false;
+               }
+
+               double power = rhs(0);
+               if (lhs.degree() <= 0) {
+                  poly = Polynomial({ std::pow(lhs(0), power) });
+                  return true;
+               }
+
+               if (power < 0 || power != std::floor(power) || lhs.degree() * power > POLY_MAX_DEGREE) {
+                  return false;
+               }
+
+               // Exponentiation by squaring
+               Polynomial result({ 1 });
+               for (int n = (int)power; n > 0; n >>= 1) {
+                  if (n & 1) {
+                     result = result * lhs;
+                  }
+
+                  lhs = lhs * lhs;
+               }
+
+               poly = result;
+               return true;
+            }
+         }
+      }
+      break;
+   case APPLY:
+      {
+         // Only a built-in function of a constant is a polynomial.
+         const Apply *apply = expr->val.apply;
+         auto fn = ectx.fnTable.find(apply->funcname);
+         Polynomial arg;
+         if (apply->n_args != 1 || fn == ectx.fnTable.end()
+             || !to_polynomial(apply->args[0], ectx, arg) || arg.degree() > 0) {
+            return false;
+         }
+
+         poly = Polynomial({ fn->second(arg(0)) });
+         return true;
+      }
+   case INTEGRAL:
+   case DERIVATIVE:
+      break;
+   }
+
+   return false;
+}
+
+bool as_polynomial(const Expr *expr, const ExecCtx &ectx, Polynomial &poly) {
+   if (!to_polynomial(expr, ectx, poly)) {
+      return false;
+   }
+
+   for (double c: poly.get_coeffs()) {
+      if (!std::isfinite(c)) {
+         return false;
+      }
+   }
+
+   return true;
+}
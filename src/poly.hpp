@@ -0,0 +1,138 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef POLY_HPP
+#define POLY_HPP
+
+#include "compile.hpp"
+#include <vector>
+
+/* Expressions of higher degree than this are left to the numerical methods */
+#define POLY_MAX_DEGREE 64
+
+/* A root where the polynomial doesn't change sign is only kept if it's this close to 0,
+ *  relative to the sum of the magnitudes of its terms there
+ */
+#define POLY_TOUCH_RESIDUAL 1e-9
+
+/* A multiple root is looked for this far around where it was first placed, relative to its size */
+#define POLY_MULTIPLE_SPREAD 1e-3
+
+/* Leading coefficients of a Sturm sequence remainder this small, relative to the dividend's largest, are rounding error */
+#define POLY_EPS 1e-12
+
+/* A polynomial in x with real coefficients */
+class Polynomial {
+   /* coeffs[k] multiplies x^k. The last one is never 0. */
+   std::vector<double> coeffs;
+
+   /**
+    * Drops zero coefficients from the top.
+    */
+   void trim();
+
+public:
+   /**
+    * Constructs the zero polynomial.
+    */
+   Polynomial();
+
+   /**
+    * @param coeffs The coefficients, from the constant term up
+    */
+   Polynomial(std::vector<double> coeffs);
+
+   /* The degree, or -1 for the zero polynomial */
+   int degree() const;
+
+   const std::vector<double> &get_coeffs() const;
+
+   /**
+    * Evaluates the polynomial with Horner's method.
+    */
+   double operator()(double x) const;
+
+   Polynomial operator+(const Polynomial &other) const;
+
+   Polynomial operator-(const Polynomial &other) const;
+
+   Polynomial operator*(const Polynomial &other) const;
+
+   Polynomial operator*(double factor) const;
+
+   Polynomial operator/(double divisor) const;
+
+   Polynomial derivative() const;
+
+   /**
+    * Gets the antiderivative which is 0 at x = 0.
+    */
+   Polynomial antiderivative() const;
+
+   /**
+    * Computes a definite integral in closed form.
+    * If b < a, the result is negated as usual.
+    */
+   double integral(double a, double b) const;
+
+   /**
+    * Computes the integral of the polynomial clamped to a range of values, in closed form.
+    * The clamped function is split where it meets either end of the range.
+    *
+    * @param a The lower bound
+    * @param b The upper bound
+    * @param lo The smallest value
+    * @param hi The largest value
+    */
+   double clamped_integral(double a, double b, double lo, double hi) const;
+
+   /**
+    * Finds the real roots in an interval.
+    * A Sturm sequence counts the distinct roots in each piece of the interval,
+    *  which is halved until each piece holds one root.
+    * Roots where the polynomial changes sign are then refined with bisection and Newton steps,
+    *  and roots of even multiplicity, where it only touches 0, by halving further.
+    *
+    * @param a The lower bound
+    * @param b The upper bound
+    *
+    * @return The roots, in increasing order, each once no matter its multiplicity
+    */
+   std::vector<double> roots(double a, double b) const;
+
+   /**
+    * Builds an expression evaluating the polynomial in Horner form.
+    */
+   Expr *to_expr() const;
+};
+
+/**
+ * Checks whether an expression in x is a polynomial, and finds its coefficients if so.
+ * Sums, differences, products, division by constants, and whole powers of polynomials are polynomials.
+ * Constant subexpressions may use anything with a value, including built-in functions.
+ * User-defined functions should already have been inlined.
+ *
+ * @param expr The expression
+ * @param ectx The context with the variables and built-in functions
+ * @param poly Where to write the polynomial
+ *
+ * @return true if the expression is a polynomial of degree at most POLY_MAX_DEGREE
+ */
+bool as_polynomial(const Expr *expr, const ExecCtx &ectx, Polynomial &poly);
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "quadrature.hpp"
+#include "asymptotes.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <vector>
+
+/* Most subintervals an integral is split into */
+#define MAX_SEGMENTS 500
+
+/* Number of pieces the interval is cut into when looking for asymptotes */
+#define POLE_SCAN 64
+
+/* Past this many evaluations, a converged result is suspected of hiding an asymptote,
+ * since the error estimates can't be trusted near one.
+ */
+#define POLE_SUSPECT 1500
+
+/* Subintervals narrower than this fraction of the whole are bunched up around a singularity */
+#define NARROW_WIDTH 1e-9
+
+/* Kronrod nodes on [-1, 1], from the outside in. The odd ones are the Gauss nodes. */
+static const double XGK[8] = {
+   0.991455371120812639206854697526329,
+   0.949107912342758524526189684047851,
+   0.864864423359769072789712788640926,
+   0.741531185599394439863864773280788,
+   0.586087235467691130294144845693013,
+   0.405845151377397166906606412076961,
+   0.207784955007898467600689403773245,
+   0.000000000000000000000000000000000
+};
+
+/* Kronrod weights */
+static const double WGK[8] = {
+   0.022935322010529224963732008058970,
+   0.063092092629978553290700663189204,
+   0.104790010322250183839876322541518,
+   0.140653259715525918745189590510238,
+   0.169004726639267902826583426598550,
+   0.190350578064785409913256402421014,
+   0.204432940075298892414161999234649,
+   0.209482141084727828012999174891714
+};
+
+/* Gauss weights for XGK[1], XGK[3], XGK[5] and XGK[7] */
+static const double WG[4] = {
+   0.129484966168869693270611432679082,
+   0.279705391489276667901467771423780,
+   0.381830050505118944950369775488975,
+   0.417959183673469387755102040816327
+};
+
+/* The integrand after the change of variables x = a + (b - a) g(t), t in [0, 1].
+ * g flattens out at whichever bounds are singular, which cancels out
+ * singularities like 1/Sqrt(x) or Log(x) there.
+ */
+struct Transformed {
+   Func fn;
+   double a, b;
+   bool sing_lo, sing_hi;
+
+   double g(double t) const {
+      if (sing_lo && sing_hi) {
+         return t * t * (3 - 2 * t);
+      } else if (sing_lo) {
+         return t * t;
+      } else if (sing_hi) {
+         return 1 - (1 - t) * (1 - t);
+      }
+
+      return t;
+   }
+
+   double operator()(double t) const {
+      double g, dg;
+      if (sing_lo && sing_hi) {
+         g = t * t * (3 - 2 * t);
+         dg = 6 * t * (1 - t);
+      } else if (sing_lo) {
+         g = t * t;
+         dg = 2 * t;
+      } else if (sing_hi) {
+         g = 1 - (1 - t) * (1 - t);
+         dg = 2 * (1 - t);
+      } else {
+         g = t;
+         dg = 1;
+      }
+
+      // Nodes can still round onto a singular bound, where the weight vanishes anyway.
+      // Anywhere else, a bad sample has to spoil the estimate.
+      double x = a + (b - a) * g;
+      double y = fn(x) * (b - a) * dg;
+      if (!std::isfinite(y) && ((sing_lo && x == a) || (sing_hi && x == b))) {
+         return 0;
+      }
+
+      return y;
+   }
+};
+
+/* A subinterval in the queue, ordered by error */
+struct Segment {
+   double lo, hi;
+   double value, error;
+
+   bool operator<(const Segment &other) const {
+      return error < other.error;
+   }
+};
+
+/**
+ * Applies the 15-point Kronrod rule and its embedded 7-point Gauss rule to [lo, hi].
+ */
+static Segment gauss_kronrod(const Transformed &f, double lo, double hi) {
+   double center = (lo + hi) / 2.0,
+          half = (hi - lo) / 2.0;
+
+   double fc = f(center);
+   double kronrod = fc * WGK[7],
+          gauss = fc * WG[3],
+          abs_sum = std::fabs(kronrod);
+
+   double fv[15];
+   fv[7] = fc;
+   for (int i = 0; i < 7; i++) {
+      double f1 = f(center - half * XGK[i]),
+             f2 = f(center + half * XGK[i]);
+
+      fv[i] = f1;
+      fv[14 - i] = f2;
+      kronrod += WGK[i] * (f1 + f2);
+      abs_sum += WGK[i] * (std::fabs(f1) + std::fabs(f2));
+      if (i % 2 == 1) {
+         gauss += WG[i / 2] * (f1 + f2);
+      }
+   }
+
+   // The same error estimate as QUADPACK's, which is much less pessimistic than |K - G|
+   // for smooth integrands.
+   double mean = kronrod / 2.0,
+          asc = 0;
+   for (int i = 0; i < 15; i++) {
+      asc += WGK[i < 8? i: 14 - i] * std::fabs(fv[i] - mean);
+   }
+
+   asc *= std::fabs(half);
+   double error = std::fabs((kronrod - gauss) * half);
+   if (asc != 0 && error != 0) {
+      error = asc * std::min(1.0, std::pow(200 * error / asc, 1.5));
+   }
+
+   double roundoff = 50 * std::numeric_limits<double>::epsilon() * abs_sum * std::fabs(half);
+   return { lo, hi, kronrod * half, std::max(error, roundoff) };
+}
+
+/**
+ * Integrates over [a, b] by repeatedly bisecting the worst subinterval.
+ *
+ * @param narrowest If not null, where to write the middle of the narrowest subinterval
+ *                  if it's small enough to suggest a singularity, or NaN otherwise
+ */
+static QuadResult gk_adaptive(Func fn,
+                              double a, double b,
+                              bool sing_lo, bool sing_hi,
+                              double abs_tol, double rel_tol,
+                              double *narrowest = nullptr) {
+   Transformed f = { fn, a, b, sing_lo, sing_hi };
+
+   std::priority_queue<Segment> queue;
+   queue.push(gauss_kronrod(f, 0, 1));
+
+   double value = queue.top().value,
+          error = queue.top().error;
+   int evals = 15;
+
+   // A sample that isn't finite has to be dealt with by splitting at it, not by bisection.
+   while (std::isfinite(value)
+          && !(error <= std::max(abs_tol, rel_tol * std::fabs(value)))
+          && (int) queue.size() < MAX_SEGMENTS) {
+      Segment worst = queue.top();
+      double mid = (worst.lo + worst.hi) / 2.0;
+      if (mid <= worst.lo || mid >= worst.hi) {
+         // Can't be split any further.
+         break;
+      }
+
+      queue.pop();
+      Segment left = gauss_kronrod(f, worst.lo, mid),
+              right = gauss_kronrod(f, mid, worst.hi);
+      evals += 30;
+
+      value += left.value + right.value - worst.value;
+      error += left.error + right.error - worst.error;
+      queue.push(left);
+      queue.push(right);
+   }
+
+   // The running totals drift, so the final ones are summed from scratch.
+   value = 0;
+   error = 0;
+   double min_width = 1, min_mid = 0;
+   while (!queue.empty()) {
+      const Segment &seg = queue.top();
+      value += seg.value;
+      error += seg.error;
+      if (seg.hi - seg.lo < min_width) {
+         min_width = seg.hi - seg.lo;
+         min_mid = (seg.lo + seg.hi) / 2.0;
+      }
+
+      queue.pop();
+   }
+
+   if (narrowest != nullptr) {
+      *narrowest = min_width < NARROW_WIDTH? a + (b - a) * f.g(min_mid): NAN;
+   }
+
+   bool converged = std::isfinite(value)
+                 && error <= std::max(abs_tol, rel_tol * std::fabs(value));
+   return { value, error, evals, converged };
+}
+
+/**
+ * Looks for vertical asymptotes inside (a, b) using the same search as the grapher.
+ *
+ * @param hint A suspected singularity, or NaN
+ *
+ * @return Their x values, in increasing order
+ */
+static std::vector<double> find_poles(Func fn, double a, double b, double hint) {
+   std::vector<double> poles;
+   double step = (b - a) / POLE_SCAN;
+
+   Point A = Point::of(fn, a);
+   for (int i = 1; i <= POLE_SCAN; i++) {
+      Point B = Point::of(fn, i == POLE_SCAN? b: a + i * step);
+
+      Point pole = goes_pos_inf(fn, A, B, b - a);
+      if (pole.y == 0) {
+         pole = goes_neg_inf(fn, A, B, b - a);
+      }
+
+      if (!std::isfinite(B.y) && i < POLE_SCAN) {
+         pole = B;
+      }
+
+      if (pole.y != 0 && a < pole.x && pole.x < b
+          && (poles.empty() || pole.x > poles.back())) {
+         poles.push_back(pole.x);
+      }
+
+      A = B;
+   }
+
+   // Weaker singularities, like 1/Sqrt(x), never get large enough for the search above.
+   if (a < hint && hint < b) {
+      double close = NARROW_WIDTH * (b - a);
+      bool known = false;
+      for (double pole: poles) {
+         known = known || std::fabs(pole - hint) < close;
+      }
+
+      if (!known) {
+         poles.insert(std::upper_bound(poles.begin(), poles.end(), hint), hint);
+      }
+   }
+
+   return poles;
+}
+
+/**
+ * Checks whether the integral diverges at a singularity, by seeing if x f(x) stops shrinking
+ * as x approaches it. That happens for 1/x and 1/x^2, but never for an integrable
+ * singularity like 1/Sqrt(x) or Log(x).
+ *
+ * @param s The singularity
+ * @param toward Which side to approach from, and how far the interval goes that way
+ *
+ * @return The infinity the integral diverges to on that side, or 0 if it seems finite
+ */
+static double divergence(Func fn, double s, double toward) {
+   // Asymptotes are only located to about 1e-11 of the interval, so these can't get much closer.
+   double near = (s + toward * 1e-4) - s,
+          nearer = (s + toward * 1e-8) - s;
+   if (nearer == 0 || std::fabs(nearer) >= std::fabs(near)) {
+      return 0;
+   }
+
+   double f_near = fn(s + near),
+          f_nearer = fn(s + nearer);
+   if (!(std::isfinite(f_near) && f_near * f_nearer > 0)) {
+      return 0;
+   }
+
+   bool grows = std::fabs(nearer * f_nearer) >= 0.9 * std::fabs(near * f_near);
+   return grows? std::copysign(INFINITY, f_near): 0;
+}
+
+QuadResult integrate_adaptive(Func fn, double a, double b, double abs_tol, double rel_tol) {
+   if (a == b) {
+      return { 0, 0, 0, true };
+   } else if (b < a) {
+      QuadResult res = integrate_adaptive(fn, b, a, abs_tol, rel_tol);
+      res.value = -res.value;
+      return res;
+   }
+
+   bool sing_lo = !std::isfinite(fn(a)),
+        sing_hi = !std::isfinite(fn(b));
+
+   // Infinities of opposite signs add up to NaN, as they should.
+   double ends = (sing_lo? divergence(fn, a, b - a): 0)
+               + (sing_hi? divergence(fn, b, a - b): 0);
+   if (ends != 0) {
+      return { ends, INFINITY, 6, false };
+   }
+
+   double narrowest;
+   QuadResult res = gk_adaptive(fn, a, b, sing_lo, sing_hi, abs_tol, rel_tol, &narrowest);
+   res.evals += 2;
+   if (res.converged && res.evals <= POLE_SUSPECT) {
+      return res;
+   }
+
+   // Asymptotes inside the interval are only looked for once the plain approach struggles.
+   std::vector<double> poles = find_poles(fn, a, b, narrowest);
+   if (poles.empty()) {
+      return res;
+   }
+
+   QuadResult split = { 0, 0, res.evals, true };
+   double lo = a;
+   bool lo_sing = sing_lo;
+   poles.push_back(b);
+   for (double hi: poles) {
+      bool hi_sing = hi == b? sing_hi: true;
+      ends = (lo_sing? divergence(fn, lo, hi - lo): 0)
+           + (hi_sing? divergence(fn, hi, lo - hi): 0);
+      if (ends != 0) {
+         split.value += ends;
+         split.error = INFINITY;
+         split.converged = false;
+      } else {
+         QuadResult piece = gk_adaptive(fn, lo, hi, lo_sing, hi_sing,
+                                        abs_tol / poles.size(), rel_tol);
+         split.value += piece.value;
+         split.error += piece.error;
+         split.evals += piece.evals;
+         split.converged = split.converged && piece.converged;
+      }
+
+      lo = hi;
+      lo_sing = true;
+   }
+
+   return split;
+}
+
+double integrate(Func fn, double a, double b) {
+   QuadResult res = integrate_adaptive(fn, a, b, INTEGRATE_TOL, INTEGRATE_REL_TOL);
+   if (res.converged || std::isinf(res.value)) {
+      return res.value;
+   }
+
+   return NAN;
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef QUADRATURE_HPP
+#define QUADRATURE_HPP
+
+#include "compile.hpp"
+
+/* Tolerances used when integrals are evaluated inside expressions */
+#define INTEGRATE_TOL 1e-10
+#define INTEGRATE_REL_TOL 1e-12
+
+/* The result of an adaptive quadrature */
+struct QuadResult {
+   /* The integral estimate and its estimated absolute error */
+   double value, error;
+
+   /* How many times the quadrature rules evaluated the integrand */
+   int evals;
+
+   /* Did the error estimate meet the tolerance? */
+   bool converged;
+};
+
+/**
+ * Approximates a definite integral using adaptive Gauss-Kronrod (G7K15) quadrature.
+ * The subinterval with the largest error is split until the total error meets the tolerance.
+ * Integrable singularities at the bounds are handled with a change of variables,
+ * and the integral is split at any asymptotes found inside the interval.
+ * An integral that diverges at one of them comes out infinite (or NaN if the signs disagree)
+ * and not converged. If b < a, the result is negated as usual.
+ *
+ * @param fn The function to integrate
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param abs_tol The absolute error tolerance
+ * @param rel_tol The error tolerance relative to the result
+ *
+ * @return The integral estimate, with its error
+ */
+QuadResult integrate_adaptive(Func fn, double a, double b, double abs_tol, double rel_tol);
+
+/**
+ * Approximates the definite integral of a function to the default tolerances.
+ * Called directly by compiled code for Integral(F, a, b) expressions.
+ *
+ * @param fn The function to integrate
+ * @param a The lower bound
+ * @param b The upper bound
+ *
+ * @return The integral estimate, an infinity if it diverges, or NaN if it didn't converge
+ */
+double integrate(Func fn, double a, double b);
+
+#endif
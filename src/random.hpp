@@ -0,0 +1,106 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstdint>
+
+/* The Weyl sequence increment of splitmix64 */
+#define SPLITMIX_GAMMA 0x9e3779b97f4a7c15ull
+
+#define SPLITMIX_MUL1 0xbf58476d1ce4e5b9ull
+#define SPLITMIX_MUL2 0x94d049bb133111ebull
+
+/**
+ * Gives the nth output of the splitmix64 generator with the given seed.
+ * The generator's state is just seed + (n + 1) * gamma, so any part of the stream
+ * can be produced independently. Compiled sampling kernels generate the same stream.
+ *
+ * @param seed The stream's seed
+ * @param n The index into the stream
+ *
+ * @return 64 random bits
+ */
+inline uint64_t splitmix_at(uint64_t seed, uint64_t n) {
+   uint64_t z = seed + (n + 1) * SPLITMIX_GAMMA;
+   z = (z ^ (z >> 30)) * SPLITMIX_MUL1;
+   z = (z ^ (z >> 27)) * SPLITMIX_MUL2;
+   return z ^ (z >> 31);
+}
+
+/**
+ * Gives a uniform double in [0, 1) from the nth output of a splitmix64 stream.
+ */
+inline double uniform_at(uint64_t seed, uint64_t n) {
+   return (double)(splitmix_at(seed, n) >> 11) / 9007199254740992.0;
+}
+
+/* Number of direction numbers for each dimension of the Sobol sequence */
+#define SOBOL_BITS 64
+
+/**
+ * Gets the direction numbers of the first two dimensions of the Sobol sequence,
+ * as 64-bit binary fractions. The first dimension is the van der Corput sequence,
+ * and the second comes from the primitive polynomial x + 1.
+ *
+ * @return A table of SOBOL_BITS numbers for dimension 0, followed by those for dimension 1
+ */
+inline const uint64_t *sobol_directions() {
+   static const struct Table {
+      uint64_t v[2 * SOBOL_BITS];
+
+      Table() {
+         uint64_t m = 1;
+         for (int k = 0; k < SOBOL_BITS; k++) {
+            v[k] = 1ull << (SOBOL_BITS - 1 - k);
+            v[SOBOL_BITS + k] = m << (SOBOL_BITS - 1 - k);
+            m = (m << 1) ^ m;
+         }
+      }
+   } table;
+
+   return table.v;
+}
+
+/**
+ * Gives a coordinate of the nth point of a digitally shifted Sobol sequence.
+ * Points are taken in Gray code order, which has the same even spread as the natural order
+ * and lets compiled kernels step from one point to the next with a single XOR.
+ * The shift is random for each seed, which makes the error of different seeds independent.
+ *
+ * @param seed The seed of the shift
+ * @param n The index of the point
+ * @param dim 0 for the first coordinate, 1 for the second
+ *
+ * @return A double in [0, 1)
+ */
+inline double sobol_at(uint64_t seed, uint64_t n, int dim) {
+   const uint64_t *v = sobol_directions() + dim * SOBOL_BITS;
+
+   uint64_t bits = splitmix_at(seed, dim);
+   for (uint64_t g = n ^ (n >> 1); g != 0; g >>= 1, v++) {
+      if (g & 1) {
+         bits ^= *v;
+      }
+   }
+
+   return (double)(bits >> 11) / 9007199254740992.0;
+}
+
+#endif
@@ -0,0 +1,377 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "reduce.hpp"
+#include "random.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+using namespace asmjit;
+
+Reduction Reduction::empty() {
+   return { DDouble::of(0),
+            0, 0, 0,
+            std::numeric_limits<double>::infinity(),
+            -std::numeric_limits<double>::infinity() };
+}
+
+Reduction merge(const Reduction &A, const Reduction &B) {
+   return { A.sum + B.sum,
+            A.count + B.count,
+            A.hits + B.hits,
+            A.height + B.height,
+            std::fmin(A.min, B.min),
+            std::fmax(A.max, B.max) };
+}
+
+ReduceCtx::ReduceCtx(JitRuntime &_rt,
+                     CodeHolder &_code,
+                     const ExecCtx &_ectx,
+                     KernelSource _source)
+   : CompCtx(_rt, _code, _ectx,
+             FuncSignatureT<void, const KernelParams *, int64_t, int64_t, Reduction *>()),
+     source(_source)
+{
+   params = cc.newIntPtr();
+   begin = cc.newInt64();
+   stop = cc.newInt64();
+   out = cc.newIntPtr();
+
+   func->setArg(0, params);
+   func->setArg(1, begin);
+   func->setArg(2, stop);
+   func->setArg(3, out);
+}
+
+void ReduceCtx::emit_splitmix(x86::Gp z, x86::Gp seed, x86::Gp n) {
+   x86::Gp t = cc.newUInt64(),
+           k = cc.newUInt64();
+
+   // z = seed + (n + 1) * gamma
+   cc.mov(z, n);
+   cc.add(z, 1);
+   cc.mov(k, imm((int64_t)SPLITMIX_GAMMA));
+   cc.imul(z, k);
+   cc.add(z, seed);
+
+   // z = (z ^ (z >> 30)) * mul1
+   cc.mov(t, z);
+   cc.shr(t, 30);
+   cc.xor_(z, t);
+   cc.mov(k, imm((int64_t)SPLITMIX_MUL1));
+   cc.imul(z, k);
+
+   // z = (z ^ (z >> 27)) * mul2
+   cc.mov(t, z);
+   cc.shr(t, 27);
+   cc.xor_(z, t);
+   cc.mov(k, imm((int64_t)SPLITMIX_MUL2));
+   cc.imul(z, k);
+
+   // z ^= z >> 31
+   cc.mov(t, z);
+   cc.shr(t, 31);
+   cc.xor_(z, t);
+}
+
+void ReduceCtx::emit_unit(x86::Xmm u, x86::Gp z) {
+   cc.shr(z, 11);
+   cc.cvtsi2sd(u, z);
+   cc.mulsd(u, cc.newDoubleConst(ConstPoolScope::kLocal, 1.0 / 9007199254740992.0));
+}
+
+void ReduceCtx::emit_uniform(x86::Xmm u, x86::Gp seed, x86::Gp n) {
+   x86::Gp z = cc.newUInt64();
+   emit_splitmix(z, seed, n);
+   emit_unit(u, z);
+}
+
+void ReduceCtx::conv_kernel(const Expr *expr) {
+   x86::Xmm sumh = cc.newXmm(), suml = cc.newXmm(),
+            count = cc.newXmm(), hits = cc.newXmm(), height = cc.newXmm(),
+            minv = cc.newXmm(), maxv = cc.newXmm(),
+            one = cc.newXmm(), zero = cc.newXmm(),
+            sample = cc.newXmm(),
+            s = cc.newXmm(), bb = cc.newXmm(), t = cc.newXmm();
+
+   x86::Gp i = cc.newInt64(),
+           ctr = cc.newUInt64(),
+           seed = cc.newUInt64(),
+           dirs = cc.newIntPtr(),
+           bits0 = cc.newUInt64(),
+           bits1 = cc.newUInt64(),
+           col_mask = cc.newUInt64();
+
+   // The box's y range split at the axis, for clipping f
+   x86::Xmm pos_lo = cc.newXmm(), pos_hi = cc.newXmm(),
+            neg_lo = cc.newXmm(), neg_hi = cc.newXmm(),
+            inv_yrange = cc.newXmm(), col_width = cc.newXmm();
+
+   Label loop = cc.newLabel(),
+         skip = cc.newLabel(),
+         done = cc.newLabel();
+
+   cc.xorps(sumh, sumh);
+   cc.xorps(suml, suml);
+   cc.xorps(count, count);
+   cc.xorps(hits, hits);
+   cc.xorps(height, height);
+   cc.xorps(zero, zero);
+   cc.movsd(one, cc.newDoubleConst(ConstPoolScope::kLocal, 1.0));
+   cc.movsd(minv, cc.newDoubleConst(ConstPoolScope::kLocal,
+                                    std::numeric_limits<double>::infinity()));
+   cc.movsd(maxv, cc.newDoubleConst(ConstPoolScope::kLocal,
+                                    -std::numeric_limits<double>::infinity()));
+
+   if (source != AFFINE) {
+      cc.mov(seed, x86::ptr(params, offsetof(KernelParams, seed)));
+
+      // pos_lo = max(ymin, 0), pos_hi = max(ymax, 0), neg_lo = min(ymin, 0), neg_hi = min(ymax, 0)
+      cc.movsd(pos_lo, x86::ptr(params, offsetof(KernelParams, ymin)));
+      cc.movsd(neg_lo, pos_lo);
+      cc.movsd(pos_hi, pos_lo);
+      cc.addsd(pos_hi, x86::ptr(params, offsetof(KernelParams, yrange)));
+      cc.movsd(neg_hi, pos_hi);
+      cc.maxsd(pos_lo, zero);
+      cc.maxsd(pos_hi, zero);
+      cc.minsd(neg_lo, zero);
+      cc.minsd(neg_hi, zero);
+
+      cc.movsd(inv_yrange, one);
+      cc.divsd(inv_yrange, x86::ptr(params, offsetof(KernelParams, yrange)));
+   }
+
+   if (source == RANDOM) {
+      cc.mov(col_mask, x86::ptr(params, offsetof(KernelParams, strata)));
+      cc.cvtsi2sd(col_width, col_mask);
+      cc.sub(col_mask, 1);
+
+      x86::Xmm t = cc.newXmm();
+      cc.movsd(t, x86::ptr(params, offsetof(KernelParams, xrange)));
+      cc.divsd(t, col_width);
+      cc.movsd(col_width, t);
+   }
+
+   if (source == SOBOL) {
+      // The shifts are the first two outputs of the seed's stream, as in sobol_at()
+      x86::Gp g = cc.newUInt64(),
+              k = cc.newUInt64(),
+              t = cc.newUInt64();
+
+      cc.xor_(k, k);
+      emit_splitmix(bits0, seed, k);
+      cc.inc(k);
+      emit_splitmix(bits1, seed, k);
+
+      // Point number begin is the XOR of the direction numbers for the bits of its Gray code.
+      Label bit_loop = cc.newLabel(),
+            bits_done = cc.newLabel();
+
+      cc.mov(dirs, imm((intptr_t)sobol_directions()));
+      cc.mov(g, begin);
+      cc.shr(g, 1);
+      cc.xor_(g, begin);
+      cc.xor_(k, k);
+
+      cc.bind(bit_loop);
+      cc.test(g, g);
+      cc.jz(bits_done);
+
+      // t is all ones if the bit is set, else zero
+      cc.mov(t, g);
+      cc.and_(t, 1);
+      cc.neg(t);
+
+      cc.mov(ctr, x86::ptr(dirs, k, 3));
+      cc.and_(ctr, t);
+      cc.xor_(bits0, ctr);
+      cc.mov(ctr, x86::ptr(dirs, k, 3, SOBOL_BITS * sizeof(uint64_t)));
+      cc.and_(ctr, t);
+      cc.xor_(bits1, ctr);
+
+      cc.shr(g, 1);
+      cc.inc(k);
+      cc.jmp(bit_loop);
+
+      cc.bind(bits_done);
+   }
+
+   cc.mov(i, begin);
+   cc.bind(loop);
+   cc.cmp(i, stop);
+   cc.jge(done);
+
+   if (source == AFFINE) {
+      cc.cvtsi2sd(x, i);
+      cc.addsd(x, x86::ptr(params, offsetof(KernelParams, offset)));
+      cc.mulsd(x, x86::ptr(params, offsetof(KernelParams, h)));
+      cc.addsd(x, x86::ptr(params, offsetof(KernelParams, a)));
+   } else if (source == SOBOL) {
+      cc.mov(ctr, bits0);
+      emit_unit(x, ctr);
+      cc.mulsd(x, x86::ptr(params, offsetof(KernelParams, xrange)));
+      cc.addsd(x, x86::ptr(params, offsetof(KernelParams, xmin)));
+
+      cc.mov(ctr, bits1);
+      emit_unit(sample, ctr);
+      cc.mulsd(sample, x86::ptr(params, offsetof(KernelParams, yrange)));
+      cc.addsd(sample, x86::ptr(params, offsetof(KernelParams, ymin)));
+   } else {
+      x86::Xmm col = cc.newXmm();
+      x86::Gp col_index = cc.newUInt64();
+
+      cc.mov(ctr, i);
+      cc.add(ctr, ctr);
+      emit_uniform(x, seed, ctr);
+
+      // x = xmin + (i % strata + u) * xrange / strata
+      cc.mov(col_index, i);
+      cc.and_(col_index, col_mask);
+      cc.cvtsi2sd(col, col_index);
+      cc.addsd(x, col);
+      cc.mulsd(x, col_width);
+      cc.addsd(x, x86::ptr(params, offsetof(KernelParams, xmin)));
+
+      cc.add(ctr, 1);
+      emit_uniform(sample, seed, ctr);
+      cc.mulsd(sample, x86::ptr(params, offsetof(KernelParams, yrange)));
+      cc.addsd(sample, x86::ptr(params, offsetof(KernelParams, ymin)));
+   }
+
+   conv_expr_rec(expr);
+
+   if (source != AFFINE) {
+      // Branchless hit test, the same as in the grapher:
+      // +1 if 0 < sample < y, -1 if y < sample < 0
+      x86::Xmm pos = cc.newXmm(), neg = cc.newXmm(), cmp = cc.newXmm();
+
+      cc.movsd(pos, zero);
+      cc.cmpsd(pos, sample, 1);
+      cc.movsd(cmp, sample);
+      cc.cmpsd(cmp, y, 1);
+      cc.andpd(pos, cmp);
+      cc.andpd(pos, one);
+
+      cc.movsd(neg, sample);
+      cc.cmpsd(neg, zero, 1);
+      cc.movsd(cmp, y);
+      cc.cmpsd(cmp, sample, 1);
+      cc.andpd(neg, cmp);
+      cc.andpd(neg, one);
+
+      cc.addsd(hits, pos);
+      cc.subsd(hits, neg);
+
+      // The part of the column between the axis and f, as a fraction of its height.
+      // Left out entirely when f is NaN.
+      cc.movsd(pos, y);
+      cc.maxsd(pos, pos_lo);
+      cc.minsd(pos, pos_hi);
+      cc.subsd(pos, pos_lo);
+
+      cc.movsd(cmp, y);
+      cc.maxsd(cmp, neg_lo);
+      cc.minsd(cmp, neg_hi);
+      cc.movsd(neg, neg_hi);
+      cc.subsd(neg, cmp);
+
+      cc.subsd(pos, neg);
+      cc.mulsd(pos, inv_yrange);
+      cc.movsd(cmp, y);
+      cc.cmpsd(cmp, y, 7);
+      cc.andpd(pos, cmp);
+      cc.addsd(height, pos);
+   }
+
+   // NaNs are unordered with themselves
+   cc.ucomisd(y, y);
+   cc.jp(skip);
+
+   // TwoSum of the running sum and y, keeping the error in suml
+   cc.movsd(s, sumh);
+   cc.addsd(s, y);
+   cc.movsd(bb, s);
+   cc.subsd(bb, sumh);
+   cc.movsd(t, s);
+   cc.subsd(t, bb);
+   cc.subsd(sumh, t);
+   cc.movsd(t, y);
+   cc.subsd(t, bb);
+   cc.addsd(sumh, t);
+   cc.addsd(suml, sumh);
+   cc.movsd(sumh, s);
+
+   cc.addsd(count, one);
+   cc.minsd(minv, y);
+   cc.maxsd(maxv, y);
+
+   cc.bind(skip);
+   if (source == SOBOL) {
+      // Consecutive Gray codes differ in the lowest set bit of i + 1
+      x86::Gp t = cc.newUInt64();
+      cc.mov(ctr, i);
+      cc.add(ctr, 1);
+      cc.bsf(ctr, ctr);
+      cc.mov(t, x86::ptr(dirs, ctr, 3));
+      cc.xor_(bits0, t);
+      cc.mov(t, x86::ptr(dirs, ctr, 3, SOBOL_BITS * sizeof(uint64_t)));
+      cc.xor_(bits1, t);
+   }
+
+   cc.inc(i);
+   cc.jmp(loop);
+
+   cc.bind(done);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, sum.hi)), sumh);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, sum.lo)), suml);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, count)), count);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, hits)), hits);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, height)), height);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, min)), minv);
+   cc.movsd(x86::ptr(out, offsetof(Reduction, max)), maxv);
+}
+
+ReduceFunc ReduceCtx::end() {
+   cc.ret();
+   cc.endFunc();
+   cc.finalize();
+
+   ReduceFunc fn;
+   Error err = rt.add(&fn, &code);
+   if (err) {
+      printf("AsmJit failed: %s\n", DebugUtils::errorAsString(err));
+      exit(1);
+   }
+
+   return fn;
+}
+
+ReduceFunc conv_reduce(const Expr *expr,
+                       KernelSource source,
+                       JitRuntime &rt,
+                       const ExecCtx &ectx) {
+   CodeHolder code;
+   code.init(rt.environment(), rt.cpuFeatures());
+
+   ReduceCtx ctx(rt, code, ectx, source);
+   ctx.conv_kernel(expr);
+
+   return ctx.end();
+}
@@ -0,0 +1,169 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef REDUCE_HPP
+#define REDUCE_HPP
+
+#include "compile.hpp"
+#include "ddouble.hpp"
+#include <cstdint>
+
+/* Where a fused kernel gets its x values from */
+enum KernelSource {
+   /* x = a + (i + offset) h */
+   AFFINE,
+
+   /* (x, y) uniform in the box [xmin, xmin + xrange] x [ymin, ymin + yrange],
+    * taken from the splitmix64 stream at indices 2i and 2i + 1.
+    * x is kept inside column i % strata of the box's equal columns.
+    */
+   RANDOM,
+
+   /* (x, y) in the same box, from the ith point of the Sobol sequence shifted by the seed */
+   SOBOL
+};
+
+/* Inputs to a fused kernel. Only the fields for its source are read. */
+struct KernelParams {
+   double a, h, offset;
+   double xmin, xrange, ymin, yrange;
+   uint64_t seed;
+
+   /* Number of columns for stratified sampling. Must be a power of two; 1 for none. */
+   uint64_t strata;
+};
+
+/* Accumulators returned by a fused kernel.
+ * NaN values of f are left out of everything except the sample count.
+ */
+struct Reduction {
+   /* Sum of f(x), as a double-double */
+   DDouble sum;
+
+   /* Number of samples where f(x) wasn't NaN */
+   double count;
+
+   /* Random or Sobol samples under the curve and above the x axis, minus those below both */
+   double hits;
+
+   /* The expected value of hits over y for each sample's x: the signed height of f(x)
+    * clipped to the box, as a fraction of the box's height
+    */
+   double height;
+
+   double min, max;
+
+   /**
+    * The accumulators for an empty range.
+    */
+   static Reduction empty();
+};
+
+/**
+ * Combines the accumulators of two ranges.
+ */
+Reduction merge(const Reduction &A, const Reduction &B);
+
+/* A compiled kernel. Evaluates f for every index in [begin, end) and reduces the results. */
+typedef void (*ReduceFunc)(const KernelParams *params,
+                           int64_t begin,
+                           int64_t end,
+                           Reduction *out);
+
+/* A class to store information for the compilation of a fused kernel.
+ * The x values are generated in registers and the results are reduced in registers,
+ * so nothing is written to memory until the loop is over.
+ */
+class ReduceCtx : public CompCtx {
+public:
+   ReduceCtx(JitRuntime &rt,
+             CodeHolder &code,
+             const ExecCtx &ectx,
+             KernelSource source);
+
+   /**
+    * Compiles the whole loop around an expression.
+    *
+    * @param expr The expression to evaluate at every index
+    */
+   void conv_kernel(const Expr *expr);
+
+   /**
+    * Finalizes the compiler
+    *
+    * @return The compiled kernel
+    */
+   ReduceFunc end();
+
+private:
+   KernelSource source;
+
+   x86::Gp params, begin, stop, out;
+
+   /**
+    * Emits code for the nth output of the splitmix64 stream.
+    *
+    * @param z Where to put the result
+    * @param seed The stream's seed
+    * @param n The index into the stream
+    */
+   void emit_splitmix(x86::Gp z, x86::Gp seed, x86::Gp n);
+
+   /**
+    * Emits code to turn the top 53 bits of z into a double in [0, 1). Clobbers z.
+    */
+   void emit_unit(x86::Xmm u, x86::Gp z);
+
+   /**
+    * Emits code for a uniform double in [0, 1) from the splitmix64 stream.
+    *
+    * @param u Where to put the result
+    * @param seed The stream's seed
+    * @param n The index into the stream
+    */
+   void emit_uniform(x86::Xmm u, x86::Gp seed, x86::Gp n);
+};
+
+/**
+ * Compiles a fused kernel for the provided expression.
+ *
+ * @param expr The expression to compile
+ * @param source Where the kernel gets its x values
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ *
+ * @return The compiled kernel
+ */
+ReduceFunc conv_reduce(const Expr *expr,
+                       KernelSource source,
+                       JitRuntime &rt,
+                       const ExecCtx &ectx);
+
+/**
+ * Runs a kernel over [begin, end) and returns its accumulators.
+ */
+inline Reduction run_reduce(ReduceFunc kernel,
+                            const KernelParams &params,
+                            int64_t begin,
+                            int64_t end) {
+   Reduction res;
+   kernel(&params, begin, end, &res);
+   return res;
+}
+
+#endif
@@ -18,6 +18,7 @@
 
 #include "compile.hpp"
 
+#include <cmath>
 #include <cstdio>
 #include <iostream>
 #include <sstream>
@@ -37,6 +38,7 @@ void repl() {
 
    ExecCtx ectx;
    double result;
+   QueryResult query;
    while (true) {
       linestream.str("");
 
@@ -64,11 +66,50 @@ void repl() {
 
       expr = nullptr;
       try {
-         if (conv_eval_str(rt, line.c_str(), ectx, &expr, result)) {
+         if (conv_eval_str(rt, line.c_str(), ectx, &expr, result,
+                           nullptr, nullptr, &query)) {
             printf("> ");
             print_expr(expr, (FILE *)stdout);
             printf(" = %.2f\n", result);
          }
+         else if (query.query == ROOTS_QUERY) {
+            printf("> Roots(%s, %g, %g) = ", query.funcname.c_str(), query.lower, query.upper);
+            if (query.values.empty()) {
+               printf("none");
+            }
+
+            for (size_t i = 0; i < query.values.size(); i++) {
+               printf(i == 0 ? "%.10g" : ", %.10g", query.values[i]);
+            }
+
+            printf("\n");
+         }
+         else if (query.query == EXTREMA_QUERY) {
+            printf("> Extrema(%s, %g, %g) = ", query.funcname.c_str(), query.lower, query.upper);
+            if (query.values.empty()) {
+               printf("none");
+            }
+
+            for (size_t i = 0; i < query.values.size(); i++) {
+               printf(i == 0 ? "%s at %.10g" : ", %s at %.10g",
+                      query.maxima[i] ? "max" : "min", query.values[i]);
+               printf(" (y = %.10g)", query.heights[i]);
+            }
+
+            printf("\n");
+         }
+         else if (query.query == SUM_QUERY || query.query == LIMIT_QUERY) {
+            printf("> %s(%s, %g) = ", query.query == SUM_QUERY ? "Sum" : "Limit",
+                   query.funcname.c_str(), query.lower);
+            if (std::isnan(query.values[0])) {
+               printf("undefined after %d terms\n", query.terms);
+            }
+            else {
+               printf("%.12g (error ~%.2g, %s, %d terms%s)\n", query.values[0], query.error,
+                      query.method.c_str(), query.terms,
+                      query.converged ? "" : ", did not converge");
+            }
+         }
 
          printf("\n");
       }
@@ -0,0 +1,185 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "roots.hpp"
+#include "asymptotes.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+/* A piece of the interval that the function changes sign across */
+struct Bracket {
+   double lo, hi,
+          flo, fhi;
+};
+
+double brent(Func fn, double a, double b, double fa, double fb) {
+   // c is kept on the other side of the root from b, so [b, c] always brackets it.
+   // a is the previous value of b.
+   double c = b, fc = fb,
+          d = b - a, e = d;
+
+   for (int i = 0; i < ROOT_MAX_ITER; i++) {
+      if ((fb > 0) == (fc > 0)) {
+         c = a;
+         fc = fa;
+         d = e = b - a;
+      }
+
+      if (std::fabs(fc) < std::fabs(fb)) {
+         a = b;   b = c;   c = a;
+         fa = fb; fb = fc; fc = fa;
+      }
+
+      double tol = 2 * DBL_EPSILON * std::fabs(b) + ROOT_TOL / 2,
+             m = (c - b) / 2;
+
+      if (std::fabs(m) <= tol || fb == 0) {
+         return b;
+      }
+
+      if (std::fabs(e) < tol || std::fabs(fa) <= std::fabs(fb)) {
+         // The last step didn't shrink the bracket enough. Bisect.
+         d = e = m;
+      } else {
+         double s = fb / fa, p, q;
+         if (a == c) {
+            // Secant step
+            p = 2 * m * s;
+            q = 1 - s;
+         } else {
+            // Inverse quadratic interpolation
+            double r = fb / fc;
+            q = fa / fc;
+            p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+            q = (q - 1) * (r - 1) * (s - 1);
+         }
+
+         if (p > 0) {
+            q = -q;
+         } else {
+            p = -p;
+         }
+
+         // Only take the step if it lands well inside the bracket and converges quickly enough.
+         if (2 * p < std::min(3 * m * q - std::fabs(tol * q), std::fabs(e * q))) {
+            e = d;
+            d = p / q;
+         } else {
+            d = e = m;
+         }
+      }
+
+      a = b;
+      fa = fb;
+      if (std::fabs(d) > tol) {
+         b += d;
+      } else {
+         b += m > 0 ? tol : -tol;
+      }
+
+      fb = fn(b);
+   }
+
+   return b;
+}
+
+std::vector<double> sample_interval(BatchFunc batch, double a, double b, int n) {
+   double h = (b - a) / n;
+   std::vector<double> xs(n + 1), ys(n + 1);
+   ThreadPool::shared().run((n + ROOT_CHUNK) / ROOT_CHUNK, [&](int64_t k) {
+      int64_t lo = k * ROOT_CHUNK,
+              hi = std::min<int64_t>(lo + ROOT_CHUNK, n + 1);
+      for (int64_t i = lo; i < hi; i++) {
+         xs[i] = i == n ? b : a + i * h;
+      }
+
+      const double *args[1] = { &xs[lo] };
+      batch(args, &ys[lo], hi - lo);
+   });
+
+   return ys;
+}
+
+std::vector<double> find_roots(BatchFunc batch, Func fn, double a, double b, int n) {
+   if (!(a < b) || n < 1) {
+      return {};
+   }
+
+   double h = (b - a) / n;
+   auto x_at = [=](int64_t i) {
+      return i == n ? b : a + i * h;
+   };
+
+   std::vector<double> ys = sample_interval(batch, a, b, n);
+
+   // Exact zeros are their own brackets, so the roots come out in order.
+   std::vector<Bracket> brackets;
+   for (int64_t i = 0; i <= n; i++) {
+      if (ys[i] == 0) {
+         brackets.push_back({ x_at(i), x_at(i), 0, 0 });
+      } else if (i < n
+                 && ys[i + 1] != 0
+                 && std::isfinite(ys[i]) && std::isfinite(ys[i + 1])
+                 && (ys[i] > 0) != (ys[i + 1] > 0)) {
+         brackets.push_back({ x_at(i), x_at(i + 1), ys[i], ys[i + 1] });
+      }
+   }
+
+   // Each bracket is refined on its own, and gets a slot for its result.
+   std::vector<double> found(brackets.size());
+   ThreadPool::shared().run(brackets.size(), [&](int64_t k) {
+      const Bracket &br = brackets[k];
+      if (br.lo == br.hi) {
+         found[k] = br.lo;
+         return;
+      }
+
+      Point A = { br.lo, br.flo },
+            B = { br.hi, br.fhi };
+      if (goes_pos_inf(fn, A, B, b - a).y != 0 || goes_neg_inf(fn, A, B, b - a).y != 0) {
+         // The sign change is across an asymptote, like tan(x) at pi/2.
+         found[k] = NAN;
+         return;
+      }
+
+      double r = brent(fn, br.lo, br.hi, br.flo, br.fhi),
+             fr = fn(r);
+
+      // A jump discontinuity also changes sign, but the function doesn't get any closer to 0 there.
+      // One end of the bracket may already have been almost exactly on the root, so that alone isn't enough.
+      double lo_mag = std::min(std::fabs(br.flo), std::fabs(br.fhi)),
+             hi_mag = std::max(std::fabs(br.flo), std::fabs(br.fhi));
+      if (!std::isfinite(fr) || (std::fabs(fr) >= lo_mag && std::fabs(fr) > ROOT_RESIDUAL * hi_mag)) {
+         found[k] = NAN;
+      } else {
+         found[k] = r;
+      }
+   });
+
+   std::vector<double> roots;
+   for (double r: found) {
+      if (!std::isnan(r)) {
+         roots.push_back(r);
+      }
+   }
+
+   return roots;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef ROOTS_HPP
+#define ROOTS_HPP
+
+#include "compile.hpp"
+#include <vector>
+
+/* Number of pieces the interval is cut into when looking for sign changes */
+#define ROOT_SCAN 4096
+
+/* Number of scan points each pool task evaluates in one batch */
+#define ROOT_CHUNK 256
+
+/* Absolute tolerance of the refined roots */
+#define ROOT_TOL 1e-13
+
+/* A refined root may be no further from 0 than this fraction of the larger end of its bracket */
+#define ROOT_RESIDUAL 1e-6
+
+/* Most iterations Brent's method takes on a bracket */
+#define ROOT_MAX_ITER 200
+
+/**
+ * Refines a root of a function with Brent's method.
+ * fn(a) and fn(b) must have opposite signs.
+ *
+ * @param fn The function
+ * @param a One end of the bracket
+ * @param b The other end of the bracket
+ * @param fa fn(a)
+ * @param fb fn(b)
+ *
+ * @return The root
+ */
+double brent(Func fn, double a, double b, double fa, double fb);
+
+/**
+ * Evaluates a function at evenly spaced points across an interval, in parallel.
+ *
+ * @param batch The function, compiled to evaluate arrays of points
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param n How many pieces to cut the interval into
+ *
+ * @return fn at each of the n + 1 points, from a to b
+ */
+std::vector<double> sample_interval(BatchFunc batch, double a, double b, int n);
+
+/**
+ * Finds the roots of a function in an interval.
+ * The interval is sampled in parallel to find where the function changes sign,
+ * sign changes across an asymptote are thrown out, and the rest are refined with Brent's method.
+ * Roots of even multiplicity (where the function touches zero without crossing)
+ * are only found if a sample lands exactly on them.
+ *
+ * @param batch The function, compiled to evaluate arrays of points, for the scan
+ * @param fn The function, for refining the roots
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param n How many pieces to cut the interval into while scanning
+ *
+ * @return The roots, in increasing order
+ */
+std::vector<double> find_roots(BatchFunc batch, Func fn, double a, double b, int n = ROOT_SCAN);
+
+#endif
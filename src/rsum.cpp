@@ -0,0 +1,378 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "rsum.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool SumSettings::operator==(const SumSettings &other) const {
+   return lower == other.lower
+       && upper == other.upper
+       && step == other.step
+       && rule == other.rule
+       && dd == other.dd
+       && levels == other.levels;
+}
+
+bool SumSettings::operator!=(const SumSettings &other) const {
+   return !(*this == other);
+}
+
+RSumEngine::RSumEngine(ThreadPool &_pool)
+   : expr(nullptr),
+     settings({ 0, 0, 0, MIDPOINT, false, 1 }),
+     stale(true),
+     pool(_pool),
+     busy(false),
+     cancelled(false),
+     done_steps(0),
+     total_steps(0),
+     rt(nullptr),
+     ectx(nullptr),
+     fn(nullptr),
+     dd_fn(nullptr),
+     kernel(nullptr),
+     sum(0)
+{}
+
+RSumEngine::~RSumEngine() {
+   cancel();
+   release();
+   destroy_expr(expr);
+}
+
+void RSumEngine::release() {
+   if (fn != nullptr) {
+      rt->release(fn);
+      fn = nullptr;
+   }
+
+   if (dd_fn != nullptr) {
+      rt->release(dd_fn);
+      dd_fn = nullptr;
+   }
+
+   if (kernel != nullptr) {
+      rt->release(kernel);
+      kernel = nullptr;
+   }
+}
+
+void RSumEngine::compile() {
+   if (fn == nullptr) {
+      fn = conv_expr(expr, *rt, *ectx);
+   }
+
+   if (settings.dd && dd_fn == nullptr) {
+      dd_fn = conv_expr_dd(expr, *rt, *ectx);
+   } else if (!settings.dd && kernel == nullptr) {
+      kernel = conv_reduce(expr, AFFINE, *rt, *ectx);
+   }
+}
+
+void RSumEngine::set_expr(const Expr *_expr, JitRuntime &_rt, const ExecCtx &_ectx) {
+   if (expr != nullptr && equal_expr(expr, _expr) && rt == &_rt && ectx == &_ectx) {
+      return;
+   }
+
+   cancel();
+   release();
+   destroy_expr(expr);
+
+   expr = copy_expr(_expr);
+   rt = &_rt;
+   ectx = &_ectx;
+   stale = true;
+}
+
+void RSumEngine::set_settings(const SumSettings &_settings) {
+   if (_settings != settings) {
+      cancel();
+      settings = _settings;
+      stale = true;
+   }
+}
+
+DDouble RSumEngine::eval_at(int64_t i, double offset, double a, double h) {
+   if (settings.dd) {
+      DDouble y = dd_call(dd_fn, two_prod(i + offset, h) + a);
+      return std::isnan(y.value())? DDouble::of(0): y;
+   }
+
+   double y = fn(a + (i + offset) * h);
+   return DDouble::of(std::isnan(y)? 0: y);
+}
+
+/**
+ * Adds up partial sums as a balanced tree, always in the same order.
+ */
+static DDouble tree_sum(const std::vector<DDouble> &partials, size_t lo, size_t hi) {
+   if (hi - lo == 1) {
+      return partials[lo];
+   }
+
+   size_t mid = lo + (hi - lo) / 2;
+   return tree_sum(partials, lo, mid) + tree_sum(partials, mid, hi);
+}
+
+DDouble RSumEngine::grid_sum(double a, double h, double offset, int64_t begin, int64_t end) {
+   if (end <= begin) {
+      return DDouble::of(0);
+   }
+
+   int64_t n_blocks = (end - begin + SUM_BLOCK - 1) / SUM_BLOCK;
+   std::vector<DDouble> partials(n_blocks, DDouble::of(0));
+   pool.run(n_blocks, [&](int64_t k) {
+      if (cancelled) {
+         return;
+      }
+
+      int64_t lo = begin + k * SUM_BLOCK,
+              hi = std::min(lo + SUM_BLOCK, end);
+      if (!settings.dd) {
+         KernelParams params = { a, h, offset };
+         partials[k] = run_reduce(kernel, params, lo, hi).sum;
+      } else {
+         // x is computed in double-double from the index, so it doesn't drift.
+         DDouble total = DDouble::of(0);
+         for (int64_t i = lo; i < hi; i++) {
+            total = total + eval_at(i, offset, a, h);
+         }
+
+         partials[k] = total;
+      }
+
+      done_steps += hi - lo;
+   });
+
+   return tree_sum(partials, 0, n_blocks);
+}
+
+void RSumEngine::compute() {
+   wait();
+   if (!stale || expr == nullptr) {
+      return;
+   }
+
+   compile();
+   busy = true;
+   run();
+}
+
+void RSumEngine::compute_async() {
+   // Anything that would change the sum cancels the running computation first.
+   if (busy || !stale || expr == nullptr) {
+      return;
+   }
+
+   wait();
+   compile();
+   busy = true;
+   worker = std::thread(&RSumEngine::run, this);
+}
+
+bool RSumEngine::running() const {
+   return busy;
+}
+
+double RSumEngine::progress() const {
+   int64_t total = total_steps;
+   return total > 0? std::min((double) done_steps / total, 1.0): 0;
+}
+
+void RSumEngine::wait() {
+   if (worker.joinable()) {
+      worker.join();
+   }
+}
+
+void RSumEngine::cancel() {
+   cancelled = true;
+   wait();
+   cancelled = false;
+}
+
+DDouble RSumEngine::rule_sum(SumRule rule, double h, int64_t n) {
+   double lower = settings.lower;
+   switch (rule) {
+   case LEFT:
+      return grid_sum(lower, h, 0, 0, n);
+   case RIGHT:
+      return grid_sum(lower, h, 1, 0, n);
+   case MIDPOINT:
+      return grid_sum(lower, h, 0.5, 0, n);
+   default:
+      return grid_sum(lower, h, 0, 1, n)
+           + (eval_at(0, 0, lower, h) + eval_at(n, 0, lower, h)) * 0.5;
+   }
+}
+
+DDouble RSumEngine::refine_sum(SumRule rule, double h, int64_t n) {
+   if (rule == MIDPOINT) {
+      return grid_sum(settings.lower, h, 1.0 / 6, 0, n)
+           + grid_sum(settings.lower, h, 5.0 / 6, 0, n);
+   }
+
+   return grid_sum(settings.lower, h, 0.5, 0, n);
+}
+
+void RSumEngine::run() {
+   double lower = settings.lower,
+          upper = settings.upper;
+   int levels = std::min(std::max(settings.levels, 1), MAX_SUM_LEVELS);
+
+   // Each level halves the steps of the one before, which keeps every old point, except
+   // for the midpoint rule, whose points are only kept when the steps are split in three.
+   // Simpson's rule is made from two trapezoid sums, so it takes one more of them.
+   SumRule base = settings.rule == SIMPSON? TRAPEZOID: settings.rule;
+   int64_t ratio = base == MIDPOINT? 3: 2;
+   int wanted = settings.rule == SIMPSON? levels + 1: levels;
+
+   // The steps are shrunk slightly so that a whole number of them covers [lower, upper].
+   int64_t n = std::max((int64_t) std::ceil((upper - lower) / settings.step), (int64_t) 1);
+   if (settings.rule == SIMPSON && n % 2 != 0) {
+      n++;
+   }
+
+   double h = (upper - lower) / n;
+
+   // The finest level keeps that step, and every coarser one needs a whole number of steps
+   // too, so the study stops short once n no longer divides by the ratio.
+   int64_t coarse = 1;
+   for (int sums = 1; sums < wanted && n % (coarse * ratio) == 0; sums++) {
+      coarse *= ratio;
+   }
+
+   int64_t steps = n / coarse;
+   done_steps = 0;
+   total_steps = base == TRAPEZOID? steps - 1: steps;
+   for (int64_t m = steps; m < n; m *= ratio) {
+      total_steps += m * (ratio - 1);
+   }
+
+   // Only the points each level adds are evaluated, so the whole study costs
+   // as much as its finest sum.
+   std::vector<DDouble> estimates;
+   std::vector<int64_t> counts;
+   DDouble total = rule_sum(base, (upper - lower) / steps, steps);
+   estimates.push_back(total * ((upper - lower) / steps));
+   counts.push_back(steps);
+
+   while (steps < n && !cancelled) {
+      total = total + refine_sum(base, (upper - lower) / steps, steps);
+      steps *= ratio;
+      estimates.push_back(total * ((upper - lower) / steps));
+      counts.push_back(steps);
+   }
+
+   if (cancelled) {
+      busy = false;
+      return;
+   }
+
+   // Simpson's sum is (4 T(h) - T(2 h)) / 3, weighting odd points by 4 and interior even points by 2.
+   if (settings.rule == SIMPSON) {
+      for (size_t k = estimates.size() - 1; k > 0; k--) {
+         estimates[k] = (estimates[k] * 4 - estimates[k - 1]) / DDouble::of(3);
+      }
+
+      estimates.erase(estimates.begin());
+      counts.erase(counts.begin());
+   }
+
+   sum = estimates.back().value();
+
+   // Richardson extrapolation, with each column removing the next power of the step
+   // from the error. Left and right sums have every power, the others only even ones,
+   // and Simpson's rule starts at the fourth.
+   double first = settings.rule == SIMPSON? 4: base == LEFT || base == RIGHT? 1: 2,
+          next = base == LEFT || base == RIGHT? 1: 2;
+
+   study.clear();
+   std::vector<DDouble> row, prev;
+   for (size_t k = 0; k < estimates.size(); k++) {
+      row.assign(1, estimates[k]);
+
+      double factor = std::pow(ratio, first);
+      for (size_t j = 1; j <= k; j++) {
+         row.push_back(row[j - 1] + (row[j - 1] - prev[j - 1]) / DDouble::of(factor - 1));
+         factor *= std::pow(ratio, next);
+      }
+
+      study.push_back({ counts[k], estimates[k].value(), row.back().value() });
+      prev.swap(row);
+   }
+
+   // Drawing uses plain doubles, with each rectangle covering a group of steps
+   // once there are too many of them.
+   rects.clear();
+   int64_t group = (n + MAX_RECTS - 1) / MAX_RECTS;
+   for (int64_t i = 0; i < n; i += group) {
+      int64_t j = std::min(i + group, n);
+      double x0 = lower + i * h,
+             x1 = lower + j * h;
+
+      double left, right;
+      switch (settings.rule) {
+      case LEFT:
+         left = right = fn(x0);
+         break;
+      case RIGHT:
+         left = right = fn(x1);
+         break;
+      case MIDPOINT:
+         left = right = fn(lower + (i + j) * 0.5 * h);
+         break;
+      default:
+         left = fn(x0);
+         right = fn(x1);
+         break;
+      }
+
+      rects.push_back({ x0, x1 - x0, left, right });
+   }
+
+   stale = false;
+   busy = false;
+}
+
+double RSumEngine::value() const {
+   return sum;
+}
+
+const std::vector<SumRect> &RSumEngine::get_rects() const {
+   return rects;
+}
+
+const std::vector<SumLevel> &RSumEngine::get_study() const {
+   return study;
+}
+
+double riemann_sum(const Expr *expr,
+                   const SumSettings &settings,
+                   JitRuntime &rt,
+                   const ExecCtx &ectx,
+                   ThreadPool &pool) {
+   RSumEngine engine(pool);
+   engine.set_expr(expr, rt, ectx);
+   engine.set_settings(settings);
+   engine.compute();
+
+   return engine.value();
+}
@@ -0,0 +1,267 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef RSUM_HPP
+#define RSUM_HPP
+
+#include "compile.hpp"
+#include "ddcompile.hpp"
+#include "ddouble.hpp"
+#include "reduce.hpp"
+#include "threadpool.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/* The most rectangles kept for drawing. Longer sums are drawn with coarser ones. */
+#define MAX_RECTS 2048
+
+/* Number of steps in each block of a sum. Blocks are the unit of work for the thread pool,
+ * and their partial sums are always combined in the same order, so the result doesn't
+ * depend on how many threads there are.
+ */
+#define SUM_BLOCK (1 << 16)
+
+/* The most levels in a convergence study */
+#define MAX_SUM_LEVELS 12
+
+/* Where in each step a Riemann sum samples the function */
+enum SumRule {
+   LEFT, RIGHT, MIDPOINT, TRAPEZOID, SIMPSON
+};
+
+/* Everything besides the function that determines a Riemann sum */
+struct SumSettings {
+   double lower, upper, step;
+   SumRule rule;
+
+   /* Should the function be evaluated in double-double precision? */
+   bool dd;
+
+   /* How many sums a convergence study computes, each refining the one before.
+    * The finest uses the step above. 1 computes that sum alone.
+    * There are fewer when the number of steps doesn't divide evenly into that many levels,
+    * which get_study() shows.
+    */
+   int levels;
+
+   bool operator==(const SumSettings &other) const;
+
+   bool operator!=(const SumSettings &other) const;
+};
+
+/* A piece of the sum to draw, with the heights of its left and right edges.
+ * The two are equal except for the trapezoid and Simpson rules.
+ */
+struct SumRect {
+   double x, width;
+   double left, right;
+};
+
+/* One sum of a convergence study, along with its Richardson extrapolation
+ * from the coarser sums before it
+ */
+struct SumLevel {
+   int64_t steps;
+   double estimate, extrapolated;
+};
+
+/* Computes Riemann sums independently of any drawing.
+ * Results are kept until the expression or the settings change.
+ * Sums can be computed in the background, in which case the results may only be read
+ * once running() is false.
+ */
+class RSumEngine {
+   /* The expression being summed, and the one it was compiled from */
+   Expr *expr;
+
+   SumSettings settings;
+
+   /* Does the sum need to be computed again? */
+   bool stale;
+
+   ThreadPool &pool;
+
+   /* The background computation, if there is one */
+   std::thread worker;
+   std::atomic<bool> busy, cancelled;
+
+   /* Steps done so far and in total, for progress reports */
+   std::atomic<int64_t> done_steps, total_steps;
+
+   JitRuntime *rt;
+   const ExecCtx *ectx;
+
+   /* Compiled forms of the expression, only made when needed */
+   Func fn;
+   DDFunc dd_fn;
+   ReduceFunc kernel;
+
+   /* Results */
+   double sum;
+   std::vector<SumRect> rects;
+   std::vector<SumLevel> study;
+
+   /**
+    * Releases the compiled functions.
+    */
+   void release();
+
+   /**
+    * Compiles whatever the current settings need.
+    */
+   void compile();
+
+   /**
+    * Computes the sum and the rectangles. Can be run on another thread.
+    */
+   void run();
+
+   /**
+    * Evaluates the function, taking NaN as 0.
+    *
+    * @param i The index of the point
+    * @param offset The offset of the point within its step
+    * @param a The start of the grid
+    * @param h The grid step
+    */
+   DDouble eval_at(int64_t i, double offset, double a, double h);
+
+   /**
+    * Adds up the function over a uniform grid, skipping NaNs.
+    * The grid is split into blocks which are summed across the thread pool.
+    *
+    * @param a The start of the grid
+    * @param h The grid step
+    * @param offset The offset of each point within its step
+    * @param begin The first index
+    * @param end One past the last index
+    */
+   DDouble grid_sum(double a, double h, double offset, int64_t begin, int64_t end);
+
+   /**
+    * Adds up the function at the points a rule samples, without multiplying by the step.
+    * Simpson's rule isn't handled here, as it's built from trapezoid sums.
+    *
+    * @param rule The rule
+    * @param h The step
+    * @param n The number of steps
+    */
+   DDouble rule_sum(SumRule rule, double h, int64_t n);
+
+   /**
+    * Adds up the function at the points a refinement adds to a sum, which are the
+    * midpoints of the old steps when they're halved, or the points a sixth of the way
+    * in from either end when the midpoint rule's steps are split in three.
+    *
+    * @param rule The rule
+    * @param h The old step
+    * @param n The old number of steps
+    */
+   DDouble refine_sum(SumRule rule, double h, int64_t n);
+
+public:
+   /**
+    * @param pool The threads to compute sums on
+    */
+   RSumEngine(ThreadPool &pool = ThreadPool::background());
+
+   ~RSumEngine();
+
+   RSumEngine(const RSumEngine &) = delete;
+
+   /**
+    * Sets the expression to sum. Does nothing if it's the same as the current one.
+    *
+    * @param expr The expression
+    * @param rt The asmjit runtime
+    * @param ectx The context storing the symbol tables
+    */
+   void set_expr(const Expr *expr, JitRuntime &rt, const ExecCtx &ectx);
+
+   /**
+    * Sets the bounds, step and rule. Does nothing if they're the same as the current ones.
+    */
+   void set_settings(const SumSettings &settings);
+
+   /**
+    * Computes the sum if anything changed since it was last computed.
+    */
+   void compute();
+
+   /**
+    * Starts computing the sum in the background if anything changed since it was
+    * last computed. The expression is compiled before this returns.
+    */
+   void compute_async();
+
+   /**
+    * Is a sum being computed in the background?
+    */
+   bool running() const;
+
+   /**
+    * Gets how far along the current computation is, from 0 to 1.
+    */
+   double progress() const;
+
+   /**
+    * Waits for the background computation, if any, to finish.
+    */
+   void wait();
+
+   /**
+    * Stops the background computation, if any, leaving the sum to be computed again.
+    */
+   void cancel();
+
+   /**
+    * Gets the last computed sum.
+    */
+   double value() const;
+
+   /**
+    * Gets the rectangles of the last computed sum.
+    */
+   const std::vector<SumRect> &get_rects() const;
+
+   /**
+    * Gets the sums of the last convergence study, from coarsest to finest.
+    * The last one is the same as value().
+    */
+   const std::vector<SumLevel> &get_study() const;
+};
+
+/**
+ * Computes a Riemann sum of an expression in one go.
+ *
+ * @param expr The expression to sum
+ * @param settings The bounds, step and rule
+ * @param rt The asmjit runtime
+ * @param ectx The context storing the symbol tables
+ * @param pool The threads to compute the sum on
+ *
+ * @return The sum
+ */
+double riemann_sum(const Expr *expr,
+                   const SumSettings &settings,
+                   JitRuntime &rt,
+                   const ExecCtx &ectx,
+                   ThreadPool &pool = ThreadPool::background());
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "series.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const char *accel_name(Accel method) {
+   switch (method) {
+   case RICHARDSON:
+      return "Richardson";
+   case AITKEN:
+      return "Aitken";
+   case WYNN:
+      return "Wynn epsilon";
+   case LEVIN:
+      return "Levin u";
+   }
+
+   return "";
+}
+
+double richardson(const std::vector<double> &s, int K) {
+   // The nodes are spread over the second half of the terms. Nodes closer together amplify rounding,
+   //  and nodes further back are too early for the expansion to hold.
+   int m = std::min(K / 2, RICHARDSON_NODES);
+   std::vector<double> h, t;
+   for (int i = 0; i < m; i++) {
+      int n = K - i * K / (2 * m);
+      h.push_back(1.0 / n);
+      t.push_back(s[n - 1]);
+   }
+
+   // Neville's algorithm, evaluating the interpolating polynomial in 1/n at 0
+   for (int k = 1; k < m; k++) {
+      for (int i = 0; i < m - k; i++) {
+         t[i] = (h[i] * t[i + 1] - h[i + k] * t[i]) / (h[i] - h[i + k]);
+      }
+   }
+
+   return t[0];
+}
+
+double aitken(const std::vector<double> &s, int K) {
+   std::vector<double> col(s.begin(), s.begin() + K);
+   while (col.size() >= 3) {
+      std::vector<double> next(col.size() - 2);
+      for (size_t i = 0; i < next.size(); i++) {
+         double d1 = col[i + 1] - col[i],
+                d2 = col[i + 2] - 2 * col[i + 1] + col[i];
+
+         // A zero second difference means the sequence has already settled.
+         if (d2 == 0) {
+            return col.back();
+         }
+
+         next[i] = col[i] - d1 * d1 / d2;
+      }
+
+      col = next;
+   }
+
+   return col.back();
+}
+
+double wynn(const std::vector<double> &s, int K) {
+   // Only the even columns estimate the limit. The odd ones are intermediate.
+   std::vector<double> prev(K + 1, 0),
+                       cur(s.begin(), s.begin() + K);
+
+   double best = cur.back();
+   for (int col = 1; cur.size() > 1; col++) {
+      std::vector<double> next(cur.size() - 1);
+      for (size_t i = 0; i < next.size(); i++) {
+         double diff = cur[i + 1] - cur[i];
+         if (diff == 0) {
+            return col % 2 == 1 ? cur[i + 1] : best;
+         }
+
+         next[i] = prev[i + 1] + 1 / diff;
+      }
+
+      if (col % 2 == 0) {
+         best = next.back();
+      }
+
+      prev = cur;
+      cur = next;
+   }
+
+   return best;
+}
+
+double levin(const std::vector<double> &s, int K) {
+   static const double BETA = 1;
+
+   int k = K - 1;
+
+   // L = sum_j (-1)^j C(k, j) c_j S_j / w_j / sum_j (-1)^j C(k, j) c_j / w_j
+   //  with c_j = ((BETA + j) / (BETA + k))^(k-1) and the remainder model w_j = (BETA + j) a_j.
+   double num = 0,
+          den = 0,
+          binom = 1;
+   for (int j = 0; j <= k; j++) {
+      double term = j == 0 ? s[0] : s[j] - s[j - 1],
+             w = (BETA + j) * term;
+      if (w == 0) {
+         // A zero term means the partial sums stopped moving.
+         return s[k];
+      }
+
+      double c = binom * std::pow((BETA + j) / (BETA + k), k - 1) / w;
+      if (j % 2 == 1) {
+         c = -c;
+      }
+
+      num += c * s[j];
+      den += c;
+      binom = binom * (k - j) / (j + 1);
+   }
+
+   return num / den;
+}
+
+SeriesResult accelerate(const std::vector<double> &s) {
+   static const Accel METHODS[] = { RICHARDSON, AITKEN, WYNN, LEVIN };
+
+   int K = s.size();
+   SeriesResult best = { s.back(), INFINITY, AITKEN, K, false };
+   if (K < 4) {
+      return best;
+   }
+
+   for (Accel method: METHODS) {
+      double (*transform)(const std::vector<double> &, int) =
+         method == RICHARDSON ? richardson
+         : method == AITKEN ? aitken
+         : method == WYNN ? wynn
+         : levin;
+
+      // Levin's transform gets worse past a moderate order, so it only ever sees the first terms.
+      int k = method == LEVIN ? std::min(K, LEVIN_MAX_ORDER + 1) : K;
+
+      // A transform which doesn't suit the sequence can still settle on a wrong value,
+      //  so the estimate is also compared with the one from a quarter fewer terms.
+      double value = transform(s, k),
+             error = 0;
+      for (int fewer: { k - 1, k - 2, 3 * k / 4 }) {
+         error = std::max(error, std::fabs(value - transform(s, fewer)));
+      }
+
+      if (std::isfinite(value) && error < best.error) {
+         best.value = value;
+         best.error = error;
+         best.method = method;
+      }
+   }
+
+   best.converged = best.error <= SERIES_CONVERGED_TOL * std::max(1.0, std::fabs(best.value));
+   return best;
+}
+
+/**
+ * Takes terms in doubling batches until the accelerated estimate converges or stops improving.
+ *
+ * @param term The term function
+ * @param a The index of the first term
+ * @param partial Should the terms be summed before they're accelerated?
+ *
+ * @return The best estimate
+ */
+static SeriesResult extrapolate(Func term, double a, bool partial) {
+   std::vector<double> s;
+   SeriesResult best = { NAN, INFINITY, AITKEN, 0, false };
+   for (int K = SERIES_MIN_TERMS; K <= SERIES_MAX_TERMS; K *= 2) {
+      while ((int)s.size() < K) {
+         double t = term(a + s.size());
+         if (!std::isfinite(t)) {
+            best.terms = s.size() + 1;
+            return best;
+         }
+
+         s.push_back(partial && !s.empty() ? s.back() + t : t);
+      }
+
+      // Past a point, more terms only add rounding error to the extrapolations,
+      //  so the best estimate is kept rather than the last one,
+      //  and terms stop being taken once they no longer help.
+      SeriesResult res = accelerate(s);
+      bool stalled = !(res.error < best.error / 2);
+      if (!(res.error > best.error)) {
+         best = res;
+      }
+
+      best.terms = K;
+      if (best.error <= SERIES_TOL * std::max(1.0, std::fabs(best.value))
+          || (stalled && K > SERIES_MIN_TERMS)) {
+         break;
+      }
+   }
+
+   return best;
+}
+
+SeriesResult sum_series(Func term, double a) {
+   return extrapolate(term, a, true);
+}
+
+SeriesResult seq_limit(Func term, double a) {
+   return extrapolate(term, a, false);
+}
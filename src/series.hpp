@@ -0,0 +1,131 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef SERIES_HPP
+#define SERIES_HPP
+
+#include "compile.hpp"
+#include <vector>
+
+/* Terms are taken in doubling batches, from this many up to the maximum,
+   until the error estimate stops shrinking */
+#define SERIES_MIN_TERMS 16
+#define SERIES_MAX_TERMS 256
+
+/* Relative error estimate at which no more terms are taken */
+#define SERIES_TOL 1e-12
+
+/* Relative error estimate below which the sequence is taken to converge at all */
+#define SERIES_CONVERGED_TOL 1e-6
+
+/* Highest order of the Levin transform. Higher orders lose more to cancellation than they gain. */
+#define LEVIN_MAX_ORDER 14
+
+/* Number of partial sums a Richardson extrapolation uses */
+#define RICHARDSON_NODES 8
+
+/* The sequence transforms, each suited to a different kind of convergence */
+enum Accel {
+   RICHARDSON, AITKEN, WYNN, LEVIN
+};
+
+/**
+ * Gets the name of a transform, as it's shown in the REPL.
+ */
+const char *accel_name(Accel method);
+
+/* The limit of a sequence, as estimated from its first terms */
+struct SeriesResult {
+   double value;
+
+   /* How much the estimate changed with the last term taken */
+   double error;
+
+   /* The transform that gave the estimate */
+   Accel method;
+
+   /* Number of terms evaluated */
+   int terms;
+
+   /* Did the error estimate get below SERIES_CONVERGED_TOL? */
+   bool converged;
+};
+
+/**
+ * Richardson extrapolation, assuming s_n = S + c_1/n + c_2/n^2 + ...
+ * The nodes are spread evenly over n = K/2 to K.
+ * Suited to sums of rational functions, which converge logarithmically.
+ *
+ * @param s The first K terms of the sequence
+ * @param K The number of terms to use
+ *
+ * @return The estimated limit
+ */
+double richardson(const std::vector<double> &s, int K);
+
+/**
+ * Aitken's delta-squared process, applied repeatedly.
+ * Suited to sequences which converge linearly, such as geometric series.
+ */
+double aitken(const std::vector<double> &s, int K);
+
+/**
+ * Wynn's epsilon algorithm, which computes the Shanks transform without solving its determinants.
+ * Suited to alternating series and linearly convergent sequences.
+ */
+double wynn(const std::vector<double> &s, int K);
+
+/**
+ * Levin's u transform of the partial sums, which models the remainders from the terms themselves.
+ * Works on logarithmic, linear and alternating convergence alike, but only up to a moderate order.
+ */
+double levin(const std::vector<double> &s, int K);
+
+/**
+ * Estimates the limit of a sequence by trying every transform on it.
+ * The error of each is estimated by how much it changes when the last terms are dropped,
+ *  and the one with the smallest estimated error is chosen.
+ *
+ * @param s The terms of the sequence
+ *
+ * @return The best estimate
+ */
+SeriesResult accelerate(const std::vector<double> &s);
+
+/**
+ * Sums the infinite series F(a) + F(a + 1) + F(a + 2) + ...
+ * Terms are evaluated only until the accelerated partial sums settle.
+ *
+ * @param term The term function
+ * @param a Where the sum starts
+ *
+ * @return The estimated sum
+ */
+SeriesResult sum_series(Func term, double a);
+
+/**
+ * Finds the limit of F(n) as n goes to infinity, from F(a), F(a + 1), F(a + 2), ...
+ *
+ * @param term The sequence
+ * @param a Where the sequence starts
+ *
+ * @return The estimated limit
+ */
+SeriesResult seq_limit(Func term, double a);
+
+#endif
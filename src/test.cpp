@@ -21,6 +21,9 @@ extern "C" {
 }
 
 #include "compile.hpp"
+#include "poly.hpp"
+#include "rsum.hpp"
+#include <cmath>
 #include <vector>
 #include <cassert>
 #include <map>
@@ -50,7 +53,21 @@ void test_expr(JitRuntime &rt,
          printf("> ");
          print_expr(expr, (FILE *)stdout);
          printf(" = %.2f\n", result);
-         if (result < expected - delta || result > expected + delta) {
+
+         // NaN fails every comparison, so it has to be ruled out explicitly,
+         //  and an infinity only matches one of the same sign.
+         bool wrong;
+         if (std::isnan(expected)) {
+            wrong = !std::isnan(result);
+         }
+         else if (std::isinf(expected)) {
+            wrong = !std::isinf(result) || std::signbit(result) != std::signbit(expected);
+         }
+         else {
+            wrong = std::isnan(result) || result < expected - delta || result > expected + delta;
+         }
+
+         if (wrong) {
             printf("FAILED! Expected: %f\n\n", expected);
             ++*fails;
          }
@@ -133,6 +150,184 @@ void test_equal(JitRuntime &rt,
    destroy_expr(expr_b);
 }  
 
+/**
+ * Tests that an expression is rejected with an error
+ *
+ * @param rt The asmjit runtime
+ * @param in The expression in string form
+ * @param ectx The relevant symbol tables
+ * @param ctr The counter for how many tests have been run
+ * @param fails The counter for how many tests have failed
+ */
+void test_error(JitRuntime &rt,
+                const char *in,
+                ExecCtx &ectx,
+                int *ctr, int *fails) {
+   Expr *expr = nullptr;
+   double result;
+   char *funcname = nullptr, *varname = nullptr;
+   printf("> %s\n", in);
+   try {
+      conv_eval_str(rt, in, ectx, &expr, result, &funcname, &varname);
+      printf("FAILED! Expected an error.\n\n");
+      ++*fails;
+      free(funcname);
+      free(varname);
+   }
+   catch (ReportingException *e) {
+      e->report();
+      printf("Success!\n\n");
+      free(e);
+   }
+
+   ++*ctr;
+   destroy_expr(expr);
+}
+
+/**
+ * Tests that a query finds the expected numbers, in order
+ *
+ * @param rt The asmjit runtime
+ * @param in The query in string form
+ * @param ectx The relevant symbol tables
+ * @param ctr The counter for how many tests have been run
+ * @param fails The counter for how many tests have failed
+ * @param expected The numbers it should find
+ * @param delta Error tolerance
+ */
+void test_query(JitRuntime &rt,
+                const char *in,
+                ExecCtx &ectx,
+                int *ctr, int *fails,
+                const std::vector<double> &expected,
+                double delta = 0.001) {
+   Expr *expr = nullptr;
+   double result;
+   QueryResult res;
+   try {
+      conv_eval_str(rt, in, ectx, &expr, result, nullptr, nullptr, &res);
+      printf("> %s =", in);
+      for (double v: res.values) {
+         printf(" %.6f", v);
+      }
+      printf("\n");
+
+      bool matches = res.values.size() == expected.size();
+      for (size_t i = 0; matches && i < expected.size(); i++) {
+         matches = res.values[i] >= expected[i] - delta && res.values[i] <= expected[i] + delta;
+      }
+
+      // A sum or limit that only came close without converging doesn't count.
+      if ((res.query == SUM_QUERY || res.query == LIMIT_QUERY) && !res.converged) {
+         printf("FAILED! The estimate didn't converge.\n\n");
+         ++*fails;
+      }
+      else if (!matches) {
+         printf("FAILED! Expected:");
+         for (double v: expected) {
+            printf(" %f", v);
+         }
+         printf("\n\n");
+         ++*fails;
+      }
+      else {
+         printf("Success!\n\n");
+      }
+
+      ++*ctr;
+   }
+   catch (ReportingException *e) {
+      e->report();
+      free(e);
+   }
+
+   destroy_expr(expr);
+}
+
+/**
+ * Tests the integral of a polynomial clamped to a range of heights
+ *
+ * @param poly The polynomial
+ * @param a The lower bound
+ * @param b The upper bound
+ * @param lo The lowest height counted
+ * @param hi The highest height counted
+ * @param ctr The counter for how many tests have been run
+ * @param fails The counter for how many tests have failed
+ * @param expected The expected integral
+ * @param delta Error tolerance
+ */
+void test_clamped(const Polynomial &poly,
+                  double a, double b,
+                  double lo, double hi,
+                  int *ctr, int *fails,
+                  double expected,
+                  double delta = 1e-12) {
+   Expr *expr = poly.to_expr();
+   double result = poly.clamped_integral(a, b, lo, hi);
+   printf("> Integral of ");
+   print_expr(expr, (FILE *)stdout);
+   printf(" on [%g, %g], clamped to [%g, %g] = %.12f\n", a, b, lo, hi, result);
+   destroy_expr(expr);
+
+   if (result < expected - delta || result > expected + delta) {
+      printf("FAILED! Expected: %.12f\n\n", expected);
+      ++*fails;
+   }
+   else {
+      printf("Success!\n\n");
+   }
+
+   ++*ctr;
+}
+
+/**
+ * Tests a Riemann sum against its expected value, and that it comes out exactly the same
+ * on one thread as on several
+ *
+ * @param rt The asmjit runtime
+ * @param fn The name of the function to sum
+ * @param settings The bounds, step and rule
+ * @param ectx The relevant symbol tables
+ * @param one A pool with a single thread
+ * @param many A pool with several threads
+ * @param ctr The counter for how many tests have been run
+ * @param fails The counter for how many tests have failed
+ * @param expected The expected value of the sum
+ * @param delta Error tolerance
+ */
+void test_rsum(JitRuntime &rt,
+               const char *fn,
+               const SumSettings &settings,
+               ExecCtx &ectx,
+               ThreadPool &one, ThreadPool &many,
+               int *ctr, int *fails,
+               double expected,
+               double delta) {
+   static const char *rules[] = { "left", "right", "midpoint", "trapezoid", "Simpson" };
+
+   const Expr *expr = ectx.exprTable.find(fn)->second;
+   double res_one = riemann_sum(expr, settings, rt, ectx, one),
+          res_many = riemann_sum(expr, settings, rt, ectx, many);
+   printf("> %s sum of %s on [%g, %g], step %g%s = %.12f\n",
+          rules[settings.rule], fn, settings.lower, settings.upper, settings.step,
+          settings.dd? " (double-double)": "", res_one);
+
+   if (res_one != res_many) {
+      printf("FAILED! %u threads gave %.17g\n\n", many.threads(), res_many);
+      ++*fails;
+   }
+   else if (res_one < expected - delta || res_one > expected + delta) {
+      printf("FAILED! Expected: %.12f\n\n", expected);
+      ++*fails;
+   }
+   else {
+      printf("Success!\n\n");
+   }
+
+   ++*ctr;
+}
+
 /**
  * Runs a series of tests for the expression evaluation program.
  *
@@ -146,7 +341,28 @@ int run_tests() {
       "G = 2^x * F(x)",
       "Ln = Log(x)/Log(e)",
       "One = Sin(x)^2 + Cos(x)^2",
-      "TaylorSin = x - (x^3/6) + (x^5/120)"
+      "TaylorSin = x - (x^3/6) + (x^5/120)",
+      "Area = Integral(F, 0, x)",
+      "Sq = x^2 + Sin(x)",
+      "DSq = D(Sq)",
+      "D2Sq = D(Sq, 2)",
+      "DArea = D(Area)",
+      "Hyp(x, y) = Sqrt(x^2 + y^2)",
+      "Lerp(a, b, t) = a + (b - a) t",
+      "Unit(t) = Hyp(Cos(t), Sin(t))",
+      "DUnit = D(Unit)",
+      "Rsq = 1/Sqrt(x)",
+      "Inv2 = 1/x^2",
+      "Cubic = (x - 1) * (x + 2)^2",
+      "CubicArea = Integral(Cubic, 1, x)",
+      "Quad = x^2",
+      "Ex = e^x",
+      "Touch = Sin(x - 1)^2",
+      "Compound = (1 + 1/x)^x",
+      "Triple = (x - 1)^3",
+      "Doubles = (x - 1)^2 (x - 2)^2",
+      "D(x) = 3x",
+      "Sum = x + 1"
    };
 
    ExecCtx ectx;
@@ -162,7 +378,27 @@ int run_tests() {
       { "e^(Ln(5) + Ln(2))", 10 },
       { "Cos(pi)", -1 },
       { "2[Sin(3 * pi/2)]", 2 },
-      { "One(1231.1233241)", 1 }};
+      { "One(1231.1233241)", 1 },
+      { "Integral(F, 0, 1)", 2 },
+      { "Integral(F, 1, 0)", -2 },
+      { "Area(3)", 12 },
+      { "DSq(1)", 2.5403 },
+      { "D2Sq(1)", 1.1585 },
+      { "DArea(2)", 5 },
+      { "Hyp(3, 4)", 5 },
+      { "Lerp(1, 3, 0.25)", 1.5 },
+      { "Unit(2)", 1 },
+      { "DUnit(2)", 0 },
+      { "Integral(Rsq, 0, 1)", 2 },
+      { "Integral(Log, 0, 1)", -1 },
+      { "Integral(Inv2, 0, 1)", INFINITY },
+      { "Integral(Inv2, 1, 0)", -INFINITY },
+      { "Integral(Tan, 0, 2)", NAN },
+      { "Integral(Cubic, -2, 1)", -6.75 },
+      { "CubicArea(3)", 38 },
+      { "D(2) + Sum(1)", 8 },
+      { "D(DSq(0))", 3 },
+      { "Integral(Sum, 0, 2)", 4 }};
  
    for (auto t: tests) {
       test_expr(rt, t.first, ectx, &ctr, &fails, t.second);
@@ -174,18 +410,98 @@ int run_tests() {
       { "Cos(2pi)", "Cos(0)" },
       { "Cos(2)^2", "1 - Sin(2)^2" },
       { "Sqrt(5)", "5^(1/2)" },
-      { "Sin(0.2)", "TaylorSin(0.2)" }};
+      { "Sin(0.2)", "TaylorSin(0.2)" },
+      { "Integral(Cos, 0, pi/2)", "Sin(pi/2)" },
+      { "D(Sin)", "Cos(0)" },
+      { "Hyp(Lerp(0, 6, 0.5), 4)", "5" }};
 
    for (auto t: eqtests) {
       test_equal(rt, t.first, t.second, ectx, &ctr, &fails);
    }
 
+   std::vector<const char *> errtests = {
+      "D(Sq, 0)",
+      "D(Sq, 2.7)",
+      "D(Sq, 1e12)",
+      "D(Sq, -1)" };
+
+   for (auto t: errtests) {
+      test_error(rt, t, ectx, &ctr, &fails);
+   }
+
+   std::vector<std::pair<const char *, std::vector<double>>> querytests = {
+      { "Roots(Cos, 0, 4)", { M_PI / 2 } },
+      { "Roots(Cos, 0, 8)", { M_PI / 2, 3 * M_PI / 2, 5 * M_PI / 2 } },
+      { "Roots(Touch, 0, 2)", { 1 } },
+      { "Roots(Tan, 1, 2)", {} },
+      { "Roots(Tan, 1, 4)", { M_PI } },
+      { "Extrema(Sin, 0, 7)", { M_PI / 2, 3 * M_PI / 2 } },
+      { "Sum(Inv2, 1)", { M_PI * M_PI / 6 } },
+      { "Limit(Compound, 1)", { M_E } }};
+
+   for (auto t: querytests) {
+      test_query(rt, t.first, ectx, &ctr, &fails, t.second);
+   }
+
+   // Polynomials are solved through their Sturm sequences, which place multiple roots exactly.
+   std::vector<std::pair<const char *, std::vector<double>>> polytests = {
+      { "Roots(Cubic, -5, 5)", { -2, 1 } },
+      { "Roots(Triple, -5, 5)", { 1 } },
+      { "Roots(Doubles, 0, 3)", { 1, 2 } },
+      { "Roots(Doubles, 1.5, 3)", { 2 } }};
+
+   for (auto t: polytests) {
+      test_query(rt, t.first, ectx, &ctr, &fails, t.second, 1e-12);
+   }
+
+   // Clipped below for |x| < 1/Sqrt(2) and above for |x| > Sqrt(3)
+   test_clamped(Polynomial({ 0, 0, 1 }), -2, 2, 0, 1, &ctr, &fails, 8.0 / 3);
+   test_clamped(Polynomial({ -1, 0, 1 }), -2, 2, -0.5, 2, &ctr, &fails,
+                8 + M_SQRT2 / 3 - 4 * std::sqrt(3.0));
+
+   // With four steps, each rule gives a different sum for x^2 on [0, 1].
+   std::vector<std::pair<SumRule, double>> rules = {
+      { LEFT, 14.0 / 64 },
+      { RIGHT, 30.0 / 64 },
+      { MIDPOINT, 21.0 / 64 },
+      { TRAPEZOID, 22.0 / 64 },
+      { SIMPSON, 1.0 / 3 }};
+
+   ThreadPool one(1), many(4);
+   for (auto t: rules) {
+      test_rsum(rt, "Quad", { 0, 1, 0.25, t.first, false, 1 }, ectx, one, many,
+                &ctr, &fails, t.second, 1e-12);
+   }
+
+   // Enough steps to be split into several blocks, which are added up the same way
+   //  however many threads there are. The error shrinks like the step for the left
+   //  and right rules, its square for the midpoint and trapezoid rules and its fourth
+   //  power for Simpson's.
+   std::vector<std::pair<SumRule, double>> exp_rules = {
+      { LEFT, 1e-5 },
+      { RIGHT, 1e-5 },
+      { MIDPOINT, 1e-10 },
+      { TRAPEZOID, 1e-10 },
+      { SIMPSON, 1e-13 }};
+
+   for (auto t: exp_rules) {
+      test_rsum(rt, "Ex", { 0, 1, 1.0 / 300000, t.first, false, 1 }, ectx, one, many,
+                &ctr, &fails, M_E - 1, t.second);
+   }
+
+   test_rsum(rt, "Ex", { 0, 1, 1.0 / 300000, SIMPSON, true, 1 }, ectx, one, many,
+             &ctr, &fails, M_E - 1, 1e-13);
+
    printf("%d tests completed. %d failures. %d successes.\n", ctr, fails, ctr - fails);
 
    for (auto f: ectx.fnTable) {
       rt.release(*f.second);
    }
 
+   for (auto f: ectx.nfnTable) {
+      rt.release(f.second.fn);
+   }
+
    return fails;
 }
  
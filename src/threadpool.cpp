@@ -0,0 +1,106 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(unsigned n_threads)
+   : body(nullptr),
+     size(0),
+     next(0),
+     pending(0),
+     generation(0),
+     stopping(false)
+{
+   // The calling thread does its share, so it isn't counted as a worker.
+   for (unsigned i = 1; i < n_threads; i++) {
+      workers.emplace_back(&ThreadPool::worker_loop, this);
+   }
+}
+
+ThreadPool::~ThreadPool() {
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+   }
+
+   wake.notify_all();
+   for (std::thread &worker: workers) {
+      worker.join();
+   }
+}
+
+void ThreadPool::work() {
+   for (int64_t i = next++; i < size; i = next++) {
+      (*body)(i);
+   }
+}
+
+void ThreadPool::worker_loop() {
+   uint64_t seen = 0;
+   while (true) {
+      {
+         std::unique_lock<std::mutex> guard(lock);
+         wake.wait(guard, [&] { return stopping || generation != seen; });
+         if (stopping) {
+            return;
+         }
+
+         seen = generation;
+      }
+
+      work();
+
+      std::lock_guard<std::mutex> guard(lock);
+      if (--pending == 0) {
+         finished.notify_all();
+      }
+   }
+}
+
+void ThreadPool::run(int64_t n, const std::function<void(int64_t)> &_body) {
+   std::lock_guard<std::mutex> serial(run_lock);
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      body = &_body;
+      size = n;
+      next = 0;
+      pending = workers.size();
+      generation++;
+   }
+
+   wake.notify_all();
+   work();
+
+   std::unique_lock<std::mutex> guard(lock);
+   finished.wait(guard, [&] { return pending == 0; });
+   body = nullptr;
+}
+
+unsigned ThreadPool::threads() const {
+   return workers.size() + 1;
+}
+
+ThreadPool &ThreadPool::shared() {
+   static ThreadPool pool;
+   return pool;
+}
+
+ThreadPool &ThreadPool::background() {
+   static ThreadPool pool;
+   return pool;
+}
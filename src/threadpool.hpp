@@ -0,0 +1,107 @@
+/*
+ * This file is part of the Riemann Project.
+ * Developed by Tom Faulhaber for personal use.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of worker threads for splitting loops across cores.
+ * Only one loop runs at a time; other callers wait their turn.
+ */
+class ThreadPool {
+   std::vector<std::thread> workers;
+
+   /* Held for the whole of a call to run() */
+   std::mutex run_lock;
+
+   /* Protects everything below */
+   std::mutex lock;
+   std::condition_variable wake, finished;
+
+   /* The loop being run */
+   const std::function<void(int64_t)> *body;
+   int64_t size;
+
+   /* The next index to hand out */
+   std::atomic<int64_t> next;
+
+   /* Workers which haven't finished the current loop */
+   size_t pending;
+
+   /* Incremented for every loop, so that workers can tell a new one has started */
+   uint64_t generation;
+
+   bool stopping;
+
+   /**
+    * Runs loop iterations until there are none left.
+    */
+   void work();
+
+   /**
+    * The main function of each worker thread.
+    */
+   void worker_loop();
+
+public:
+   /**
+    * Starts the workers.
+    *
+    * @param n_threads How many threads to run loops on, including the caller's
+    */
+   explicit ThreadPool(unsigned n_threads = std::thread::hardware_concurrency());
+
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool &) = delete;
+
+   /**
+    * Calls body(i) for every i in [0, n) across the pool and the calling thread.
+    * The order of the calls is unspecified. Returns once they have all finished.
+    *
+    * @param n The number of iterations
+    * @param body The loop body
+    */
+   void run(int64_t n, const std::function<void(int64_t)> &body);
+
+   /**
+    * Gets the number of threads loops run on.
+    */
+   unsigned threads() const;
+
+   /**
+    * Gets a pool with one thread per core, shared by the whole program.
+    */
+   static ThreadPool &shared();
+
+   /**
+    * Gets a second pool with one thread per core, for long computations run from
+    * background threads. A loop there can take seconds, and keeping it off the shared
+    * pool means the GTK thread never waits for one to finish.
+    */
+   static ThreadPool &background();
+};
+
+#endif